@@ -48,6 +48,7 @@ solution "burds_solution"
         SDL2_include,
 	}
 	
+	configuration {"windows"}
 	links {
 		"user32",
 		"shell32",
@@ -64,6 +65,13 @@ solution "burds_solution"
 		"opengl32",
 		SDL2_lib,
 	}
+
+	configuration {"linux"}
+	links {
+		"pthread",
+	}
+
+	configuration {}
 	
 	flags {
 		"NoExceptions",
@@ -77,7 +85,10 @@ solution "burds_solution"
 	--defines {}
 	
 	-- disable exception related warnings
+	configuration {"vs*"}
 	buildoptions{ "/wd4577", "/wd4530" }
+
+	configuration {}
 	
 
 project "burds_app"
@@ -106,6 +117,74 @@ project "burds_neat"
 		"src/imgui/*.cpp",
 	}
 
+-- simulation + evolution only, no window/GL/ImGui (runs on display-less servers)
+project "burds_app_headless"
+	kind "ConsoleApp"
+
+	configuration {}
+
+	defines {
+		"HEADLESS",
+	}
+
+	files {
+		"src/base.h",
+		"src/base.cpp",
+		"src/vec_math.h",
+		"src/sprite.h",
+		"src/neural.h",
+		"src/neural.cpp",
+		"src/snapshot.h",
+		"src/snapshot.cpp",
+		"src/export_c.h",
+		"src/export_c.cpp",
+		"src/wide_math.h",
+		"src/burds/burds_app.cpp",
+	}
+
+project "burds_neat_headless"
+	kind "ConsoleApp"
+
+	configuration {}
+
+	defines {
+		"HEADLESS",
+	}
+
+	files {
+		"src/base.h",
+		"src/base.cpp",
+		"src/vec_math.h",
+		"src/sprite.h",
+		"src/neat.h",
+		"src/neat.cpp",
+		"src/snapshot.h",
+		"src/snapshot.cpp",
+		"src/export_c.h",
+		"src/export_c.cpp",
+		"src/burds/burds_neat.cpp",
+	}
+
+-- timings of the evolution and inference kernels, written as JSON
+project "burds_bench"
+	kind "ConsoleApp"
+
+	configuration {}
+
+	files {
+		"src/base.h",
+		"src/base.cpp",
+		"src/neural.h",
+		"src/neural.cpp",
+		"src/snapshot.h",
+		"src/snapshot.cpp",
+		"src/export_c.h",
+		"src/export_c.cpp",
+		"src/neat.h",
+		"src/neat.cpp",
+		"src/bench/burds_bench.cpp",
+	}
+
 
 project "frogs_app"
 	kind "WindowedApp"
@@ -133,6 +212,53 @@ project "frogs_neat"
 		"src/imgui/*.cpp",
 	}
 
+project "frogs_app_headless"
+	kind "ConsoleApp"
+
+	configuration {}
+
+	defines {
+		"HEADLESS",
+	}
+
+	files {
+		"src/base.h",
+		"src/base.cpp",
+		"src/vec_math.h",
+		"src/sprite.h",
+		"src/neural.h",
+		"src/neural.cpp",
+		"src/snapshot.h",
+		"src/snapshot.cpp",
+		"src/export_c.h",
+		"src/export_c.cpp",
+		"src/wide_math.h",
+		"src/frogs/frogs_app.cpp",
+	}
+
+project "frogs_neat_headless"
+	kind "ConsoleApp"
+
+	configuration {}
+
+	defines {
+		"HEADLESS",
+	}
+
+	files {
+		"src/base.h",
+		"src/base.cpp",
+		"src/vec_math.h",
+		"src/sprite.h",
+		"src/neat.h",
+		"src/neat.cpp",
+		"src/snapshot.h",
+		"src/snapshot.cpp",
+		"src/export_c.h",
+		"src/export_c.cpp",
+		"src/frogs/frogs_neat.cpp",
+	}
+
     
 project "xor_app"
 	kind "WindowedApp"
@@ -1,11 +1,25 @@
+#include <random>
 #include "base.h"
+#include <assert.h>
+#include <emmintrin.h>
+#include <stdlib.h>
+#include <math.h>
+#include <immintrin.h>
+
+#ifdef _WIN32
 #include <windows.h>
+#endif
+
+#ifdef _WIN32
 
 timept startCounter;
 i64 PERFORMANCE_FREQUENCY;
 
+static u64 g_startCycles;
+
 void timeInit()
 {
+    g_startCycles = timeCycles();
     LARGE_INTEGER li;
     QueryPerformanceFrequency(&li);
     PERFORMANCE_FREQUENCY = (i64)li.QuadPart;
@@ -21,14 +35,1208 @@ timept timeGet()
     return ((timept)li.QuadPart - startCounter);
 }
 
+#else
+// monotonic clock, counted in nanoseconds
+timept startCounter;
+const i64 PERFORMANCE_FREQUENCY = 1000000000;
+
+static timept timeMonotonicNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (timept)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static u64 g_startCycles;
+
+void timeInit()
+{
+    g_startCycles = timeCycles();
+    startCounter = timeMonotonicNs();
+    LOG("performanceFrequency=%lld", (long long)PERFORMANCE_FREQUENCY);
+}
+
+timept timeGet()
+{
+    return timeMonotonicNs() - startCounter;
+}
+#endif
+
+// split in whole seconds + remainder so long headless runs don't overflow
 i64 timeToMicrosec(i64 delta)
 {
-    return (delta * 1000000) / PERFORMANCE_FREQUENCY;
+    return (delta / PERFORMANCE_FREQUENCY) * 1000000 +
+           ((delta % PERFORMANCE_FREQUENCY) * 1000000) / PERFORMANCE_FREQUENCY;
 }
 
 i64 timeGetMicro()
 {
-    return (timeGet() * 1000000) / PERFORMANCE_FREQUENCY;
+    return timeToMicrosec(timeGet());
+}
+
+f64 timeCyclesToMicro(u64 cycles)
+{
+    const i64 elapsedMicro = timeGetMicro();
+    const u64 elapsedCycles = timeCycles() - g_startCycles;
+    if(elapsedMicro <= 0 || elapsedCycles == 0) {
+        return 0.0;
+    }
+    return cycles * ((f64)elapsedMicro / elapsedCycles);
+}
+
+// counters of exited threads are kept so their last zones still get collected
+#define PROFILE_MAX_THREADS 256
+// smoothing factor of the per frame averages
+#define PROFILE_AVERAGE_WEIGHT (1.0 / 30.0)
+
+struct Profiler
+{
+    std::mutex mutex;
+    const char* zoneNames[PROFILE_MAX_ZONES];
+    i32 zoneCount = 0;
+
+    ProfileCounters* threads[PROFILE_MAX_THREADS];
+    u64 seenCycles[PROFILE_MAX_THREADS][PROFILE_MAX_ZONES];
+    u64 seenCalls[PROFILE_MAX_THREADS][PROFILE_MAX_ZONES];
+    i32 threadCount = 0;
+
+    ProfileStats lastFrame;
+    ProfileStats totals;
+    f64 avgZoneCycles[PROFILE_MAX_ZONES];
+    f64 avgFrameCycles = 0.0;
+    u64 frameStart = 0;
+};
+
+static Profiler g_profiler;
+thread_local ProfileCounters* g_profileCounters = nullptr;
+
+ProfileCounters* profileThreadCounters()
+{
+    Profiler& p = g_profiler;
+    std::lock_guard<std::mutex> lock(p.mutex);
+
+    if(p.threadCount == PROFILE_MAX_THREADS) {
+        // counts may get lost from now on, but nothing breaks
+        g_profileCounters = p.threads[PROFILE_MAX_THREADS - 1];
+        return g_profileCounters;
+    }
+
+    ProfileCounters* c = new ProfileCounters();
+    const i32 id = p.threadCount++;
+    p.threads[id] = c;
+    memset(p.seenCycles[id], 0, sizeof(p.seenCycles[id]));
+    memset(p.seenCalls[id], 0, sizeof(p.seenCalls[id]));
+    g_profileCounters = c;
+    return c;
+}
+
+i32 profileZoneRegister(const char* name)
+{
+    Profiler& p = g_profiler;
+    std::lock_guard<std::mutex> lock(p.mutex);
+
+    for(i32 z = 0; z < p.zoneCount; ++z) {
+        if(strcmp(p.zoneNames[z], name) == 0) {
+            return z;
+        }
+    }
+
+    assert(p.zoneCount < PROFILE_MAX_ZONES);
+    const i32 zoneId = p.zoneCount++;
+    p.zoneNames[zoneId] = name;
+    p.avgZoneCycles[zoneId] = 0.0;
+    return zoneId;
+}
+
+i32 profileZoneCount()
+{
+    Profiler& p = g_profiler;
+    std::lock_guard<std::mutex> lock(p.mutex);
+    return p.zoneCount;
 }
 
-u64 g_RandSeed= 0xdeadbeefcdcd;
+const char* profileZoneName(i32 zoneId)
+{
+    Profiler& p = g_profiler;
+    std::lock_guard<std::mutex> lock(p.mutex);
+    assert(zoneId >= 0 && zoneId < p.zoneCount);
+    return p.zoneNames[zoneId];
+}
+
+void profileFrameEnd()
+{
+    Profiler& p = g_profiler;
+    const u64 now = timeCycles();
+
+    ProfileStats& frame = p.lastFrame;
+    frame = {};
+    frame.frameCount = 1;
+    frame.frameCycles = p.frameStart ? now - p.frameStart : 0;
+    p.frameStart = now;
+
+    i32 zoneCount;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        zoneCount = p.zoneCount;
+        for(i32 t = 0; t < p.threadCount; ++t) {
+            const ProfileCounters& c = *p.threads[t];
+            for(i32 z = 0; z < zoneCount; ++z) {
+                const u64 cycles = c.cycles[z].load(std::memory_order_relaxed);
+                const u64 calls = c.calls[z].load(std::memory_order_relaxed);
+                frame.zoneCycles[z] += cycles - p.seenCycles[t][z];
+                frame.zoneCalls[z] += calls - p.seenCalls[t][z];
+                p.seenCycles[t][z] = cycles;
+                p.seenCalls[t][z] = calls;
+            }
+        }
+    }
+
+    ProfileStats& totals = p.totals;
+    const bool firstFrame = totals.frameCount == 0;
+    totals.frameCount++;
+    totals.frameCycles += frame.frameCycles;
+    for(i32 z = 0; z < zoneCount; ++z) {
+        totals.zoneCycles[z] += frame.zoneCycles[z];
+        totals.zoneCalls[z] += frame.zoneCalls[z];
+        p.avgZoneCycles[z] += (frame.zoneCycles[z] - p.avgZoneCycles[z]) * PROFILE_AVERAGE_WEIGHT;
+    }
+    if(firstFrame) {
+        p.avgFrameCycles = frame.frameCycles;
+    }
+    p.avgFrameCycles += (frame.frameCycles - p.avgFrameCycles) * PROFILE_AVERAGE_WEIGHT;
+}
+
+const ProfileStats& profileLastFrame()
+{
+    return g_profiler.lastFrame;
+}
+
+const ProfileStats& profileTotals()
+{
+    return g_profiler.totals;
+}
+
+f64 profileAverageMicro(i32 zoneId)
+{
+    return timeCyclesToMicro(g_profiler.avgZoneCycles[zoneId]);
+}
+
+f64 profileAverageFrameMicro()
+{
+    return timeCyclesToMicro(g_profiler.avgFrameCycles);
+}
+
+void profileResetTotals()
+{
+    g_profiler.totals = {};
+}
+
+void profileLogTotals(const char* prefix)
+{
+    const ProfileStats& totals = g_profiler.totals;
+    if(totals.frameCount == 0) return;
+
+    const f64 frameCount = totals.frameCount;
+    LOG("%s %lld frames, %.2fus per frame", prefix, (long long)totals.frameCount,
+        timeCyclesToMicro(totals.frameCycles) / frameCount);
+
+    const i32 zoneCount = profileZoneCount();
+    for(i32 z = 0; z < zoneCount; ++z) {
+        if(totals.zoneCalls[z] == 0) continue;
+        const f64 micro = timeCyclesToMicro(totals.zoneCycles[z]);
+        LOG("%s   %-12s %10.2fus/frame %10.2fus/call %8llu calls", prefix, profileZoneName(z),
+            micro / frameCount, micro / totals.zoneCalls[z], (unsigned long long)totals.zoneCalls[z]);
+    }
+}
+
+static u64 g_randSeed = 0x1245;
+// usable before randSetSeed(), threads that are never seeded all share this sequence
+thread_local RandState g_randState = {{
+    0x0c9a7f4e51d2b8a3, 0x6e1f5b3c92d4a781, 0x3b8d2e6f1a4c9057, 0x9d4a1c7e5f2b8063
+}};
+
+static u64 splitmix64(u64* x)
+{
+    u64 z = (*x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static thread_local RandWideState g_randWideState;
+
+static void randWideSeed(RandWideState* w, u64* x)
+{
+    for(i32 lane = 0; lane < 4; ++lane) {
+        for(i32 k = 0; k < 4; ++k) {
+            w->s[k][lane] = splitmix64(x);
+        }
+    }
+    w->seeded = true;
+}
+
+void randSetSeed(u64 seed)
+{
+    g_randSeed = seed;
+    randSeedThread(RAND_STREAM_MAIN);
+}
+
+// splitmix64 never outputs 4 zeros in a row so the xoshiro state is always valid
+static void randSeedState(RandState* state, RandWideState* wide, u64 key, u64 streamId)
+{
+    u64 x = key + streamId * 0xd1b54a32d192ed03;
+    for(i32 i = 0; i < 4; ++i) {
+        state->s[i] = splitmix64(&x);
+    }
+    randWideSeed(wide, &x);
+}
+
+void randSeedThread(u64 streamId)
+{
+    randSeedState(&g_randState, &g_randWideState, g_randSeed, streamId);
+}
+
+void randStreamSeed(RandStream* stream, u64 key, u64 streamId)
+{
+    randSeedState(&stream->state, &stream->wide, key, streamId);
+}
+
+void randStreamSwap(RandStream* stream)
+{
+    const RandState state = g_randState;
+    g_randState = stream->state;
+    stream->state = state;
+
+    const RandWideState wide = g_randWideState;
+    g_randWideState = stream->wide;
+    stream->wide = wide;
+}
+
+u64 randGetSeed()
+{
+    return g_randSeed;
+}
+
+u64 randDefaultSeed()
+{
+    u64 seed;
+    const char* env = getenv("RAND_SEED");
+    if(env && env[0]) {
+        seed = strtoull(env, nullptr, 0);
+    }
+    else {
+        std::random_device randomDevice;
+        seed = ((u64)randomDevice() << 32) ^ randomDevice() ^ (u64)time(NULL);
+    }
+    LOG("randSeed=0x%llx (RAND_SEED=0x%llx to replay)", (unsigned long long)seed,
+        (unsigned long long)seed);
+    return seed;
+}
+
+// threads that never called randSeedThread() derive their lanes from the scalar stream
+static RandWideState& randWideGet()
+{
+    RandWideState& w = g_randWideState;
+    if(!w.seeded) {
+        u64 x = randu64();
+        randWideSeed(&w, &x);
+    }
+    return w;
+}
+
+#ifdef __AVX2__
+static inline __m256i randWideRotl(__m256i x, i32 k)
+{
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+#endif
+
+void randFillU64(u64* out, i32 count)
+{
+    RandWideState& w = randWideGet();
+    i32 i = 0;
+
+#ifdef __AVX2__
+    __m256i s0 = _mm256_loadu_si256((const __m256i*)w.s[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i*)w.s[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i*)w.s[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i*)w.s[3]);
+
+    for(; i + 4 <= count; i += 4) {
+        // no 64 bit multiply in AVX2: x * 5 = (x << 2) + x, x * 9 = (x << 3) + x
+        const __m256i x5 = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+        const __m256i r = randWideRotl(x5, 7);
+        const __m256i result = _mm256_add_epi64(_mm256_slli_epi64(r, 3), r);
+        _mm256_storeu_si256((__m256i*)(out + i), result);
+
+        const __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = randWideRotl(s3, 45);
+    }
+
+    _mm256_storeu_si256((__m256i*)w.s[0], s0);
+    _mm256_storeu_si256((__m256i*)w.s[1], s1);
+    _mm256_storeu_si256((__m256i*)w.s[2], s2);
+    _mm256_storeu_si256((__m256i*)w.s[3], s3);
+#endif
+
+    // scalar lanes, also used for the tail (which steps all 4 lanes and drops the extra values)
+    for(; i < count; i += 4) {
+        for(i32 lane = 0; lane < 4; ++lane) {
+            const u64 s1 = w.s[1][lane];
+            const u64 result = randRotl(s1 * 5, 7) * 9;
+            const u64 t = s1 << 17;
+            w.s[2][lane] ^= w.s[0][lane];
+            w.s[3][lane] ^= w.s[1][lane];
+            w.s[1][lane] ^= w.s[2][lane];
+            w.s[0][lane] ^= w.s[3][lane];
+            w.s[2][lane] ^= t;
+            w.s[3][lane] = randRotl(w.s[3][lane], 45);
+            if(i + lane < count) {
+                out[i + lane] = result;
+            }
+        }
+    }
+}
+
+// randFillUnit converts its u64 bits to f64 in place, randFillBelow and the dense path of
+// randSampleEvents draw theirs through a stack buffer of RAND_FILL_CHUNK values
+#define RAND_FILL_CHUNK 256
+
+void randFillUnit(f64* out, i32 count)
+{
+    static_assert(sizeof(f64) == sizeof(u64), "");
+    u64* bits = (u64*)out;
+    randFillU64(bits, count);
+    for(i32 i = 0; i < count; ++i) {
+        out[i] = (bits[i] >> 11) * (1.0 / 9007199254740992.0);
+    }
+}
+
+void randFillF64(f64* out, i32 count, f64 vmin, f64 vmax)
+{
+    randFillUnit(out, count);
+    const f64 range = vmax - vmin;
+    for(i32 i = 0; i < count; ++i) {
+        out[i] = vmin + out[i] * range;
+    }
+}
+
+void randFillBelow(i32* out, i32 count, i32 n)
+{
+    assert(n > 0);
+    u64 bits[RAND_FILL_CHUNK];
+    const u64 threshold = (0 - (u64)n) % (u64)n;
+
+    for(i32 c = 0; c < count; c += RAND_FILL_CHUNK) {
+        const i32 chunkCount = min(count - c, RAND_FILL_CHUNK);
+        randFillU64(bits, chunkCount);
+        for(i32 i = 0; i < chunkCount; ++i) {
+            u64 hi;
+            const u64 lo = randMul128(bits[i], (u64)n, &hi);
+            // rejected values (probability n / 2^64) are redrawn from the scalar stream
+            out[c + i] = lo < threshold ? (i32)randBelow(n) : (i32)hi;
+        }
+    }
+}
+
+void randFillNormal(f64* out, i32 count, f64 mean, f64 stddev)
+{
+    randFillUnit(out, count);
+    for(i32 i = 0; i < count; i += 2) {
+        // 1 - u is in (0, 1], log() stays finite
+        const f64 radius = sqrt(-2.0 * log(1.0 - out[i])) * stddev;
+        const f64 angle = TAU * (i + 1 < count ? out[i + 1] : randUnit());
+        out[i] = mean + radius * cos(angle);
+        if(i + 1 < count) {
+            out[i + 1] = mean + radius * sin(angle);
+        }
+    }
+}
+
+// above this chance comparing one uniform per individual is cheaper than a log per event
+#define RAND_EVENT_DENSE_CHANCE 0.2
+
+i32 randSampleEvents(i32* outIds, i32 count, f64 chance)
+{
+    if(chance <= 0.0 || count <= 0) {
+        return 0;
+    }
+
+    i32 eventCount = 0;
+    if(chance >= 1.0) {
+        for(i32 i = 0; i < count; ++i) {
+            outIds[eventCount++] = i;
+        }
+        return eventCount;
+    }
+
+    if(chance > RAND_EVENT_DENSE_CHANCE) {
+        f64 u[RAND_FILL_CHUNK];
+        for(i32 c = 0; c < count; c += RAND_FILL_CHUNK) {
+            const i32 chunkCount = min(count - c, RAND_FILL_CHUNK);
+            randFillUnit(u, chunkCount);
+            for(i32 i = 0; i < chunkCount; ++i) {
+                if(u[i] < chance) {
+                    outIds[eventCount++] = c + i;
+                }
+            }
+        }
+        return eventCount;
+    }
+
+    // gap to the next event is geometric: floor(log(u) / log(1 - chance))
+    const f64 logMiss = log1p(-chance);
+    i64 id = -1;
+    while(true) {
+        const f64 gap = floor(log(1.0 - randUnit()) / logMiss);
+        if(gap >= (f64)(count - 1 - id)) {
+            break;
+        }
+        id += (i64)gap + 1;
+        outIds[eventCount++] = (i32)id;
+    }
+    return eventCount;
+}
+
+// TRACE
+#define TRACE_BUFFER_EVENT_COUNT 16384
+#define TRACE_MAX_THREADS 256
+#define TRACE_FLUSH_INTERVAL_MICRO 5000
+
+struct TraceEvent
+{
+    u64 start;
+    u64 end;
+    i32 zoneId;
+};
+
+struct TraceBuffer
+{
+    SpscQueue<TraceEvent, TRACE_BUFFER_EVENT_COUNT> queue;
+    std::atomic<u32> droppedCount{0};
+    i32 tid;
+};
+
+// like the profile counters, buffers of exited threads are kept
+struct TraceRecorder
+{
+    std::mutex mutex; // threads[] and threadCount
+    TraceBuffer* threads[TRACE_MAX_THREADS];
+    i32 threadCount = 0;
+    bool threadNamed[TRACE_MAX_THREADS];
+
+    std::mutex controlMutex; // start/stop
+    FILE* file = nullptr;
+    i64 eventCount = 0;
+    std::thread writer;
+    std::atomic<bool> writerQuit{false};
+    bool atExitRegistered = false;
+};
+
+std::atomic<bool> g_traceEnabled{false};
+static TraceRecorder g_trace;
+static thread_local TraceBuffer* g_traceBuffer = nullptr;
+
+static TraceBuffer* traceThreadBuffer()
+{
+    TraceRecorder& tr = g_trace;
+    std::lock_guard<std::mutex> lock(tr.mutex);
+    if(tr.threadCount == TRACE_MAX_THREADS) {
+        return nullptr;
+    }
+
+    TraceBuffer* buffer = new TraceBuffer();
+    buffer->tid = tr.threadCount++;
+    tr.threads[buffer->tid] = buffer;
+    tr.threadNamed[buffer->tid] = false;
+    g_traceBuffer = buffer;
+    return buffer;
+}
+
+void traceRecord(i32 zoneId, u64 start, u64 end)
+{
+    TraceBuffer* buffer = g_traceBuffer ? g_traceBuffer : traceThreadBuffer();
+    if(!buffer) return;
+
+    if(!buffer->queue.push({ start, end, zoneId })) {
+        buffer->droppedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+static void traceWriteEvent(TraceRecorder& tr, const char* json)
+{
+    fprintf(tr.file, "%s%s", tr.eventCount > 0 ? ",\n" : "", json);
+    tr.eventCount++;
+}
+
+// writer thread, or the thread calling traceStop() once the writer is gone
+static void traceDrain(bool discard)
+{
+    TraceRecorder& tr = g_trace;
+    char json[256];
+
+    i32 threadCount;
+    {
+        std::lock_guard<std::mutex> lock(tr.mutex);
+        threadCount = tr.threadCount;
+    }
+
+    for(i32 t = 0; t < threadCount; ++t) {
+        TraceBuffer& buffer = *tr.threads[t];
+        TraceEvent event;
+
+        if(discard) {
+            while(buffer.queue.pop(&event));
+            continue;
+        }
+
+        if(!tr.threadNamed[t]) {
+            snprintf(json, sizeof(json), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                     "\"args\":{\"name\":\"thread %d\"}}", buffer.tid, buffer.tid);
+            traceWriteEvent(tr, json);
+            tr.threadNamed[t] = true;
+        }
+
+        while(buffer.queue.pop(&event)) {
+            const f64 ts = timeCyclesToMicro(event.start - g_startCycles);
+            const f64 dur = timeCyclesToMicro(event.end - event.start);
+            snprintf(json, sizeof(json), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+                     "\"ts\":%.3f,\"dur\":%.3f}", profileZoneName(event.zoneId), buffer.tid, ts, dur);
+            traceWriteEvent(tr, json);
+        }
+    }
+}
+
+static void traceWriterRun()
+{
+    TraceRecorder& tr = g_trace;
+    while(!tr.writerQuit.load(std::memory_order_acquire)) {
+        traceDrain(false);
+        std::this_thread::sleep_for(std::chrono::microseconds(TRACE_FLUSH_INTERVAL_MICRO));
+    }
+}
+
+bool traceStart(const char* path)
+{
+    TraceRecorder& tr = g_trace;
+    std::lock_guard<std::mutex> lock(tr.controlMutex);
+    if(tr.file) return false;
+
+    tr.file = fopen(path, "wb");
+    if(!tr.file) {
+        LOG("ERROR: trace> could not open %s", path);
+        return false;
+    }
+
+    if(!tr.atExitRegistered) {
+        atexit(traceStop);
+        tr.atExitRegistered = true;
+    }
+
+    // leftovers from a previous recording
+    traceDrain(true);
+    for(i32 t = 0; t < TRACE_MAX_THREADS; ++t) {
+        tr.threadNamed[t] = false;
+    }
+
+    fprintf(tr.file, "[\n");
+    tr.eventCount = 0;
+    tr.writerQuit = false;
+    tr.writer = std::thread(traceWriterRun);
+    g_traceEnabled = true;
+
+    LOG("trace> recording to %s", path);
+    return true;
+}
+
+void traceStop()
+{
+    TraceRecorder& tr = g_trace;
+    std::lock_guard<std::mutex> lock(tr.controlMutex);
+    if(!tr.file) return;
+
+    g_traceEnabled = false;
+    tr.writerQuit.store(true, std::memory_order_release);
+    tr.writer.join();
+    traceDrain(false);
+
+    u32 droppedCount = 0;
+    {
+        std::lock_guard<std::mutex> threadLock(tr.mutex);
+        for(i32 t = 0; t < tr.threadCount; ++t) {
+            droppedCount += tr.threads[t]->droppedCount.exchange(0, std::memory_order_relaxed);
+        }
+    }
+
+    fprintf(tr.file, "\n]\n");
+    fclose(tr.file);
+    tr.file = nullptr;
+
+    LOG("trace> %lld events written, %u dropped", (long long)tr.eventCount, droppedCount);
+}
+
+bool traceIsRecording()
+{
+    return g_traceEnabled.load(std::memory_order_relaxed);
+}
+
+void traceStartFromEnv()
+{
+    const char* path = getenv("TRACE_FILE");
+    if(path && path[0]) {
+        traceStart(path);
+    }
+}
+
+// a simulation step only lasts tens of microseconds, so idle workers spin for a while
+// before going to sleep on the condition variable
+// past the pause phase the spinning thread yields, in case there are more threads than cores
+#define THREAD_POOL_SPIN_PAUSE_COUNT 2000
+#define THREAD_POOL_SPIN_COUNT 20000
+#define THREAD_POOL_DEQUE_SIZE 256 // per worker, power of 2
+#define THREAD_POOL_BACKGROUND_SIZE 256 // power of 2
+
+static inline void threadPoolSpinWait(i32 spin)
+{
+    if(spin < THREAD_POOL_SPIN_PAUSE_COUNT) {
+        _mm_pause();
+    }
+    else {
+        std::this_thread::yield();
+    }
+}
+
+struct Task
+{
+    TaskGraphNode* node;
+    i32 chunkId;
+};
+
+// the owner pushes and pops at the back, thieves pop at the front
+// the lock is only held for a few instructions, head and tail can be peeked at without it
+struct TaskDeque
+{
+    std::atomic<bool> locked{false};
+    std::atomic<u32> head{0};
+    std::atomic<u32> tail{0};
+    Task tasks[THREAD_POOL_DEQUE_SIZE];
+    u8 pad[64]; // keep neighbouring deques off the same cache line
+
+    void lock()
+    {
+        while(locked.exchange(true, std::memory_order_acquire)) {
+            _mm_pause();
+        }
+    }
+
+    void unlock()
+    {
+        locked.store(false, std::memory_order_release);
+    }
+
+    bool isEmpty() const
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_relaxed);
+    }
+
+    // returns false when full
+    bool push(const Task& task)
+    {
+        lock();
+        const u32 t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_relaxed) == THREAD_POOL_DEQUE_SIZE) {
+            unlock();
+            return false;
+        }
+        tasks[t & (THREAD_POOL_DEQUE_SIZE - 1)] = task;
+        tail.store(t + 1, std::memory_order_relaxed);
+        unlock();
+        return true;
+    }
+
+    bool popBack(Task* task)
+    {
+        if(isEmpty()) return false;
+        lock();
+        const u32 t = tail.load(std::memory_order_relaxed);
+        if(t == head.load(std::memory_order_relaxed)) {
+            unlock();
+            return false;
+        }
+        *task = tasks[(t - 1) & (THREAD_POOL_DEQUE_SIZE - 1)];
+        tail.store(t - 1, std::memory_order_relaxed);
+        unlock();
+        return true;
+    }
+
+    bool popFront(Task* task)
+    {
+        if(isEmpty()) return false;
+        lock();
+        const u32 h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_relaxed)) {
+            unlock();
+            return false;
+        }
+        *task = tasks[h & (THREAD_POOL_DEQUE_SIZE - 1)];
+        head.store(h + 1, std::memory_order_relaxed);
+        unlock();
+        return true;
+    }
+};
+
+struct ThreadPool
+{
+    std::thread workers[THREAD_POOL_MAX_THREADS];
+    TaskDeque deques[THREAD_POOL_MAX_THREADS];
+    i32 threadCount = 1;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<u32> workEpoch{0}; // bumped every time tasks are pushed
+    std::atomic<i32> sleeperCount{0};
+    std::atomic<bool> quit{false};
+
+    // tasks of background graphs, only taken by idle pool threads and by taskGraphWait()
+    // so a worker waiting on a short parallel for never gets stuck in a long background task
+    std::mutex backgroundMutex;
+    Task background[THREAD_POOL_BACKGROUND_SIZE];
+    u32 backgroundHead = 0;
+    u32 backgroundTail = 0;
+    std::atomic<i32> backgroundCount{0};
+};
+
+static ThreadPool g_threadPool;
+static thread_local i32 g_threadPoolWorkerId = -1;
+
+static void threadPoolNotify()
+{
+    ThreadPool& tp = g_threadPool;
+    tp.workEpoch.fetch_add(1);
+    if(tp.sleeperCount.load() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(tp.mutex);
+        }
+        tp.cv.notify_all();
+    }
+}
+
+static bool threadPoolPushBackground(const Task& task)
+{
+    ThreadPool& tp = g_threadPool;
+    std::lock_guard<std::mutex> lock(tp.backgroundMutex);
+    if(tp.backgroundTail - tp.backgroundHead == THREAD_POOL_BACKGROUND_SIZE) {
+        return false;
+    }
+    tp.background[tp.backgroundTail++ & (THREAD_POOL_BACKGROUND_SIZE - 1)] = task;
+    tp.backgroundCount.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+static bool threadPoolPopBackground(Task* task)
+{
+    ThreadPool& tp = g_threadPool;
+    if(tp.backgroundCount.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(tp.backgroundMutex);
+    if(tp.backgroundHead == tp.backgroundTail) {
+        return false;
+    }
+    *task = tp.background[tp.backgroundHead++ & (THREAD_POOL_BACKGROUND_SIZE - 1)];
+    tp.backgroundCount.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+static void taskRun(const Task& task);
+
+static void taskNodeLaunch(TaskGraphNode* node, i32 workerId);
+
+// called once the last chunk of a graph node returned
+static void taskNodeDone(TaskGraphNode* node, i32 workerId)
+{
+    TaskGraph* graph = node->graph;
+    for(i32 d = 0; d < node->dependentCount; ++d) {
+        TaskGraphNode* dependent = &graph->nodes[node->dependents[d]];
+        if(dependent->waitCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            taskNodeLaunch(dependent, workerId);
+        }
+    }
+    // last access, the graph may be gone as soon as it reaches 0
+    graph->nodesLeft.fetch_sub(1, std::memory_order_release);
+}
+
+static void taskNodeLaunch(TaskGraphNode* node, i32 workerId)
+{
+    ThreadPool& tp = g_threadPool;
+    if(node->count <= 0) {
+        taskNodeDone(node, workerId);
+        return;
+    }
+
+    const bool background = node->graph && node->graph->background;
+    assert(background || workerId >= 0);
+    for(i32 c = 0; c < node->chunkCount; ++c) {
+        const Task task = { node, c };
+        const bool pushed = background ? threadPoolPushBackground(task) :
+                            tp.deques[(workerId + c) % tp.threadCount].push(task);
+        // queue full, run it right away
+        if(!pushed) {
+            taskRun(task);
+        }
+    }
+    threadPoolNotify();
+}
+
+static void taskRun(const Task& task)
+{
+    TaskGraphNode* node = task.node;
+    const i32 start = (i64)node->count * task.chunkId / node->chunkCount;
+    const i32 end = (i64)node->count * (task.chunkId + 1) / node->chunkCount;
+    const i64 mark = scratchMark();
+    node->func(node->userData, start, end, task.chunkId);
+    scratchRewind(mark);
+
+    // a plain parallel for can go out of scope as soon as chunksLeft reaches 0
+    TaskGraph* graph = node->graph;
+    if(node->chunksLeft.fetch_sub(1, std::memory_order_acq_rel) == 1 && graph) {
+        taskNodeDone(node, g_threadPoolWorkerId);
+    }
+}
+
+// own deque first, then steal, returns false when there was nothing to run
+// threads outside the pool only take background tasks
+static bool threadPoolRunOne(i32 workerId, bool takeBackground)
+{
+    ThreadPool& tp = g_threadPool;
+    Task task;
+    if(workerId >= 0) {
+        if(tp.deques[workerId].popBack(&task)) {
+            taskRun(task);
+            return true;
+        }
+        for(i32 i = 1; i < tp.threadCount; ++i) {
+            if(tp.deques[(workerId + i) % tp.threadCount].popFront(&task)) {
+                taskRun(task);
+                return true;
+            }
+        }
+    }
+    if(takeBackground && threadPoolPopBackground(&task)) {
+        taskRun(task);
+        return true;
+    }
+    return false;
+}
+
+// runs other tasks until *counter reaches 0
+static void threadPoolHelpUntilZero(const std::atomic<i32>* counter, bool takeBackground)
+{
+    const i32 workerId = g_threadPoolWorkerId;
+    i32 spin = 0;
+    while(counter->load(std::memory_order_acquire) > 0) {
+        if(threadPoolRunOne(workerId, takeBackground)) {
+            spin = 0;
+        }
+        else {
+            threadPoolSpinWait(++spin);
+        }
+    }
+}
+
+static void threadPoolWorker(i32 workerId)
+{
+    ThreadPool& tp = g_threadPool;
+    g_threadPoolWorkerId = workerId;
+    randSeedThread(RAND_STREAM_THREAD_POOL + workerId);
+
+    i32 spin = 0;
+    while(!tp.quit.load(std::memory_order_relaxed)) {
+        const u32 epoch = tp.workEpoch.load();
+        if(threadPoolRunOne(workerId, true)) {
+            spin = 0;
+            continue;
+        }
+        if(++spin < THREAD_POOL_SPIN_COUNT) {
+            threadPoolSpinWait(spin);
+            continue;
+        }
+
+        // tasks pushed after epoch was read bump it, so they can't be missed
+        tp.sleeperCount.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(tp.mutex);
+            tp.cv.wait(lock, [&] {
+                return tp.workEpoch.load() != epoch || tp.quit.load(std::memory_order_relaxed);
+            });
+        }
+        tp.sleeperCount.fetch_sub(1);
+        spin = 0;
+    }
+}
+
+void threadPoolInit(i32 threadCount)
+{
+    ThreadPool& tp = g_threadPool;
+    assert(tp.threadCount == 1); // already initialized
+
+    if(threadCount <= 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    tp.threadCount = clamp(threadCount, 1, THREAD_POOL_MAX_THREADS);
+    tp.quit = false;
+    g_threadPoolWorkerId = 0;
+
+    for(i32 i = 1; i < tp.threadCount; ++i) {
+        tp.workers[i] = std::thread(threadPoolWorker, i);
+    }
+
+    LOG("threadPool: %d threads", tp.threadCount);
+}
+
+void threadPoolShutdown()
+{
+    ThreadPool& tp = g_threadPool;
+    assert(tp.backgroundCount.load() == 0); // background graph still running
+    {
+        std::lock_guard<std::mutex> lock(tp.mutex);
+        tp.quit = true;
+    }
+    tp.cv.notify_all();
+
+    for(i32 i = 1; i < tp.threadCount; ++i) {
+        tp.workers[i].join();
+    }
+    tp.threadCount = 1;
+    g_threadPoolWorkerId = -1;
+}
+
+i32 threadPoolThreadCount()
+{
+    return g_threadPool.threadCount;
+}
+
+i32 threadPoolWorkerId()
+{
+    return g_threadPoolWorkerId;
+}
+
+void parallelForRaw(i32 count, i32 chunkCount, TaskFunc func, void* userData)
+{
+    if(count <= 0) return;
+    chunkCount = clamp(chunkCount, 1, count);
+
+    // not worth waking the workers up, or not a worker
+    const i32 workerId = g_threadPoolWorkerId;
+    if(g_threadPool.threadCount == 1 || chunkCount == 1 || workerId < 0) {
+        const i64 mark = scratchMark();
+        func(userData, 0, count, 0);
+        scratchRewind(mark);
+        return;
+    }
+
+    TaskGraphNode node;
+    node.func = func;
+    node.userData = userData;
+    node.count = count;
+    node.chunkCount = chunkCount;
+    node.graph = nullptr;
+    node.chunksLeft.store(chunkCount, std::memory_order_relaxed);
+
+    // the calling thread takes chunk 0 right away
+    ThreadPool& tp = g_threadPool;
+    for(i32 c = 1; c < chunkCount; ++c) {
+        const Task task = { &node, c };
+        if(!tp.deques[(workerId + c) % tp.threadCount].push(task)) {
+            taskRun(task);
+        }
+    }
+    threadPoolNotify();
+
+    taskRun({ &node, 0 });
+    threadPoolHelpUntilZero(&node.chunksLeft, false);
+}
+
+
+// TASK GRAPH
+void taskGraphReset(TaskGraph* graph)
+{
+    assert(taskGraphIsDone(graph));
+    graph->nodeCount = 0;
+}
+
+i32 taskGraphAddRaw(TaskGraph* graph, i32 count, i32 chunkCount, TaskFunc func, void* userData)
+{
+    assert(graph->nodeCount < TASK_GRAPH_MAX_NODES);
+    const i32 id = graph->nodeCount++;
+    TaskGraphNode& node = graph->nodes[id];
+    node.func = func;
+    node.userData = userData;
+    node.count = count;
+    node.chunkCount = clamp(chunkCount, 1, max(count, 1));
+    node.dependentCount = 0;
+    node.dependencyCount = 0;
+    node.graph = graph;
+    return id;
+}
+
+void taskGraphDepend(TaskGraph* graph, i32 node, i32 dependsOn)
+{
+    assert(node < graph->nodeCount);
+    assert(dependsOn < node); // also rules out cycles
+    TaskGraphNode& dep = graph->nodes[dependsOn];
+    assert(dep.dependentCount < TASK_GRAPH_MAX_LINKS);
+    dep.dependents[dep.dependentCount++] = node;
+    graph->nodes[node].dependencyCount++;
+}
+
+static void taskGraphStart(TaskGraph* graph, bool background)
+{
+    assert(taskGraphIsDone(graph)); // still running
+    graph->background = background;
+    for(i32 n = 0; n < graph->nodeCount; ++n) {
+        TaskGraphNode& node = graph->nodes[n];
+        node.waitCount.store(node.dependencyCount, std::memory_order_relaxed);
+        node.chunksLeft.store(node.chunkCount, std::memory_order_relaxed);
+    }
+    graph->nodesLeft.store(graph->nodeCount, std::memory_order_release);
+
+    // every node is initialized before the first one can finish
+    for(i32 n = 0; n < graph->nodeCount; ++n) {
+        if(graph->nodes[n].dependencyCount == 0) {
+            taskNodeLaunch(&graph->nodes[n], g_threadPoolWorkerId);
+        }
+    }
+}
+
+void taskGraphRun(TaskGraph* graph)
+{
+    // nodes are added after the ones they depend on, so in order is a valid order
+    if(g_threadPool.threadCount == 1 || g_threadPoolWorkerId < 0) {
+        for(i32 n = 0; n < graph->nodeCount; ++n) {
+            const TaskGraphNode& node = graph->nodes[n];
+            if(node.count > 0) {
+                const i64 mark = scratchMark();
+                node.func(node.userData, 0, node.count, 0);
+                scratchRewind(mark);
+            }
+        }
+        return;
+    }
+
+    taskGraphStart(graph, false);
+    threadPoolHelpUntilZero(&graph->nodesLeft, false);
+}
+
+void taskGraphRunBackground(TaskGraph* graph)
+{
+    taskGraphStart(graph, true);
+}
+
+bool taskGraphIsDone(TaskGraph* graph)
+{
+    return graph->nodesLeft.load(std::memory_order_acquire) == 0;
+}
+
+void taskGraphWait(TaskGraph* graph)
+{
+    threadPoolHelpUntilZero(&graph->nodesLeft, true);
+}
+
+
+// SCRATCH
+// marks are positions in a virtual address space spanning all the blocks of the chain,
+// each block starts where the previous one ends so they stay ordered across blocks
+struct ScratchBlock
+{
+    ScratchBlock* prev;
+    ScratchBlock* next;
+    i64 start; // position of the first byte of the block
+    i64 size;
+    u8 pad[32]; // data starts 64 bytes in
+
+    inline u8* data() { return (u8*)this + sizeof(ScratchBlock); }
+};
+
+static_assert(sizeof(ScratchBlock) == 64, "data must stay 64 byte aligned");
+
+struct ScratchArena
+{
+    ScratchBlock* first = nullptr;
+    ScratchBlock* cur = nullptr;
+    i64 top = 0;
+
+    ~ScratchArena()
+    {
+        ScratchBlock* b = first;
+        while(b) {
+            ScratchBlock* next = b->next;
+            _aligned_free(b);
+            b = next;
+        }
+    }
+};
+
+static thread_local ScratchArena g_scratch;
+
+static ScratchBlock* scratchNewBlock(ScratchBlock* prev, i64 size)
+{
+    size = max(size, (i64)SCRATCH_BLOCK_SIZE);
+    ScratchBlock* b = (ScratchBlock*)_aligned_malloc(sizeof(ScratchBlock) + size, 64);
+    assert(b);
+    b->prev = prev;
+    b->next = nullptr;
+    b->start = prev ? prev->start + prev->size : 0;
+    b->size = size;
+    return b;
+}
+
+void* scratchAlloc(i64 size)
+{
+    ScratchArena& arena = g_scratch;
+    if(!arena.cur) {
+        arena.first = scratchNewBlock(nullptr, size);
+        arena.cur = arena.first;
+    }
+
+    ScratchBlock* b = arena.cur;
+    i64 offset = (arena.top - b->start + 63) & ~(i64)63;
+    if(offset + size > b->size) {
+        // next block if it fits, otherwise replace the rest of the chain with a big enough one
+        if(!b->next || b->next->size < size) {
+            ScratchBlock* n = b->next;
+            while(n) {
+                ScratchBlock* next = n->next;
+                _aligned_free(n);
+                n = next;
+            }
+            b->next = scratchNewBlock(b, size);
+        }
+        b = b->next;
+        arena.cur = b;
+        offset = 0;
+    }
+
+    arena.top = b->start + offset + size;
+    return b->data() + offset;
+}
+
+i64 scratchMark()
+{
+    return g_scratch.top;
+}
+
+void scratchRewind(i64 mark)
+{
+    ScratchArena& arena = g_scratch;
+    assert(mark <= arena.top);
+    while(arena.cur && mark < arena.cur->start) {
+        arena.cur = arena.cur->prev;
+    }
+    arena.top = mark;
+}
@@ -1,8 +1,18 @@
 #pragma once
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
-#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 typedef int8_t i8;
 typedef uint8_t u8;
@@ -15,9 +25,9 @@ typedef uint64_t u64;
 typedef float f32;
 typedef double f64;
 
-#define LOG(fmt, ...) (printf(fmt "\n", __VA_ARGS__), fflush(stdout))
-#define TIME_MILLI() (clock() / (CLOCKS_PER_SEC / 1000))
-#define TIME_MICRO() (clock() / CLOCKS_PER_SEC)
+#define LOG(fmt, ...) (printf(fmt "\n", ##__VA_ARGS__), fflush(stdout))
+#define TIME_MILLI() (timeGetMicro() / 1000)
+#define TIME_MICRO() (timeGetMicro())
 #define arr_count(arr) (sizeof(arr)/sizeof(arr[0]))
 #define stack_arr(type, count) ((type*)alloca(sizeof(type) * count))
 #define arr_zero(arr, count) (memset(arr, 0, sizeof(arr[0]) * count))
@@ -41,7 +51,16 @@ typedef double f64;
     #define min(a,b) (((a) < (b)) ? (a) : (b))
 #endif
 
-#define RAND_USE_STD
+#ifndef _WIN32
+    #include <stdlib.h>
+    inline void* _aligned_malloc(size_t size, size_t alignment)
+    {
+        void* ptr = nullptr;
+        if(posix_memalign(&ptr, alignment, size) != 0) return nullptr;
+        return ptr;
+    }
+    #define _aligned_free(ptr) free(ptr)
+#endif
 
 
 // TIME
@@ -51,28 +70,347 @@ timept timeGet();
 i64 timeToMicrosec(i64 delta);
 i64 timeGetMicro();
 
+// raw cycle counter (TSC on x86, timeGet() elsewhere), only meaningful as a difference
+inline u64 timeCycles()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (u64)timeGet();
+#endif
+}
+
+// calibrated against timeGet() over the time elapsed since timeInit()
+f64 timeCyclesToMicro(u64 cycles);
+
+
+// PROFILE
+// PROFILE_ZONE("name") times the rest of the enclosing scope, zones with the same name
+// are merged. PROFILE_SCOPE(var, "name") does the same but can be closed early with var.stop()
+// every thread writes its own counters, profileFrameEnd() (called by one thread, once per
+// frame) collects what all threads spent in each zone since the previous call
+#define PROFILE_MAX_ZONES 32
+
+struct ProfileCounters
+{
+    std::atomic<u64> cycles[PROFILE_MAX_ZONES];
+    std::atomic<u64> calls[PROFILE_MAX_ZONES];
+};
+
+struct ProfileStats
+{
+    u64 zoneCycles[PROFILE_MAX_ZONES];
+    u64 zoneCalls[PROFILE_MAX_ZONES];
+    u64 frameCycles;
+    i64 frameCount;
+};
+
+extern thread_local ProfileCounters* g_profileCounters;
+ProfileCounters* profileThreadCounters();
+
+i32 profileZoneRegister(const char* name);
+i32 profileZoneCount();
+const char* profileZoneName(i32 zoneId);
+
+void profileFrameEnd();
+const ProfileStats& profileLastFrame();
+const ProfileStats& profileTotals(); // every frame since profileResetTotals()
+f64 profileAverageMicro(i32 zoneId); // per frame, smoothed over the last ~30 frames
+f64 profileAverageFrameMicro();
+void profileResetTotals();
+void profileLogTotals(const char* prefix);
+
+// single writer per counter, no need for a locked add
+inline void profileZoneAdd(i32 zoneId, u64 cycles)
+{
+    ProfileCounters* c = g_profileCounters ? g_profileCounters : profileThreadCounters();
+    c->cycles[zoneId].store(c->cycles[zoneId].load(std::memory_order_relaxed) + cycles,
+                            std::memory_order_relaxed);
+    c->calls[zoneId].store(c->calls[zoneId].load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+}
+
+// TRACE
+// optional Chrome trace event JSON (chrome://tracing, ui.perfetto.dev) of every profile zone
+// each thread pushes its closed zones to its own lock-free ring buffer, a background thread
+// drains them to the file. Events are dropped (and counted) when a buffer is full
+extern std::atomic<bool> g_traceEnabled;
+
+bool traceStart(const char* path);
+void traceStop(); // also called at exit
+bool traceIsRecording();
+void traceStartFromEnv(); // records to $TRACE_FILE when it is set
+void traceRecord(i32 zoneId, u64 start, u64 end);
+
+struct ProfileScope
+{
+    i32 zoneId;
+    u64 start;
+
+    ProfileScope(i32 zoneId_): zoneId(zoneId_), start(timeCycles()) {}
+    ~ProfileScope() { stop(); }
+
+    void stop()
+    {
+        if(zoneId < 0) return;
+        const u64 end = timeCycles();
+        profileZoneAdd(zoneId, end - start);
+        if(g_traceEnabled.load(std::memory_order_relaxed)) {
+            traceRecord(zoneId, start, end);
+        }
+        zoneId = -1;
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(var, name)\
+    static const i32 PROFILE_CONCAT(var, ZoneId) = profileZoneRegister(name);\
+    ProfileScope var(PROFILE_CONCAT(var, ZoneId))
+#define PROFILE_ZONE(name) PROFILE_SCOPE(PROFILE_CONCAT(profileScope, __LINE__), name)
+
+
+// THREAD POOL
+// work-stealing pool: every worker owns a deque of tasks, it takes its own from the back and
+// steals from the front of the other deques when it runs dry
+// worker 0 is the thread that called threadPoolInit(), threads outside the pool (islands,
+// tools) run everything they submit inline
+#define THREAD_POOL_MAX_THREADS 64
+
+// func is called on contiguous [start, end) ranges, chunkId < the chunk count of the parallel for
+typedef void (*TaskFunc)(void* userData, i32 start, i32 end, i32 chunkId);
+
+void threadPoolInit(i32 threadCount); // <= 0 uses the hardware thread count
+void threadPoolShutdown();
+i32 threadPoolThreadCount();
+i32 threadPoolWorkerId(); // -1 outside the pool
+void parallelForRaw(i32 count, i32 chunkCount, TaskFunc func, void* userData);
+
+// can be nested and called from any worker, the waiting thread runs other tasks meanwhile
+// count is split in threadPoolThreadCount() chunks, chunkId can index per-thread partial results
+template<typename Func>
+inline void parallelFor(i32 count, Func func)
+{
+    parallelForRaw(count, threadPoolThreadCount(), [](void* userData, i32 start, i32 end, i32 chunkId) {
+        (*(Func*)userData)(start, end, chunkId);
+    }, &func);
+}
+
+// finer split for uneven work, idle workers steal the chunks left over
+template<typename Func>
+inline void parallelForChunks(i32 count, i32 chunkCount, Func func)
+{
+    parallelForRaw(count, chunkCount, [](void* userData, i32 start, i32 end, i32 chunkId) {
+        (*(Func*)userData)(start, end, chunkId);
+    }, &func);
+}
+
+
+// TASK GRAPH
+// every node is a parallel for (a single call when count is 1) that starts once the nodes it
+// depends on are done, the functions and their data have to outlive the run
+#define TASK_GRAPH_MAX_NODES 16
+#define TASK_GRAPH_MAX_LINKS 8
+
+struct TaskGraph;
+
+struct TaskGraphNode
+{
+    TaskFunc func;
+    void* userData;
+    i32 count;
+    i32 chunkCount;
+    i32 dependents[TASK_GRAPH_MAX_LINKS];
+    i32 dependentCount;
+    i32 dependencyCount;
+    TaskGraph* graph; // null for a plain parallel for
+
+    std::atomic<i32> waitCount; // dependencies not done yet
+    std::atomic<i32> chunksLeft;
+};
+
+struct TaskGraph
+{
+    TaskGraphNode nodes[TASK_GRAPH_MAX_NODES];
+    i32 nodeCount = 0;
+    bool background = false;
+    std::atomic<i32> nodesLeft{0};
+};
+
+void taskGraphReset(TaskGraph* graph);
+i32 taskGraphAddRaw(TaskGraph* graph, i32 count, i32 chunkCount, TaskFunc func, void* userData);
+// node runs after dependsOn, which has to be added before it
+void taskGraphDepend(TaskGraph* graph, i32 node, i32 dependsOn);
+// blocks until every node is done, the calling thread works on them too
+void taskGraphRun(TaskGraph* graph);
+
+// hands the whole graph to the first idle pool thread and returns
+// taskGraphWait() runs it on the calling thread if no pool thread took it yet, so it also
+// completes with a single thread
+void taskGraphRunBackground(TaskGraph* graph);
+bool taskGraphIsDone(TaskGraph* graph);
+void taskGraphWait(TaskGraph* graph);
+
+template<typename Func>
+inline i32 taskGraphAdd(TaskGraph* graph, i32 count, i32 chunkCount, Func* func)
+{
+    return taskGraphAddRaw(graph, count, chunkCount, [](void* userData, i32 start, i32 end, i32 chunkId) {
+        (*(Func*)userData)(start, end, chunkId);
+    }, func);
+}
+
+
+// SCRATCH
+// per-thread bump allocator for temporary arrays, released together by rewinding to a mark
+// the thread pool rewinds it after each task, so what a task allocates lives until it returns
+// grows by chaining blocks when full, blocks are kept and reused after a rewind
+#define SCRATCH_BLOCK_SIZE (16 * 1024 * 1024)
+
+void* scratchAlloc(i64 size); // 64 byte aligned
+i64 scratchMark();
+void scratchRewind(i64 mark);
+
+template<typename T>
+inline T* scratchArr(i64 count)
+{
+    return (T*)scratchAlloc(sizeof(T) * count);
+}
+
+
+// QUEUE
+// lock-free ring buffer for one producer thread and one consumer thread, N is a power of 2
+template<typename T, i32 N>
+struct SpscQueue
+{
+    static_assert((N & (N - 1)) == 0, "N must be a power of 2");
+
+    T items[N];
+    std::atomic<u32> head{0}; // written by the consumer
+    u8 pad[64]; // keep head and tail off the same cache line
+    std::atomic<u32> tail{0}; // written by the producer
+
+    // returns false when full
+    bool push(const T& item)
+    {
+        const u32 t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // returns false when empty
+    bool pop(T* item)
+    {
+        const u32 h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *item = items[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
 
 // RANDOM
-extern u64 g_RandSeed;
+// xoshiro256** streams, one per thread
+// randSetSeed() sets the run seed and reseeds the calling thread as the main stream, other
+// threads call randSeedThread() with their own stream id so a whole run replays from its seed
+#define RAND_STREAM_MAIN 0
+#define RAND_STREAM_THREAD_POOL 1 // + worker id
+#define RAND_STREAM_USER (RAND_STREAM_THREAD_POOL + THREAD_POOL_MAX_THREADS) // first free stream
+
+struct RandState
+{
+    u64 s[4];
+};
+
+// s[k][lane]: word k of each lane's state, so a row loads as one 4 x u64 vector
+struct RandWideState
+{
+    u64 s[4][4];
+    bool seeded;
+};
+
+extern thread_local RandState g_randState;
 
-#ifdef RAND_USE_STD
-static std::random_device g_randomDevice;
-static std::mt19937 g_randomMt(g_randomDevice());
+void randSetSeed(u64 seed);
+void randSeedThread(u64 streamId);
+
+// a stream that belongs to a piece of work rather than to a thread: tasks that can run on any
+// worker swap it in with RandStreamScope, so their draws don't depend on who ran them
+struct RandStream
+{
+    RandState state;
+    RandWideState wide;
+};
+
+void randStreamSeed(RandStream* stream, u64 key, u64 streamId);
+void randStreamSwap(RandStream* stream); // exchanges it with the calling thread's streams
+
+struct RandStreamScope
+{
+    RandStream* stream;
+
+    explicit RandStreamScope(RandStream* stream_): stream(stream_) { randStreamSwap(stream); }
+    ~RandStreamScope() { randStreamSwap(stream); }
+};
+u64 randGetSeed();
+// RAND_SEED environment variable if set, else a fresh random seed (logged either way)
+u64 randDefaultSeed();
+
+inline u64 randRotl(u64 x, i32 k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+inline u64 randu64()
+{
+    u64* s = g_randState.s;
+    const u64 result = randRotl(s[1] * 5, 7) * 9;
+    const u64 t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = randRotl(s[3], 45);
+    return result;
+}
+
+// returns the low 64 bits of a * b, the high 64 bits in hi
+inline u64 randMul128(u64 a, u64 b, u64* hi)
+{
+#ifdef _MSC_VER
+    return _umul128(a, b, hi);
+#else
+    const __uint128_t p = (__uint128_t)a * b;
+    *hi = (u64)(p >> 64);
+    return (u64)p;
 #endif
+}
 
-inline void randSetSeed(u64 seed)
+// [0, n) without modulo bias, the division only happens on the rare rejection path (Lemire)
+inline u64 randBelow(u64 n)
 {
-    g_RandSeed = seed;
+    u64 hi;
+    u64 lo = randMul128(randu64(), n, &hi);
+    if(lo < n) {
+        const u64 threshold = (0 - n) % n;
+        while(lo < threshold) {
+            lo = randMul128(randu64(), n, &hi);
+        }
+    }
+    return hi;
 }
 
-inline u64 xorshift64star()
+// [0, 1) with 53 bits of precision
+inline f64 randUnit()
 {
-    u64 x = g_RandSeed;	/* The state must be seeded with a nonzero value. */
-    x ^= x >> 12; // a
-    x ^= x << 25; // b
-    x ^= x >> 27; // c
-    g_RandSeed = x;
-    return x * 0x2545F4914F6CDD1D;
+    return (randu64() >> 11) * (1.0 / 9007199254740992.0);
 }
 
 inline f64 clampf64(f64 val, f64 vmin, f64 vmax)
@@ -90,29 +428,32 @@ inline T clamp(T val, T vmin, T vmax)
     return val;
 }
 
+// [vmin, vmax)
 inline f64 randf64(f64 vmin, f64 vmax)
 {
-#ifdef RAND_USE_STD
-    std::uniform_real_distribution<f64> dis(vmin, vmax);
-    return dis(g_randomMt);
-#else
-    u64 r = xorshift64star();
-    return vmin + ((f64)r/(f64)U64_MAX) * (vmax - vmin);
-#endif
+    return vmin + randUnit() * (vmax - vmin);
 }
 
-
+// [vmin, vmax]
 inline i64 randi64(i64 vmin, i64 vmax)
 {
-#ifdef RAND_USE_STD
-    std::uniform_int_distribution<i64> dis(vmin, vmax);
-    return dis(g_randomMt);
-#else
-    u64 r = xorshift64star();
-    return min + (r % (max - min + 1));
-#endif
+    return vmin + (i64)randBelow((u64)(vmax - vmin) + 1);
 }
 
+// BULK RANDOM
+// 4 extra xoshiro256** lanes per thread stepped together (AVX2 when available, same output
+// without it), seeded by randSeedThread() alongside the scalar stream
+void randFillU64(u64* out, i32 count);
+void randFillUnit(f64* out, i32 count); // [0, 1)
+void randFillF64(f64* out, i32 count, f64 vmin, f64 vmax); // [vmin, vmax)
+void randFillBelow(i32* out, i32 count, i32 n); // [0, n)
+void randFillNormal(f64* out, i32 count, f64 mean, f64 stddev); // Box-Muller
+
+// draws an event with probability chance for each of count individuals
+// writes the ids that got one in increasing order to outIds (count max) and returns how many
+// low chances skip ahead geometrically so the cost is per event, not per individual
+i32 randSampleEvents(i32* outIds, i32 count, f64 chance);
+
 inline f64 lerp(f64 a, f64 b, f64 ratio)
 {
     return a * (1.0-ratio) + b * ratio;
@@ -0,0 +1,523 @@
+#include "base.h"
+#include <stdlib.h>
+#include <assert.h>
+#include "neural.h"
+#include "neat.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// timings of the inference and evolution kernels, swept over population and genome sizes
+// results are printed and written as JSON
+
+#define BENCH_MAX_RESULTS 256
+#define BENCH_DEFAULT_MIN_MS 200
+#define BENCH_NEAT_WARMUP_GENERATIONS 20
+
+// hardware counters, per op
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_L1D_MISSES 2
+#define PERF_LLC_MISSES 3
+#define PERF_BRANCH_MISSES 4
+#define PERF_COUNTER_COUNT 5
+
+static const char* g_perfCounterName[PERF_COUNTER_COUNT] = {
+    "cycles", "instructions", "l1dMisses", "llcMisses", "branchMisses"
+};
+
+struct BenchResult
+{
+    const char* kernel;
+    char config[32];
+    i32 popCount;
+    i32 genomeSize; // weights (NN/RNN) or average gene count (NEAT)
+    i64 opCount;
+    f64 nsPerOp;
+    f64 netsPerSec;
+    f64 perfPerOp[PERF_COUNTER_COUNT]; // < 0 when not measured
+};
+
+static BenchResult g_results[BENCH_MAX_RESULTS];
+static i32 g_resultCount = 0;
+static i64 g_minMicro = BENCH_DEFAULT_MIN_MS * 1000;
+
+// PERF
+// optional Linux perf_event_open counters of the calling thread (user space only)
+// every counter is opened on its own: the ones the kernel refuses (perf_event_paranoid,
+// seccomp in containers, no PMU in a VM) are left out and the others still work
+static i32 g_perfFd[PERF_COUNTER_COUNT] = { -1, -1, -1, -1, -1 };
+
+static bool perfInit()
+{
+#ifdef __linux__
+    struct { u32 type; u64 config; } events[PERF_COUNTER_COUNT] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+
+    i32 openCount = 0;
+    for(i32 c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[c].type;
+        attr.config = events[c].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // more counters than the PMU has get multiplexed, counts are scaled back in perfStop()
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        g_perfFd[c] = (i32)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if(g_perfFd[c] < 0) {
+            LOG("bench> perf counter %s unavailable", g_perfCounterName[c]);
+            continue;
+        }
+        openCount++;
+    }
+    return openCount > 0;
+#else
+    LOG("bench> perf counters are only supported on Linux");
+    return false;
+#endif
+}
+
+static void perfStart()
+{
+#ifdef __linux__
+    for(i32 c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        if(g_perfFd[c] < 0) continue;
+        ioctl(g_perfFd[c], PERF_EVENT_IOC_RESET, 0);
+        ioctl(g_perfFd[c], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+// counts since perfStart(), -1 for counters that are not available
+static void perfStop(f64* counts)
+{
+    for(i32 c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        counts[c] = -1.0;
+    }
+
+#ifdef __linux__
+    for(i32 c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        if(g_perfFd[c] < 0) continue;
+        ioctl(g_perfFd[c], PERF_EVENT_IOC_DISABLE, 0);
+
+        u64 values[3]; // value, time enabled, time running
+        if(read(g_perfFd[c], values, sizeof(values)) != sizeof(values) || values[2] == 0) {
+            continue;
+        }
+        counts[c] = (f64)values[0] * ((f64)values[1] / values[2]);
+    }
+#endif
+}
+
+static void perfShutdown()
+{
+#ifdef __linux__
+    for(i32 c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        if(g_perfFd[c] >= 0) {
+            close(g_perfFd[c]);
+            g_perfFd[c] = -1;
+        }
+    }
+#endif
+}
+
+// calls func until the time budget is spent
+// one call runs opsPerCall ops and touches netsPerCall nets
+template<typename Func>
+static void benchRun(const char* kernel, const char* config, i32 popCount, i32 genomeSize,
+                     i32 opsPerCall, i32 netsPerCall, Func func)
+{
+    func(); // warm up
+
+    i64 callCount = 0;
+    i64 elapsedMicro = 0;
+    f64 perfCounts[PERF_COUNTER_COUNT];
+    perfStart();
+    const timept t0 = timeGet();
+    do {
+        func();
+        callCount++;
+        elapsedMicro = timeToMicrosec(timeGet() - t0);
+    } while(elapsedMicro < g_minMicro);
+    perfStop(perfCounts);
+
+    assert(g_resultCount < BENCH_MAX_RESULTS);
+    BenchResult& r = g_results[g_resultCount++];
+    r.kernel = kernel;
+    snprintf(r.config, sizeof(r.config), "%s", config);
+    r.popCount = popCount;
+    r.genomeSize = genomeSize;
+    r.opCount = callCount * opsPerCall;
+    r.nsPerOp = elapsedMicro * 1000.0 / r.opCount;
+    r.netsPerSec = callCount * netsPerCall / (elapsedMicro / 1000000.0);
+    for(i32 c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        r.perfPerOp[c] = perfCounts[c] < 0.0 ? -1.0 : perfCounts[c] / r.opCount;
+    }
+
+    LOG("bench> %-24s %-10s pop=%-5d size=%-5d %12.1f ns/op %14.0f nets/s", kernel, config,
+        popCount, genomeSize, r.nsPerOp, r.netsPerSec);
+
+    char perfLine[256];
+    i32 len = 0;
+    for(i32 c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        if(r.perfPerOp[c] < 0.0) continue;
+        len += snprintf(perfLine + len, sizeof(perfLine) - len, " %s/op=%.2f", g_perfCounterName[c],
+                        r.perfPerOp[c]);
+    }
+    if(r.perfPerOp[PERF_CYCLES] > 0.0 && r.perfPerOp[PERF_INSTRUCTIONS] >= 0.0) {
+        len += snprintf(perfLine + len, sizeof(perfLine) - len, " ipc=%.2f",
+                        r.perfPerOp[PERF_INSTRUCTIONS] / r.perfPerOp[PERF_CYCLES]);
+    }
+    if(len > 0) {
+        LOG("bench>  %s", perfLine);
+    }
+}
+
+static void layersToString(char* out, i32 outSize, const i32* layers, i32 layerCount)
+{
+    i32 len = 0;
+    for(i32 l = 0; l < layerCount; ++l) {
+        len += snprintf(out + len, outSize - len, l ? "-%d" : "%d", layers[l]);
+    }
+}
+
+static void randomFitness(f64* fitness, i32 count)
+{
+    for(i32 i = 0; i < count; ++i) {
+        fitness[i] = randf64(0.1, 10.0);
+    }
+}
+
+static void randomInputs(f64* inputs, i32 count)
+{
+    for(i32 i = 0; i < count; ++i) {
+        inputs[i] = randf64(-1.0, 1.0);
+    }
+}
+
+static void benchNN(const i32* layers, i32 layerCount, i32 popCount)
+{
+    char config[32];
+    layersToString(config, sizeof(config), layers, layerCount);
+
+    NeuralNetDef def;
+    nnMakeDef(&def, layerCount, layers, 1.0);
+
+    NeuralNet** curGen = (NeuralNet**)malloc(sizeof(NeuralNet*) * popCount);
+    NeuralNet** nextGen = (NeuralNet**)malloc(sizeof(NeuralNet*) * popCount);
+    i32* curGenSpecies = (i32*)malloc(sizeof(i32) * popCount);
+    i32* nextGenSpecies = (i32*)malloc(sizeof(i32) * popCount);
+    f64* fitness = (f64*)malloc(sizeof(f64) * popCount);
+    f64* inputs = stack_arr(f64, def.inputNeuronCount);
+
+    nnAlloc(curGen, popCount, def);
+    nnAlloc(nextGen, popCount, def);
+    nnInit(curGen, popCount, def);
+
+    NnSpeciation* speciation = new NnSpeciation;
+    nnSpeciationInit(speciation, curGenSpecies, curGen, popCount, def);
+
+    randomInputs(inputs, def.inputNeuronCount);
+    for(i32 i = 0; i < popCount; ++i) {
+        curGen[i]->setInputs(inputs, def.inputNeuronCount);
+    }
+
+    const i32 weightCount = def.weightTotalCount;
+
+    benchRun("nnPropagate", config, popCount, weightCount, 1, popCount, [&] {
+        nnPropagate(curGen, popCount, def);
+    });
+
+    benchRun("nnCompatibilityDistance", config, popCount, weightCount, popCount - 1, popCount, [&] {
+        volatile f64 total = 0;
+        for(i32 i = 1; i < popCount; ++i) {
+            total += nnTestCompatibility(curGen[i-1]->weights, curGen[i]->weights, weightCount);
+        }
+    });
+
+    benchRun("nnCrossover", config, popCount, weightCount, popCount - 1, popCount, [&] {
+        for(i32 i = 1; i < popCount; ++i) {
+            nnCrossover(nextGen[i]->weights, curGen[i-1]->weights, curGen[i]->weights, weightCount);
+        }
+    });
+
+    NnEvolutionParams evolParams;
+    evolParams.popCount = popCount;
+    evolParams.fitness = fitness;
+    evolParams.curGenRNN = curGen;
+    evolParams.nextGenRNN = nextGen;
+    evolParams.rnnDef = &def;
+    evolParams.curGenSpecies = curGenSpecies;
+    evolParams.nextGenSpecies = nextGenSpecies;
+    evolParams.speciation = speciation;
+
+    benchRun("nnEvolve", config, popCount, weightCount, 1, popCount, [&] {
+        randomFitness(fitness, popCount);
+        nnEvolve(&evolParams);
+    });
+
+    delete speciation;
+    nnDealloc(curGen);
+    nnDealloc(nextGen);
+    free(curGen);
+    free(nextGen);
+    free(curGenSpecies);
+    free(nextGenSpecies);
+    free(fitness);
+}
+
+static void benchRNN(const i32* layers, i32 layerCount, i32 popCount)
+{
+    char config[32];
+    layersToString(config, sizeof(config), layers, layerCount);
+
+    RecurrentNeuralNetDef def;
+    rnnMakeDef(&def, layerCount, layers, 1.0);
+
+    RecurrentNeuralNet** curGen = (RecurrentNeuralNet**)malloc(sizeof(RecurrentNeuralNet*) * popCount);
+    RecurrentNeuralNet** nextGen = (RecurrentNeuralNet**)malloc(sizeof(RecurrentNeuralNet*) * popCount);
+    i32* curGenSpecies = (i32*)malloc(sizeof(i32) * popCount);
+    i32* nextGenSpecies = (i32*)malloc(sizeof(i32) * popCount);
+    f64* fitness = (f64*)malloc(sizeof(f64) * popCount);
+    f64* inputs = stack_arr(f64, def.inputNeuronCount);
+
+    rnnAlloc(curGen, popCount, def);
+    rnnAlloc(nextGen, popCount, def);
+    rnnInit(curGen, popCount, def);
+
+    RnnSpeciation* speciation = new RnnSpeciation;
+    rnnSpeciationInit(speciation, curGenSpecies, curGen, popCount, def);
+
+    randomInputs(inputs, def.inputNeuronCount);
+    for(i32 i = 0; i < popCount; ++i) {
+        curGen[i]->setInputs(inputs, def.inputNeuronCount);
+    }
+
+    const i32 weightCount = def.weightTotalCount;
+
+    benchRun("rnnPropagate", config, popCount, weightCount, 1, popCount, [&] {
+        rnnPropagate(curGen, popCount, def);
+    });
+
+    bool wideOk = true;
+    for(i32 l = 0; l < layerCount; ++l) {
+        wideOk &= (layers[l] & 1) == 0;
+    }
+    if(wideOk) {
+        benchRun("rnnPropagateWide", config, popCount, weightCount, 1, popCount, [&] {
+            rnnPropagateWide(curGen, popCount, def);
+        });
+    }
+
+    benchRun("rnnCrossover", config, popCount, weightCount, popCount - 1, popCount, [&] {
+        for(i32 i = 1; i < popCount; ++i) {
+            rnnCrossover(nextGen[i]->weights, curGen[i-1]->weights, curGen[i]->weights, weightCount);
+        }
+    });
+
+    RnnEvolutionParams evolParams;
+    evolParams.popCount = popCount;
+    evolParams.fitness = fitness;
+    evolParams.curGenRNN = curGen;
+    evolParams.nextGenRNN = nextGen;
+    evolParams.rnnDef = &def;
+    evolParams.curGenSpecies = curGenSpecies;
+    evolParams.nextGenSpecies = nextGenSpecies;
+    evolParams.speciation = speciation;
+
+    benchRun("rnnEvolve", config, popCount, weightCount, 1, popCount, [&] {
+        randomFitness(fitness, popCount);
+        rnnEvolve(&evolParams);
+    });
+
+    delete speciation;
+    rnnDealloc(curGen);
+    rnnDealloc(nextGen);
+    free(curGen);
+    free(nextGen);
+    free(curGenSpecies);
+    free(nextGenSpecies);
+    free(fitness);
+}
+
+// genomes start fully connected inputs -> outputs, and grow hidden nodes during the warm up
+static void benchNEAT(i32 inputCount, i32 outputCount, i32 warmupGenerations, i32 popCount)
+{
+    char config[32];
+    snprintf(config, sizeof(config), "%d-%d+%dg", inputCount, outputCount, warmupGenerations);
+
+    Genome** curGen = (Genome**)malloc(sizeof(Genome*) * popCount);
+    Genome** nextGen = (Genome**)malloc(sizeof(Genome*) * popCount);
+    NeatNN** nn = (NeatNN**)calloc(popCount, sizeof(NeatNN*));
+    f64* fitness = (f64*)malloc(sizeof(f64) * popCount);
+    f64* inputs = stack_arr(f64, inputCount);
+
+    NeatEvolutionParams evolParams;
+    evolParams.mutateAddNode = 0.2;
+    evolParams.mutateAddConn = 0.2;
+
+    neatGenomeAlloc(curGen, popCount);
+    neatGenomeAlloc(nextGen, popCount);
+
+    NeatSpeciation* speciation = new NeatSpeciation;
+    neatGenomeInit(curGen, popCount, inputCount, outputCount, evolParams, speciation);
+
+    for(i32 g = 0; g < warmupGenerations; ++g) {
+        randomFitness(fitness, popCount);
+        neatEvolve(curGen, nextGen, fitness, popCount, speciation, evolParams);
+    }
+
+    i64 totalGeneCount = 0;
+    for(i32 i = 0; i < popCount; ++i) {
+        totalGeneCount += curGen[i]->geneCount;
+    }
+    const i32 avgGeneCount = totalGeneCount / popCount;
+
+    neatGenomeAllocMakeNN(curGen, popCount, nn);
+    randomInputs(inputs, inputCount);
+
+    benchRun("neatNnPropagate", config, popCount, avgGeneCount, 1, popCount, [&] {
+        for(i32 i = 0; i < popCount; ++i) {
+            nn[i]->setInputs(inputs, inputCount);
+        }
+        neatNnPropagate(nn, popCount);
+    });
+
+    benchRun("neatGenomeAllocMakeNN", config, popCount, avgGeneCount, 1, popCount, [&] {
+        neatNnDealloc(nn);
+        neatGenomeAllocMakeNN(curGen, popCount, nn);
+    });
+
+    benchRun("neatCompatibilityDistance", config, popCount, avgGeneCount, popCount - 1, popCount, [&] {
+        volatile f64 total = 0;
+        for(i32 i = 1; i < popCount; ++i) {
+            total += neatTestCompability(curGen[i-1], curGen[i], evolParams);
+        }
+    });
+
+    benchRun("neatCrossover", config, popCount, avgGeneCount, popCount - 1, popCount, [&] {
+        for(i32 i = 1; i < popCount; ++i) {
+            neatTestCrossover(curGen[i-1], curGen[i], nextGen[i]);
+        }
+    });
+
+    // genomes keep growing while this runs, the first calls weigh the most
+    benchRun("neatEvolve", config, popCount, avgGeneCount, 1, popCount, [&] {
+        randomFitness(fitness, popCount);
+        neatEvolve(curGen, nextGen, fitness, popCount, speciation, evolParams);
+    });
+
+    delete speciation;
+    neatNnDealloc(nn);
+    neatGenomeDealloc(curGen);
+    neatGenomeDealloc(nextGen);
+    free(curGen);
+    free(nextGen);
+    free(nn);
+    free(fitness);
+}
+
+static bool writeJson(const char* path, u64 seed)
+{
+    FILE* f = fopen(path, "wb");
+    if(!f) {
+        LOG("ERROR: can't open %s", path);
+        return false;
+    }
+
+    fprintf(f, "{\n  \"seed\": %llu,\n  \"minTimeMs\": %lld,\n  \"results\": [\n",
+            (unsigned long long)seed, (long long)(g_minMicro / 1000));
+    for(i32 i = 0; i < g_resultCount; ++i) {
+        const BenchResult& r = g_results[i];
+        fprintf(f, "    {\"kernel\": \"%s\", \"config\": \"%s\", \"popCount\": %d, \"genomeSize\": %d, "
+                "\"ops\": %lld, \"nsPerOp\": %.3f, \"netsPerSec\": %.1f",
+                r.kernel, r.config, r.popCount, r.genomeSize, (long long)r.opCount, r.nsPerOp,
+                r.netsPerSec);
+        for(i32 c = 0; c < PERF_COUNTER_COUNT; ++c) {
+            if(r.perfPerOp[c] < 0.0) continue;
+            fprintf(f, ", \"%sPerOp\": %.3f", g_perfCounterName[c], r.perfPerOp[c]);
+        }
+        fprintf(f, "}%s\n", i + 1 < g_resultCount ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return true;
+}
+
+// usage: burds_bench [output json] [seed] [min time per benchmark in ms] [perf counters 0/1]
+i32 main(i32 argc, char** argv)
+{
+    LOG("Burds bench");
+
+    timeInit();
+
+    const char* outputPath = "burds_bench.json";
+    if(argc > 1) {
+        outputPath = argv[1];
+    }
+
+    u64 seed = 0x1245;
+    if(argc > 2) {
+        seed = strtoull(argv[2], nullptr, 0);
+    }
+    randSetSeed(seed);
+
+    if(argc > 3) {
+        g_minMicro = atoi(argv[3]) * 1000;
+    }
+
+    if(argc > 4 && atoi(argv[4]) != 0) {
+        if(!perfInit()) {
+            LOG("bench> no perf counter available, timing only");
+        }
+    }
+
+    const i32 popCounts[] = { 256, 1024, 4096 };
+
+    const i32 nnSmall[] = { 6, 4, 4 };
+    const i32 nnMedium[] = { 12, 16, 4 };
+    const i32 nnLarge[] = { 32, 64, 64, 8 };
+
+    for(i32 p = 0; p < (i32)arr_count(popCounts); ++p) {
+        const i32 popCount = popCounts[p];
+        benchNN(nnSmall, arr_count(nnSmall), popCount);
+        benchNN(nnMedium, arr_count(nnMedium), popCount);
+        benchNN(nnLarge, arr_count(nnLarge), popCount);
+        benchRNN(nnSmall, arr_count(nnSmall), popCount);
+        benchRNN(nnMedium, arr_count(nnMedium), popCount);
+        benchRNN(nnLarge, arr_count(nnLarge), popCount);
+    }
+
+    // neatGenomeAllocMakeNN handles at most 2048 genomes per call
+    const i32 neatPopCounts[] = { 256, 1024 };
+
+    for(i32 p = 0; p < (i32)arr_count(neatPopCounts); ++p) {
+        const i32 popCount = neatPopCounts[p];
+        benchNEAT(6, 4, 0, popCount);
+        benchNEAT(6, 4, BENCH_NEAT_WARMUP_GENERATIONS, popCount);
+        benchNEAT(12, 4, BENCH_NEAT_WARMUP_GENERATIONS, popCount);
+    }
+
+    perfShutdown();
+
+    if(!writeJson(outputPath, seed)) {
+        return 1;
+    }
+
+    LOG("bench> %d results written to %s", g_resultCount, outputPath);
+    return 0;
+}
@@ -1,25 +1,43 @@
 #include "base.h"
+#ifndef HEADLESS
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
 #include <gl3w.h>
+#endif
 #include <stdlib.h>
 #include <float.h>
 #include <assert.h>
 
-#include "window.h"
 #include "sprite.h"
 #include "neural.h"
+#include "wide_math.h"
+#ifndef HEADLESS
+#include "window.h"
+#include "neural_imgui.h"
+#include "profile_imgui.h"
 #include "imgui/imgui.h"
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include "imgui/imgui_internal.h"
 #include "imgui/imgui_sdl2_setup.h"
+#endif
 
 #define FRAMES_PER_SEC 60.0
 #define FRAME_DT ((f64)(1.0/FRAMES_PER_SEC))
 
-#define BIRD_COUNT 1024
+// time allowed for simulation steps per presented frame
+#define SIM_BUDGET_MICRO 12000
+#define SIM_BUDGET_MAX_SPEED_MICRO 50000
+
+#ifndef BIRD_COUNT
+    #define BIRD_COUNT 1024
+#endif
 constexpr i32 MAX_SPECIES = RNN_MAX_SPECIES;
 
+// each genome can be evaluated on several apple paths at once, every episode is a bird slot:
+// slot = episode * BIRD_COUNT + genome, episode 0 is the one displayed
+#define EPISODE_MAX_COUNT 8
+constexpr i32 BIRD_SLOT_COUNT = BIRD_COUNT * EPISODE_MAX_COUNT;
+
 #define BIRD_BODY_RATIO 0.5f
 #define BIRD_WING_RATIO 1.68125f
 
@@ -62,9 +80,16 @@ struct BirdInput
     u8 left, right, flap, brake;
 };
 
+// snapshot sections of the app, next to the population (index 0)
+#define APP_SNAPSHOT_KIND 0x4e4e5242 // "BRNN"
+#define APP_SNAPSHOT_STATE (SNAPSHOT_SECTION_USER + 0)
+#define APP_SNAPSHOT_PAST_STATS (SNAPSHOT_SECTION_USER + 1)
+
 struct App {
 
+#ifndef HEADLESS
 AppWindow window;
+#endif
 
 i32 tex_birdBody;
 i32 tex_birdWing;
@@ -92,21 +117,24 @@ Transform birdLeftWingTf[BIRD_COUNT];
 Transform birdRightWingTf[BIRD_COUNT];
 Color3 speciesColor[MAX_SPECIES];
 
-Vec2 birdPos[BIRD_COUNT];
-Vec2 birdVel[BIRD_COUNT];
-f32 birdRot[BIRD_COUNT];
-f32 birdAngularVel[BIRD_COUNT];
-f32 birdFlapLeftCd[BIRD_COUNT];
-f32 birdFlapRightCd[BIRD_COUNT];
-u8 birdBraking[BIRD_COUNT];
-BirdInput birdInput[BIRD_COUNT];
-
-f32 birdHealth[BIRD_COUNT];
-u8 birdDead[BIRD_COUNT];
-u8 birdDeadFromGround[BIRD_COUNT];
-i32 birdApplePositionId[BIRD_COUNT];
-
-Vec2 applePosList[APPLE_POS_LIST_COUNT];
+// physics state is split in x/y arrays so updatePhysics can work on 8 birds at once
+f32 birdPosX[BIRD_SLOT_COUNT];
+f32 birdPosY[BIRD_SLOT_COUNT];
+f32 birdVelX[BIRD_SLOT_COUNT];
+f32 birdVelY[BIRD_SLOT_COUNT];
+f32 birdRot[BIRD_SLOT_COUNT];
+f32 birdAngularVel[BIRD_SLOT_COUNT];
+f32 birdFlapLeftCd[BIRD_SLOT_COUNT];
+f32 birdFlapRightCd[BIRD_SLOT_COUNT];
+u8 birdBraking[BIRD_SLOT_COUNT];
+BirdInput birdInput[BIRD_SLOT_COUNT];
+
+f32 birdHealth[BIRD_SLOT_COUNT];
+u8 birdDead[BIRD_SLOT_COUNT];
+u8 birdDeadFromGround[BIRD_SLOT_COUNT];
+i32 birdApplePositionId[BIRD_SLOT_COUNT];
+
+Vec2 applePosList[EPISODE_MAX_COUNT][APPLE_POS_LIST_COUNT];
 Transform appleTf[BIRD_COUNT];
 
 Line targetLine[BIRD_COUNT];
@@ -124,15 +152,28 @@ NeuralNet* nextGenNN[BIRD_COUNT];
 NnSpeciation speciation;
 NnEvolutionParams genEnv;
 #endif
+// per slot net: genome net for episode 0, other episodes share the genome weights
+#ifdef NNTYPE_RNN
+RecurrentNeuralNet* birdNN[BIRD_SLOT_COUNT];
+RecurrentNeuralNet* episodeNN[BIRD_SLOT_COUNT - BIRD_COUNT];
+#elif defined(NNTYPE_NN)
+NeuralNet* birdNN[BIRD_SLOT_COUNT];
+NeuralNet* episodeNN[BIRD_SLOT_COUNT - BIRD_COUNT];
+#endif
 i32 curGenSpecies[BIRD_COUNT];
 i32 nextSpeciesTag[BIRD_COUNT];
 
-i32 birdAppleEatenCount[BIRD_COUNT];
-f32 birdDistToNextApple[BIRD_COUNT];
-f32 birdShortestDistToNextApple[BIRD_COUNT];
+i32 birdAppleEatenCount[BIRD_SLOT_COUNT];
+f32 birdDistToNextApple[BIRD_SLOT_COUNT];
+f32 birdShortestDistToNextApple[BIRD_SLOT_COUNT];
+
+f64 birdFitnessAcc[BIRD_SLOT_COUNT];
+f64 birdFitness[BIRD_SLOT_COUNT];
+f64 genomeFitness[BIRD_COUNT]; // mean over the episodes, fed to evolution
 
-f64 birdFitnessAcc[BIRD_COUNT];
-f64 birdFitness[BIRD_COUNT];
+i32 episodeCount = 1;
+i32 nextEpisodeCount = 1; // applied on the next generation
+i32 birdSlotCount = BIRD_COUNT;
 
 f32 viewZoom;
 i32 viewX;
@@ -140,6 +181,7 @@ i32 viewY;
 u8 mouseRightButDown = 0;
 
 i32 timeScale;
+i32 lastFrameStepCount = 0;
 
 bool showUi = true;
 bool dbgAutoSelectBest = true;
@@ -155,11 +197,53 @@ struct GenerationStats {
     f64 avgFitness = 0.0;
 };
 
+// per-thread partial reductions of a simulation step
+struct alignas(64) StepPartial {
+    f64 maxFitness;
+    f64 totalFitness;
+    i32 aliveCount;
+};
+
+StepPartial stepPartial[THREAD_POOL_MAX_THREADS];
+
+// birds that still need simulating (alive, or dead and still falling), sorted by id
+i32 activeBirdIds[BIRD_SLOT_COUNT];
+i32 activeBirdCount = 0;
+i32 aliveBirdCount = 0;
+// fitness of the birds dropped from the active list this generation
+f64 inactiveFitnessTotal = 0.0;
+f64 inactiveFitnessMax = 0.0;
+
 i32 generationNumber = 0;
 GenerationStats curGenStats;
 GenerationStats lastGenStats;
 GenerationStats pastGenStats[STATS_HISTORY_COUNT];
 
+struct SnapshotState {
+    i32 generationNumber;
+    GenerationStats curGenStats;
+    GenerationStats lastGenStats;
+};
+
+SnapshotWriter snapshotWriter;
+char snapshotPath[256];
+i32 snapshotInterval = 0; // generations, 0: no snapshots
+
+char exportCPath[256];
+bool exportCEnabled = false;
+f64 exportCBestFitness = 0.0; // of the last champion exported
+i32 exportCGeneration = -1;
+
+inline Vec2 birdPosition(i32 birdId) const
+{
+    return vec2Make(birdPosX[birdId], birdPosY[birdId]);
+}
+
+inline Vec2 birdApplePos(i32 birdId) const
+{
+    return applePosList[birdId / BIRD_COUNT][birdApplePositionId[birdId]];
+}
+
 void resetBirdColors()
 {
     const u32 colorMax = 0xFF;
@@ -178,12 +262,15 @@ void resetBirdColors()
 
 void resetBirds()
 {
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        birdPos[i].x = 0;
-        birdPos[i].y = GROUND_Y-100;
+    episodeCount = nextEpisodeCount;
+    birdSlotCount = BIRD_COUNT * episodeCount;
+
+    for(i32 i = 0; i < BIRD_SLOT_COUNT; ++i) {
+        birdPosX[i] = 0;
+        birdPosY[i] = GROUND_Y-100;
     }
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 i = 0; i < BIRD_SLOT_COUNT; ++i) {
         birdRot[i] = -PI * 0.5;
     }
 
@@ -207,11 +294,12 @@ void resetBirds()
         birdRightWingTf[i].center.y = BIRD_WING_HEIGHT * 0.6f;
     }
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 i = 0; i < BIRD_SLOT_COUNT; ++i) {
         birdHealth[i] = HEALTH_MAX; // seconds
     }
 
-    mem_zero(birdVel);
+    mem_zero(birdVelX);
+    mem_zero(birdVelY);
     mem_zero(birdAngularVel);
     mem_zero(birdFlapLeftCd);
     mem_zero(birdFlapRightCd);
@@ -222,11 +310,28 @@ void resetBirds()
     mem_zero(birdDeadFromGround);
     mem_zero(birdFitness);
     mem_zero(birdFitnessAcc);
+    mem_zero(genomeFitness);
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 i = 0; i < BIRD_SLOT_COUNT; ++i) {
         birdShortestDistToNextApple[i] = 99999999.9;
     }
 
+    for(i32 i = 0; i < birdSlotCount; ++i) {
+        activeBirdIds[i] = i;
+    }
+    activeBirdCount = birdSlotCount;
+    aliveBirdCount = birdSlotCount;
+
+#ifdef NNTYPE_RNN
+    // episodes start from the same hidden state as the genome net
+    for(i32 i = BIRD_COUNT; i < birdSlotCount; ++i) {
+        memmove(birdNN[i]->prevHiddenValues, curGenNN[i % BIRD_COUNT]->prevHiddenValues,
+                sizeof(f64) * nnDef.hiddenStateNeuronCount);
+    }
+#endif
+    inactiveFitnessTotal = 0.0;
+    inactiveFitnessMax = 0.0;
+
     for(i32 i = 0; i < BIRD_COUNT; ++i) {
         appleTf[i].size.x = 80;
         appleTf[i].size.y = 80;
@@ -242,22 +347,27 @@ void resetBirds()
     }
 }
 
+// one independent path per episode
 void resetApplePath()
 {
-    i32 spawnOriginX = 0;
-    i32 spawnOriginY = 0;
     const i32 spawnRadius = 1000;
 
-    for(i32 i = 0; i < APPLE_POS_LIST_COUNT; ++i) {
-        f64 dirX = randi64(0, 1) ? 1.0 : -1.0;
-        f64 dirY = randi64(0, 1) ? 1.0 : -1.0;
-        applePosList[i].x = spawnOriginX + (spawnRadius * 0.5 + randi64(0, spawnRadius * 0.5)) * dirX;
-        applePosList[i].y = spawnOriginY + (spawnRadius * 0.5 + randi64(0, spawnRadius * 0.5)) * dirY;
-        if(applePosList[i].y >= GROUND_Y - spawnRadius) {
-            applePosList[i].y -= spawnRadius;
+    for(i32 e = 0; e < EPISODE_MAX_COUNT; ++e) {
+        Vec2* path = applePosList[e];
+        i32 spawnOriginX = 0;
+        i32 spawnOriginY = 0;
+
+        for(i32 i = 0; i < APPLE_POS_LIST_COUNT; ++i) {
+            f64 dirX = randi64(0, 1) ? 1.0 : -1.0;
+            f64 dirY = randi64(0, 1) ? 1.0 : -1.0;
+            path[i].x = spawnOriginX + (spawnRadius * 0.5 + randi64(0, spawnRadius * 0.5)) * dirX;
+            path[i].y = spawnOriginY + (spawnRadius * 0.5 + randi64(0, spawnRadius * 0.5)) * dirY;
+            if(path[i].y >= GROUND_Y - spawnRadius) {
+                path[i].y -= spawnRadius;
+            }
+            spawnOriginX = path[i].x;
+            spawnOriginY = path[i].y;
         }
-        spawnOriginX = applePosList[i].x;
-        spawnOriginY = applePosList[i].y;
     }
 }
 
@@ -386,6 +496,7 @@ void resetSimulation()
 
 bool init()
 {
+#ifndef HEADLESS
 	if(!window.init("Burds [NN]", "burds_app_imgui.ini", 1600, 900, false)) {
         return false;
     }
@@ -416,6 +527,7 @@ bool init()
        ) {
         return false;
     }
+#endif
 
     timeScale = 1.0f;
 
@@ -425,19 +537,33 @@ bool init()
     rnnMakeDef(&nnDef, sizeof(layers) / sizeof(layers[0]), layers, 1.f);
     rnnAlloc(curGenNN, BIRD_COUNT, nnDef);
     rnnAlloc(nextGenNN, BIRD_COUNT, nnDef);
+    rnnAlloc(episodeNN, BIRD_SLOT_COUNT - BIRD_COUNT, nnDef);
 #elif defined(NNTYPE_NN)
     nnMakeDef(&nnDef, sizeof(layers) / sizeof(layers[0]), layers, 1.f);
     nnAlloc(curGenNN, BIRD_COUNT, nnDef);
     nnAlloc(nextGenNN, BIRD_COUNT, nnDef);
+    nnAlloc(episodeNN, BIRD_SLOT_COUNT - BIRD_COUNT, nnDef);
 #endif
 
+    // evolution copies into curGenNN in place, the weight pointers stay valid
+    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+        birdNN[i] = curGenNN[i];
+    }
+    for(i32 i = BIRD_COUNT; i < BIRD_SLOT_COUNT; ++i) {
+        birdNN[i] = episodeNN[i - BIRD_COUNT];
+        birdNN[i]->weights = curGenNN[i % BIRD_COUNT]->weights;
+#ifdef NNTYPE_RNN
+        birdNN[i]->prevHiddenWeights = curGenNN[i % BIRD_COUNT]->prevHiddenWeights;
+#endif
+    }
+
     genEnv.popCount = BIRD_COUNT;
     genEnv.curGenSpecies = curGenSpecies;
     genEnv.nextGenSpecies = nextSpeciesTag;
     genEnv.curGenRNN = curGenNN;
     genEnv.nextGenRNN = nextGenNN;
     genEnv.rnnDef = &nnDef;
-    genEnv.fitness = birdFitness;
+    genEnv.fitness = genomeFitness;
     genEnv.speciation = &speciation;
 
     genEnv.mutationRate = 2.0;
@@ -446,13 +572,240 @@ bool init()
 
     resetSimulation();
 
+    if(snapshotConfigFromEnv(snapshotPath, sizeof(snapshotPath), &snapshotInterval)) {
+        loadSnapshot();
+    }
+    exportCEnabled = exportCConfigFromEnv(exportCPath, sizeof(exportCPath));
+
     return true;
 }
 
+// the population is written right after its evolution
+void writeSnapshot()
+{
+    PROFILE_ZONE("snapshot");
+    snapshotBegin(&snapshotWriter, APP_SNAPSHOT_KIND);
+
+    const SnapshotState state = { generationNumber, curGenStats, lastGenStats };
+    snapshotAdd(&snapshotWriter, APP_SNAPSHOT_STATE, 0, &state, sizeof(state), 1);
+    snapshotAdd(&snapshotWriter, APP_SNAPSHOT_PAST_STATS, 0, pastGenStats, sizeof(pastGenStats[0]),
+                STATS_HISTORY_COUNT);
+#ifdef NNTYPE_RNN
+    rnnSnapshotAdd(&snapshotWriter, 0, curGenNN, BIRD_COUNT, curGenSpecies, speciation, nnDef);
+#elif defined(NNTYPE_NN)
+    nnSnapshotAdd(&snapshotWriter, 0, curGenNN, BIRD_COUNT, curGenSpecies, speciation, nnDef);
+#endif
+
+    snapshotWriteAsync(&snapshotWriter, snapshotPath);
+}
+
+// after resetSimulation()
+bool loadSnapshot()
+{
+    Snapshot snap;
+    if(!snapshotOpen(&snap, snapshotPath, APP_SNAPSHOT_KIND)) {
+        return false;
+    }
+
+    const timept t0 = timeGet();
+    const SnapshotState* state = snapshotArrExact<SnapshotState>(snap, APP_SNAPSHOT_STATE, 0, 1);
+    const GenerationStats* pastStats = snapshotArrExact<GenerationStats>(snap, APP_SNAPSHOT_PAST_STATS,
+                                                                         0, STATS_HISTORY_COUNT);
+    bool restored = state && pastStats;
+#ifdef NNTYPE_RNN
+    restored = restored && rnnSnapshotRestore(snap, 0, curGenNN, BIRD_COUNT, curGenSpecies,
+                                              &speciation, nnDef);
+#elif defined(NNTYPE_NN)
+    restored = restored && nnSnapshotRestore(snap, 0, curGenNN, BIRD_COUNT, curGenSpecies,
+                                             &speciation, nnDef);
+#endif
+    if(!restored) {
+        LOG("ERROR: snapshot> could not resume from %s, starting over", snapshotPath);
+        snapshotClose(&snap);
+        resetSimulation();
+        return false;
+    }
+
+    generationNumber = state->generationNumber;
+    curGenStats = state->curGenStats;
+    lastGenStats = state->lastGenStats;
+    memmove(pastGenStats, pastStats, sizeof(pastGenStats));
+    snapshotClose(&snap);
+
+    LOG("snapshot> resumed from %s at generation %d (%.3fms)", snapshotPath, generationNumber,
+        timeToMicrosec(timeGet() - t0) / 1000.0);
+    return true;
+}
+
+#ifdef HEADLESS
+// step the simulation as fast as possible, no window or rendering
+// maxGenerations <= 0 runs forever
+void runHeadless(i32 maxGenerations)
+{
+    const i64 reportIntervalMicro = 5000000;
+    const timept startTime = timeGet();
+    timept reportTime = startTime;
+    i64 stepCount = 0;
+    i64 reportStepCount = 0;
+    i32 reportGenNumber = generationNumber;
+
+    profileResetTotals();
+
+    while(maxGenerations <= 0 || generationNumber <= maxGenerations) {
+        step();
+        profileFrameEnd();
+        stepCount++;
+
+        const i64 reportDelta = timeToMicrosec(timeGet() - reportTime);
+        if(reportDelta >= reportIntervalMicro) {
+            const f64 sec = reportDelta / 1000000.0;
+            LOG("headless> gen=%d steps/s=%.0f gen/s=%.3f", generationNumber,
+                (stepCount - reportStepCount) / sec, (generationNumber - reportGenNumber) / sec);
+            // zones run inside parallelFor add up the time of every thread
+            profileLogTotals("headless>");
+            profileResetTotals();
+            reportTime = timeGet();
+            reportStepCount = stepCount;
+            reportGenNumber = generationNumber;
+        }
+    }
+
+    const f64 totalSec = timeToMicrosec(timeGet() - startTime) / 1000000.0;
+    LOG("headless> done: %d birds x %d episodes, %d threads, %d generations, %lld steps in %.2fs (steps/s=%.0f gen/s=%.3f)",
+        BIRD_COUNT, episodeCount, threadPoolThreadCount(), generationNumber - 1, (long long)stepCount, totalSec,
+        stepCount / totalSec, (generationNumber - 1) / totalSec);
+}
+
+#ifdef __AVX2__
+// checks updatePhysicsWide against the scalar reference on random bird states, then times both
+void benchPhysics(i32 iterations)
+{
+    // every episode slot is checked
+    birdSlotCount = BIRD_SLOT_COUNT;
+
+    for(i32 i = 0; i < birdSlotCount; ++i) {
+        birdPosX[i] = randf64(-5000.0, 5000.0);
+        birdPosY[i] = randf64(-5000.0, GROUND_Y);
+        birdVelX[i] = randf64(-1000.0, 1000.0);
+        birdVelY[i] = randf64(-1000.0, 1000.0);
+        birdRot[i] = randf64(-TAU, TAU);
+        birdAngularVel[i] = randf64(-20.0, 20.0);
+        birdFlapLeftCd[i] = randi64(0, 1) ? 0.0 : randf64(0.0, WING_FLAP_TIME);
+        birdFlapRightCd[i] = randf64(0.0, WING_FLAP_TIME);
+        birdInput[i].left = randi64(0, 1) ? randi64(0, 255) : 0;
+        birdInput[i].right = randi64(0, 1) ? randi64(0, 255) : 0;
+        birdInput[i].flap = randi64(0, 1) ? randi64(0, 255) : 0;
+        birdInput[i].brake = randi64(0, 1) ? randi64(0, 255) : 0;
+        birdBraking[i] = false;
+        birdDead[i] = randi64(0, 9) == 0;
+        birdDeadFromGround[i] = false;
+        birdFitness[i] = randf64(0.0, 10.0);
+    }
+
+    struct StateArray { void* ptr; i32 size; };
+    const StateArray state[] = {
+        { birdPosX, sizeof(birdPosX) }, { birdPosY, sizeof(birdPosY) },
+        { birdVelX, sizeof(birdVelX) }, { birdVelY, sizeof(birdVelY) },
+        { birdRot, sizeof(birdRot) }, { birdAngularVel, sizeof(birdAngularVel) },
+        { birdFlapLeftCd, sizeof(birdFlapLeftCd) }, { birdFlapRightCd, sizeof(birdFlapRightCd) },
+        { birdBraking, sizeof(birdBraking) }, { birdDead, sizeof(birdDead) },
+        { birdDeadFromGround, sizeof(birdDeadFromGround) }, { birdFitness, sizeof(birdFitness) },
+    };
+
+    i32 stateSize = 0;
+    for(const StateArray& sa : state) stateSize += sa.size;
+    u8* initial = (u8*)malloc(stateSize);
+    u8* reference = (u8*)malloc(stateSize);
+
+    auto saveState = [&](u8* dest) {
+        for(const StateArray& sa : state) {
+            memmove(dest, sa.ptr, sa.size);
+            dest += sa.size;
+        }
+    };
+    auto restoreState = [&](const u8* src) {
+        for(const StateArray& sa : state) {
+            memmove(sa.ptr, src, sa.size);
+            src += sa.size;
+        }
+    };
+
+    saveState(initial);
+
+    // one step, compare
+    updatePhysicsScalar(0, birdSlotCount);
+    saveState(reference);
+    const u8* refArr[arr_count(state)];
+    i32 offset = 0;
+    for(i32 k = 0; k < (i32)arr_count(state); ++k) {
+        refArr[k] = reference + offset;
+        offset += state[k].size;
+    }
+    const f32* refPosX = (const f32*)refArr[0];
+    const f32* refPosY = (const f32*)refArr[1];
+    const f32* refVelX = (const f32*)refArr[2];
+    const f32* refVelY = (const f32*)refArr[3];
+    const f32* refRot = (const f32*)refArr[4];
+    const u8* refBraking = refArr[8];
+    const u8* refDead = refArr[9];
+
+    restoreState(initial);
+    updatePhysicsWide(0, birdSlotCount);
+
+    f32 maxPosDiff = 0, maxVelDiff = 0, maxRotDiff = 0;
+    i32 flagMismatches = 0;
+    for(i32 i = 0; i < birdSlotCount; ++i) {
+        maxPosDiff = max(maxPosDiff, fabsf(birdPosX[i] - refPosX[i]));
+        maxPosDiff = max(maxPosDiff, fabsf(birdPosY[i] - refPosY[i]));
+        maxVelDiff = max(maxVelDiff, fabsf(birdVelX[i] - refVelX[i]));
+        maxVelDiff = max(maxVelDiff, fabsf(birdVelY[i] - refVelY[i]));
+        f32 rotDiff = fabsf(birdRot[i] - refRot[i]);
+        rotDiff = min(rotDiff, fabsf(rotDiff - (f32)TAU)); // fmod can land on either side of TAU
+        maxRotDiff = max(maxRotDiff, rotDiff);
+        flagMismatches += (birdBraking[i] != refBraking[i]) + (birdDead[i] != refDead[i]);
+    }
+    LOG("physbench> max diff: pos=%g vel=%g rot=%g flagMismatches=%d",
+        maxPosDiff, maxVelDiff, maxRotDiff, flagMismatches);
+
+    // timings
+    restoreState(initial);
+    timept t0 = timeGet();
+    for(i32 it = 0; it < iterations; ++it) {
+        updatePhysicsScalar(0, birdSlotCount);
+    }
+    const i64 scalarMicro = timeToMicrosec(timeGet() - t0);
+
+    restoreState(initial);
+    t0 = timeGet();
+    for(i32 it = 0; it < iterations; ++it) {
+        updatePhysicsWide(0, birdSlotCount);
+    }
+    const i64 wideMicro = timeToMicrosec(timeGet() - t0);
+
+    const f64 birdSteps = (f64)birdSlotCount * iterations;
+    LOG("physbench> %d birds x %d steps: scalar=%.2fns/bird wide=%.2fns/bird (x%.2f)",
+        birdSlotCount, iterations, scalarMicro * 1000.0 / birdSteps, wideMicro * 1000.0 / birdSteps,
+        (f64)scalarMicro / max(wideMicro, (i64)1));
+
+    restoreState(initial);
+    free(initial);
+    free(reference);
+}
+#endif
+#else
+// fixed FRAME_DT simulation steps, decoupled from presentation:
+// real time * timeScale feeds an accumulator that is drained by as many steps as fit in the
+// frame budget, then one frame is rendered and we sleep until the next present
 void run()
 {
+    const i64 presentDtMicro = FRAME_DT * 1000000;
+    f64 simAccumulator = 0.0;
+    timept lastFrameTime = timeGet();
+
     while(window.running) {
-        timept t0 = timeGet();
+        const timept frameStart = timeGet();
+        const f64 realDt = timeToMicrosec(frameStart - lastFrameTime) / 1000000.0;
+        lastFrameTime = frameStart;
 
         SDL_Event event;
         while(SDL_PollEvent(&event)) {
@@ -462,20 +815,35 @@ void run()
 
         newFrame();
 
-		static f64 lastTimeRender = TIME_MILLI();
-		if(dbgTimeMaxSpeed && TIME_MILLI()-lastTimeRender < 500) {
-			ImGui::EndFrame();
-		}
-		else {
-			lastTimeRender = TIME_MILLI();
-			render();
-			window.swap();
-		}
+        // max speed ignores the accumulator and steps for the whole (larger) budget
+        const i64 budgetMicro = dbgTimeMaxSpeed ? SIM_BUDGET_MAX_SPEED_MICRO : SIM_BUDGET_MICRO;
+        simAccumulator += realDt * timeScale;
 
+        i32 stepCount = 0;
+        while(dbgTimeMaxSpeed || simAccumulator >= FRAME_DT) {
+            step();
+            stepCount++;
+            simAccumulator -= FRAME_DT;
+
+            if(timeToMicrosec(timeGet() - frameStart) >= budgetMicro) {
+                break;
+            }
+        }
+
+        // we can't keep up, drop the backlog instead of spiraling
+        simAccumulator = clamp(simAccumulator, 0.0, FRAME_DT);
+        lastFrameStepCount = stepCount;
+
+        updateVisuals();
+        render();
+        window.swap();
+        profileFrameEnd();
+
+        // sleep until the next present, the accumulator absorbs the scheduler jitter
         if(!dbgTimeMaxSpeed) {
-            const i64 frameDtMicro = FRAME_DT/timeScale * 1000000;
-            while(((frameDtMicro - timeToMicrosec(timeGet() - t0)) / 1000) > 1) {
-                _mm_pause();
+            const i64 remainingMicro = presentDtMicro - timeToMicrosec(timeGet() - frameStart);
+            if(remainingMicro > 1000) {
+                SDL_Delay(remainingMicro / 1000);
             }
         }
     }
@@ -618,12 +986,12 @@ void ui_birdViewer()
     ImGui::BeginGroup();
     ImGui::TextColored(titleColor, "Input");
 
-    Vec2 applePos = applePosList[birdApplePositionId[dbgViewerBirdId]];
-    f64 appleOffsetX = applePos.x - birdPos[dbgViewerBirdId].x;
-    f64 appleOffsetY = applePos.y - birdPos[dbgViewerBirdId].y;
+    Vec2 applePos = birdApplePos(dbgViewerBirdId);
+    f64 appleOffsetX = applePos.x - birdPosX[dbgViewerBirdId];
+    f64 appleOffsetY = applePos.y - birdPosY[dbgViewerBirdId];
 
-    ImGui::Text("velX: %g", birdVel[dbgViewerBirdId].x / 1000.0);
-    ImGui::Text("velY: %g", birdVel[dbgViewerBirdId].y / 1000.0);
+    ImGui::Text("velX: %g", birdVelX[dbgViewerBirdId] / 1000.0);
+    ImGui::Text("velY: %g", birdVelY[dbgViewerBirdId] / 1000.0);
     ImGui::Text("appleOffsetX: %g", appleOffsetX / 2000.0);
     ImGui::Text("appleOffsetY: %g", appleOffsetY / 2000.0);
     ImGui::Text("rot: %g", birdRot[dbgViewerBirdId] / TAU);
@@ -632,8 +1000,8 @@ void ui_birdViewer()
     ImGui::Separator();
 
     ImGui::TextColored(titleColor, "Fitness factors");
-    f64 distFactor = 1.0 - (min(vec2Distance(&birdPos[dbgViewerBirdId],
-                                             &appleTf[dbgViewerBirdId].pos), 2000) / 2000.0);
+    const Vec2 viewerPos = birdPosition(dbgViewerBirdId);
+    f64 distFactor = 1.0 - (min(vec2Distance(&viewerPos, &appleTf[dbgViewerBirdId].pos), 2000) / 2000.0);
     f64 healthFactor = birdHealth[dbgViewerBirdId] / HEALTH_MAX;
     ImGui::Text("distance: %g", distFactor);
     ImGui::Text("health: %g", healthFactor);
@@ -734,8 +1102,10 @@ void ui_simOptions()
 {
     ImGui::Begin("Simulation");
 
-    ImGui::SliderInt("time scale", &timeScale, 1, 20);
+    ImGui::SliderInt("time scale", &timeScale, 1, 100);
     ImGui::Checkbox("Max speed", &dbgTimeMaxSpeed);
+    ImGui::Text("Steps per frame: %d", lastFrameStepCount);
+    ImGui::SliderInt("Episodes per genome", &nextEpisodeCount, 1, EPISODE_MAX_COUNT);
     ImGui::Checkbox("Show objective lines", &dbgShowObjLines);
     ImGui::Checkbox("Highlight bird", &dbgHightlightBird);
     ImGui::Checkbox("Follow bird", &dbgFollowBird);
@@ -768,37 +1138,40 @@ void doUI()
     ui_birdViewer();
     ui_generationViewer();
     ui_speciation();
+    ImGui_ProfileWindow();
 }
+#endif
 
 
-void updateNNs()
+// the update functions work on a slice of the active bird list so they can run on several threads
+void updateNNs(const i32* ids, const i32 count)
 {
+    PROFILE_ZONE("updateNNs");
+    const i64 scratchStart = scratchMark();
 #ifdef NNTYPE_RNN
-    RecurrentNeuralNet* aliveNN[BIRD_COUNT];
+    RecurrentNeuralNet** aliveNN = scratchArr<RecurrentNeuralNet*>(count);
 #elif defined(NNTYPE_NN)
-    NeuralNet* aliveNN[BIRD_COUNT];
+    NeuralNet** aliveNN = scratchArr<NeuralNet*>(count);
 #endif
     i32 aliveCount = 0;
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
         if(birdDead[i]) continue;
-        aliveNN[aliveCount++] = curGenNN[i];
+        aliveNN[aliveCount++] = birdNN[i];
     }
 
     // setup neural net inputs
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    PROFILE_SCOPE(inputZone, "nnInputs");
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
         if(birdDead[i]) continue;
-        Vec2 applePos = applePosList[birdApplePositionId[i]];
-        f64 appleOffsetX = applePos.x - birdPos[i].x;
-        f64 appleOffsetY = applePos.y - birdPos[i].y;
-        f64 velX = birdVel[i].x;
-        f64 velY = birdVel[i].y;
+        Vec2 applePos = birdApplePos(i);
+        f64 appleOffsetX = applePos.x - birdPosX[i];
+        f64 appleOffsetY = applePos.y - birdPosY[i];
+        f64 velX = birdVelX[i];
+        f64 velY = birdVelY[i];
         f64 rot = birdRot[i];
-        f64 angVel = birdAngularVel[i];
-
-        Vec2 diff = vec2Minus(&applePos, &birdPos[i]);
-        Vec2 dir = {cosf(rot), sinf(rot)};
-        f32 diffRot = vec2AngleBetween(&dir, &diff);
 
         f64 inputs[6] = {
             velX / 1000.0,
@@ -812,9 +1185,11 @@ void updateNNs()
         };
 
         assert(arr_count(inputs) == nnDef.inputNeuronCount);
-        curGenNN[i]->setInputs(inputs, arr_count(inputs));
+        birdNN[i]->setInputs(inputs, arr_count(inputs));
     }
+    inputZone.stop();
 
+    PROFILE_SCOPE(propagateZone, "propagate");
 #ifdef NNTYPE_RNN
     #ifdef CONF_DEBUG
         rnnPropagate(aliveNN, aliveCount, nnDef);
@@ -828,15 +1203,17 @@ void updateNNs()
         nnPropagate(aliveNN, aliveCount, nnDef); // TODO: make wide
     #endif
 #endif
+    propagateZone.stop();
 
     // get neural net output
     const i32 outputCount = nnDef.outputNeuronCount;
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
         if(birdDead[i]) continue;
         f64 out[4];
         assert(arr_count(out) == nnDef.outputNeuronCount);
-        memmove(out, curGenNN[i]->output, sizeof(out[0]) * outputCount);
+        memmove(out, birdNN[i]->output, sizeof(out[0]) * outputCount);
 
         // tanh
         outputNormalizeTanh(out, arr_count(out));
@@ -851,12 +1228,16 @@ void updateNNs()
         birdInput[i].flap = clamp(out[2] - 0.5, 0.0, 0.5) * 2.0 * 255;
         birdInput[i].brake = clamp(out[3] - 0.5, 0.0, 0.5) * 2.0 * 255;
     }
+
+    scratchRewind(scratchStart);
 }
 
-void updateMechanics()
+void updateMechanics(const i32* ids, const i32 count, StepPartial* partial)
 {
+    PROFILE_ZONE("mechanics");
     // wing anim time
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
         if(birdDead[i]) continue;
         birdFlapLeftCd[i] -= FRAME_DT;
         birdFlapRightCd[i] -= FRAME_DT;
@@ -870,32 +1251,38 @@ void updateMechanics()
     }
 
     // check if we touched the apple
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
         if(birdDead[i]) continue;
-        Vec2* applePos = &applePosList[birdApplePositionId[i]];
-        if(vec2Distance(applePos, &birdPos[i]) < APPLE_RADIUS) {
+        const Vec2 pos = birdPosition(i);
+        Vec2 applePos = birdApplePos(i);
+        if(vec2Distance(&applePos, &pos) < APPLE_RADIUS) {
             birdApplePositionId[i]++;
             birdAppleEatenCount[i]++;
             birdHealth[i] = HEALTH_MAX;
-            birdShortestDistToNextApple[i] = vec2Distance(&applePosList[birdApplePositionId[i]],
-                    &birdPos[i]);
+            applePos = birdApplePos(i);
+            birdShortestDistToNextApple[i] = vec2Distance(&applePos, &pos);
         }
     }
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
         if(birdDead[i]) continue;
-        f32 dist = vec2Distance(&applePosList[birdApplePositionId[i]], &birdPos[i]);
+        const Vec2 pos = birdPosition(i);
+        const Vec2 applePos = birdApplePos(i);
+        f32 dist = vec2Distance(&applePos, &pos);
         birdShortestDistToNextApple[i] = min(birdShortestDistToNextApple[i], dist);
     }
 
-    f32 birdDistToNextAppleOld[BIRD_COUNT];
-    memmove(birdDistToNextAppleOld, birdDistToNextApple, sizeof(birdDistToNextApple));
-
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        birdDistToNextApple[i] = vec2Distance(&applePosList[birdApplePositionId[i]], &birdPos[i]);
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
+        const Vec2 pos = birdPosition(i);
+        const Vec2 applePos = birdApplePos(i);
+        birdDistToNextApple[i] = vec2Distance(&applePos, &pos);
     }
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
         if(birdDead[i]) continue;
 
         birdHealth[i] -= FRAME_DT;
@@ -905,10 +1292,14 @@ void updateMechanics()
     }
 
     // calculate fitness
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
         if(birdDead[i]) continue;
         f64 applesFactor = birdAppleEatenCount[i];
-        f64 distFactor = 1.0 - (min(vec2Distance(&birdPos[i], &appleTf[i].pos), 2000) / 2000.0); // 0.0 -> 1.0
+        // appleTf is only updated when rendering, use the apple list directly
+        const Vec2 pos = birdPosition(i);
+        const Vec2 applePos = birdApplePos(i);
+        f64 distFactor = 1.0 - (min(vec2Distance(&pos, &applePos), 2000) / 2000.0); // 0.0 -> 1.0
         f64 healthFactor = birdHealth[i] / HEALTH_MAX;
 
         birdFitnessAcc[i] += (healthFactor + distFactor * distFactor) * FRAME_DT;
@@ -918,161 +1309,78 @@ void updateMechanics()
 
     f64 maxFitness = 0.0;
     f64 totalFitness = 0.0;
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    i32 aliveCount = 0;
+    for(i32 k = 0; k < count; ++k) {
+        const i32 i = ids[k];
         totalFitness += birdFitness[i];
         if(birdFitness[i] > maxFitness) {
             maxFitness = birdFitness[i];
         }
+        aliveCount += !birdDead[i];
     }
 
-    curGenStats.avgFitness = totalFitness / BIRD_COUNT;
-    curGenStats.maxFitness = maxFitness;
-
-    bool allDead = true;
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        if(!birdDead[i]) {
-            allDead = false;
-            break;
-        }
-    }
-
-    // produce next generation
-    if(allDead) {
-        nextGeneration();
-    }
+    partial->maxFitness = maxFitness;
+    partial->totalFitness = totalFitness;
+    partial->aliveCount = aliveCount;
 }
 
-void updatePhysics()
+// reference implementation, also handles the tail of the wide kernel
+void updatePhysicsScalar(const i32 start, const i32 end)
 {
-#if 0
-    // apply bird input
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        u8 flapLeft = (birdFlapLeftCd[i] <= 0.0f) && birdInput[i].left;
-        u8 flapRight = (birdFlapRightCd[i] <= 0.0f) && birdInput[i].right;
-
-        Vec2 leftForce = {
-            flapLeft * cosf(birdRot[i] +PI * 0.15f) * WING_STRENGTH,
-            flapLeft * sinf(birdRot[i] +PI * 0.15f) * WING_STRENGTH,
-        };
-        Vec2 rightForce = {
-            flapRight * cosf(birdRot[i] -PI * 0.15f) * WING_STRENGTH,
-            flapRight * sinf(birdRot[i] -PI * 0.15f) * WING_STRENGTH,
-        };
-
-        Vec2 totalForce = { leftForce.x + rightForce.x, leftForce.y + rightForce.y };
-
-        if(flapLeft && flapRight) {
-            totalForce.x *= 1.5f;
-            totalForce.y *= 1.5f;
-            birdAngularVel[i] *= 0.5;
-        }
-
-        // easier to rectify speed
-        f32 vl = vec2Len(&birdVel[i]);
-        f32 fl = vec2Len(&totalForce);
-
-        if(vec2Dot(&birdVel[i], &totalForce) < -(vl * fl * 0.5)) {
-            totalForce.x += -birdVel[i].x * 0.75;
-            totalForce.y += -birdVel[i].y * 0.75;
-        }
-
-        birdVel[i].x += totalForce.x;
-        birdVel[i].y += totalForce.y;
-
-        // easier to rectify angle
-        f32 leftAngStr = WING_STRENGTH_ANGULAR;
-        f32 rightAngStr = -WING_STRENGTH_ANGULAR;
-
-        /*if(birdAngularVel[i] < 0.0) {
-            leftAngStr -= birdAngularVel[i];
-            rightAngStr += birdAngularVel[i] * 0.5;
-        }
-
-        if(birdAngularVel[i] > 0.0) {
-            rightAngStr -= birdAngularVel[i];
-            leftAngStr += birdAngularVel[i] * 0.5;
-        }*/
-
-        birdAngularVel[i] += flapLeft * leftAngStr +
-                                 flapRight * rightAngStr;
-
-        if(flapLeft) {
-            birdFlapLeftCd[i] = WING_FLAP_TIME;
-        }
-        if(flapRight) {
-            birdFlapRightCd[i] = WING_FLAP_TIME;
-        }
-    }
-#endif
-
     constexpr f32 gravity = 200.f;
 
-    // apply bird input
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        if(birdDead[i]) continue;
-        f64 rotLeft = birdInput[i].left / 255.0;
-        f64 rotRight = birdInput[i].right / 255.0;
-        f64 flap = 0;
-        f64 brake = 0;
+    for(i32 i = start; i < end; ++i) {
+        // apply bird input
+        if(!birdDead[i]) {
+            f64 rotLeft = birdInput[i].left / 255.0;
+            f64 rotRight = birdInput[i].right / 255.0;
+            f64 flap = 0;
+            f64 brake = 0;
+
+            if(birdFlapLeftCd[i] <= 0.0f) {
+                if(birdInput[i].flap) {
+                    flap = birdInput[i].flap / 255.0;
+                }
+                else if(birdInput[i].brake) {
+                    brake = birdInput[i].brake / 255.0;
+                }
+            }
 
-        if(birdFlapLeftCd[i] <= 0.0f) {
-            if(birdInput[i].flap) {
-                flap = birdInput[i].flap / 255.0;
+            birdRot[i] += rotRight * WING_STRENGTH_ANGULAR * FRAME_DT +
+                          rotLeft  * -WING_STRENGTH_ANGULAR * FRAME_DT;
+
+            if(brake > 0.0) {
+                birdVelX[i] *= 1.0 - (WING_BRAKE * brake);
+                birdVelY[i] *= 1.0 - (WING_BRAKE * brake);
+                birdFlapLeftCd[i] = WING_FLAP_TIME;
+                birdFlapRightCd[i] = WING_FLAP_TIME;
+                birdBraking[i] = true;
             }
-            else if(birdInput[i].brake) {
-                brake = birdInput[i].brake / 255.0;
+            else if(flap > 0.0) {
+                birdVelX[i] += (f32)(cosf(birdRot[i]) * WING_STRENGTH * FRAME_DT * flap);
+                birdVelY[i] += (f32)(sinf(birdRot[i]) * WING_STRENGTH * FRAME_DT * flap);
+                birdFlapLeftCd[i] = WING_FLAP_TIME;
+                birdFlapRightCd[i] = WING_FLAP_TIME;
             }
         }
 
-        birdRot[i] += rotRight * WING_STRENGTH_ANGULAR * FRAME_DT +
-                      rotLeft  * -WING_STRENGTH_ANGULAR * FRAME_DT;
-
-        if(brake > 0.0) {
-            birdVel[i].x *= 1.0 - (WING_BRAKE * brake);
-            birdVel[i].y *= 1.0 - (WING_BRAKE * brake);
-            birdFlapLeftCd[i] = WING_FLAP_TIME;
-            birdFlapRightCd[i] = WING_FLAP_TIME;
-            birdBraking[i] = true;
-        }
-        else if(flap > 0.0) {
-            Vec2 force = {(f32)(cosf(birdRot[i]) * WING_STRENGTH * FRAME_DT * flap),
-                          (f32)(sinf(birdRot[i]) * WING_STRENGTH * FRAME_DT * flap)};
-
-            birdVel[i].x += force.x;
-            birdVel[i].y += force.y;
-            birdFlapLeftCd[i] = WING_FLAP_TIME;
-            birdFlapRightCd[i] = WING_FLAP_TIME;
-        }
-    }
+        // apply gravity and friction to bird velocity
+        birdVelY[i] += gravity * FRAME_DT;
 
-    // apply gravity and friction to bird velocity
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        birdVel[i].y += gravity * FRAME_DT;
-        /*birdVel[i].y *= 1.f - FRICTION_AIR * FRAME_DT;
-        birdVel[i].x *= 1.f - FRICTION_AIR * FRAME_DT;*/
-    }
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
         if(birdAngularVel[i] > ANGULAR_VELOCITY_MAX) birdAngularVel[i] = ANGULAR_VELOCITY_MAX;
         if(birdAngularVel[i] < -ANGULAR_VELOCITY_MAX) birdAngularVel[i] = -ANGULAR_VELOCITY_MAX;
         birdAngularVel[i] *= 1.f - FRICTION_AIR_ANGULAR * FRAME_DT;
-    }
 
-    // apply bird velocity to pos
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        birdPos[i].x += birdVel[i].x * FRAME_DT;
-        birdPos[i].y += birdVel[i].y * FRAME_DT;
-    }
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        //birdRot[i] += birdAngularVel[i] * FRAME_DT;
+        // apply bird velocity to pos
+        birdPosX[i] += birdVelX[i] * FRAME_DT;
+        birdPosY[i] += birdVelY[i] * FRAME_DT;
         birdRot[i] = fmod(birdRot[i], TAU);
-    }
 
-    // check for ground collision
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        if(birdPos[i].y > GROUND_Y) {
-            birdPos[i].y = GROUND_Y;
-            birdVel[i].x = 0;
-            birdVel[i].y = 0;
+        // check for ground collision
+        if(birdPosY[i] > GROUND_Y) {
+            birdPosY[i] = GROUND_Y;
+            birdVelX[i] = 0;
+            birdVelY[i] = 0;
 
             if(!birdDead[i]) {
                 birdDead[i] = true;
@@ -1083,6 +1391,147 @@ void updatePhysics()
     }
 }
 
+#ifdef __AVX2__
+// same as updatePhysicsScalar on 8 birds at a time, dead birds are masked out of the input part
+// everything is computed in f32 so results differ from the reference by a few ulps
+void updatePhysicsWide(const i32 start, const i32 end)
+{
+    constexpr f32 gravity = 200.f;
+    const f32 dt = FRAME_DT;
+
+    const w256 zero = wide_f32_zero();
+    const w256 one = wide_f32_set1(1.f);
+    const w256 inv255 = wide_f32_set1(1.f / 255.f);
+    const w256 rotStrength = wide_f32_set1(WING_STRENGTH_ANGULAR * FRAME_DT);
+    const w256 flapStrength = wide_f32_set1(WING_STRENGTH * FRAME_DT);
+    const w256 brakeStrength = wide_f32_set1(WING_BRAKE);
+    const w256 flapTime = wide_f32_set1(WING_FLAP_TIME);
+    const w256 gravityStep = wide_f32_set1(gravity * dt);
+    const w256 angVelMax = wide_f32_set1(ANGULAR_VELOCITY_MAX);
+    const w256 angVelMin = wide_f32_set1(-ANGULAR_VELOCITY_MAX);
+    const w256 angFriction = wide_f32_set1(1.f - FRICTION_AIR_ANGULAR * dt);
+    const w256 wdt = wide_f32_set1(dt);
+    const w256 groundY = wide_f32_set1(GROUND_Y);
+    const w256i byteMask = wide_i32_set1(0xFF);
+    const w256i zeroi = _mm256_setzero_si256();
+
+    static_assert(sizeof(BirdInput) == 4, "BirdInput is loaded as one i32 per bird");
+
+    i32 i = start;
+    for(; i + 8 <= end; i += 8) {
+        const w256 alive = wide_i32_as_f32(wide_i32_equal(wide_u8_load_to_i32(&birdDead[i]), zeroi));
+
+        // unpack left, right, flap, brake bytes
+        const w256i input = wide_i32_load(&birdInput[i]);
+        const w256 rotLeft = wide_f32_mul(wide_i32_to_f32(wide_i32_and(input, byteMask)), inv255);
+        const w256 rotRight = wide_f32_mul(wide_i32_to_f32(wide_i32_and(wide_i32_shr(input, 8), byteMask)), inv255);
+        const w256i flapIn = wide_i32_and(wide_i32_shr(input, 16), byteMask);
+        const w256i brakeIn = wide_i32_shr(input, 24);
+        const w256 flapInZero = wide_i32_as_f32(wide_i32_equal(flapIn, zeroi));
+        const w256 brakeInZero = wide_i32_as_f32(wide_i32_equal(brakeIn, zeroi));
+
+        w256 flapLeftCd = wide_f32_load(&birdFlapLeftCd[i]);
+        w256 flapRightCd = wide_f32_load(&birdFlapRightCd[i]);
+        const w256 ready = wide_f32_and(alive, wide_f32_less_equal(flapLeftCd, zero));
+        const w256 flapMask = wide_f32_andnot(flapInZero, ready);
+        const w256 brakeMask = wide_f32_andnot(brakeInZero, wide_f32_and(ready, flapInZero));
+
+        w256 rot = wide_f32_load(&birdRot[i]);
+        rot = wide_f32_add(rot, wide_f32_and(alive, wide_f32_mul(wide_f32_sub(rotRight, rotLeft), rotStrength)));
+
+        w256 sinRot, cosRot;
+        wide_f32_sincos(rot, &sinRot, &cosRot);
+
+        w256 velX = wide_f32_load(&birdVelX[i]);
+        w256 velY = wide_f32_load(&birdVelY[i]);
+
+        // brake
+        const w256 brakeFactor = wide_f32_sub(one, wide_f32_mul(brakeStrength,
+                                    wide_f32_mul(wide_i32_to_f32(brakeIn), inv255)));
+        velX = wide_f32_blendv(velX, wide_f32_mul(velX, brakeFactor), brakeMask);
+        velY = wide_f32_blendv(velY, wide_f32_mul(velY, brakeFactor), brakeMask);
+
+        // flap
+        const w256 flapForce = wide_f32_mul(flapStrength, wide_f32_mul(wide_i32_to_f32(flapIn), inv255));
+        velX = wide_f32_add(velX, wide_f32_and(flapMask, wide_f32_mul(cosRot, flapForce)));
+        velY = wide_f32_add(velY, wide_f32_and(flapMask, wide_f32_mul(sinRot, flapForce)));
+
+        const w256 wingUsed = wide_f32_or(flapMask, brakeMask);
+        flapLeftCd = wide_f32_blendv(flapLeftCd, flapTime, wingUsed);
+        flapRightCd = wide_f32_blendv(flapRightCd, flapTime, wingUsed);
+
+        // gravity and angular friction
+        velY = wide_f32_add(velY, gravityStep);
+
+        w256 angVel = wide_f32_load(&birdAngularVel[i]);
+        angVel = wide_f32_mul(wide_f32_max(wide_f32_min(angVel, angVelMax), angVelMin), angFriction);
+
+        // integrate
+        w256 posX = wide_f32_add(wide_f32_load(&birdPosX[i]), wide_f32_mul(velX, wdt));
+        w256 posY = wide_f32_add(wide_f32_load(&birdPosY[i]), wide_f32_mul(velY, wdt));
+        rot = wide_f32_wrap_angle(rot);
+
+        // ground collision
+        const w256 hitGround = wide_f32_greater_than(posY, groundY);
+        posY = wide_f32_blendv(posY, groundY, hitGround);
+        velX = wide_f32_andnot(hitGround, velX);
+        velY = wide_f32_andnot(hitGround, velY);
+
+        wide_f32_store(&birdPosX[i], posX);
+        wide_f32_store(&birdPosY[i], posY);
+        wide_f32_store(&birdVelX[i], velX);
+        wide_f32_store(&birdVelY[i], velY);
+        wide_f32_store(&birdRot[i], rot);
+        wide_f32_store(&birdAngularVel[i], angVel);
+        wide_f32_store(&birdFlapLeftCd[i], flapLeftCd);
+        wide_f32_store(&birdFlapRightCd[i], flapRightCd);
+
+        // byte flags rarely change, write them per bird
+        const i32 brakeBits = wide_f32_movemask(brakeMask);
+        const i32 deathBits = wide_f32_movemask(wide_f32_and(hitGround, alive));
+        if(brakeBits | deathBits) {
+            for(i32 b = 0; b < 8; ++b) {
+                if(brakeBits & (1 << b)) {
+                    birdBraking[i + b] = true;
+                }
+                if(deathBits & (1 << b)) {
+                    birdDead[i + b] = true;
+                    birdDeadFromGround[i + b] = true;
+                    birdFitness[i + b] *= 0.8; // death from ground penalty
+                }
+            }
+        }
+    }
+
+    updatePhysicsScalar(i, end);
+}
+#endif
+
+void updatePhysicsRange(const i32 start, const i32 end)
+{
+#ifdef __AVX2__
+    updatePhysicsWide(start, end);
+#else
+    updatePhysicsScalar(start, end);
+#endif
+}
+
+void updatePhysics(const i32* ids, const i32 count)
+{
+    PROFILE_ZONE("physics");
+    // ids are sorted, runs of consecutive ids are contiguous ranges of the state arrays
+    i32 k = 0;
+    while(k < count) {
+        i32 runEnd = k + 1;
+        while(runEnd < count && ids[runEnd] == ids[runEnd - 1] + 1) {
+            runEnd++;
+        }
+        updatePhysicsRange(ids[k], ids[runEnd - 1] + 1);
+        k = runEnd;
+    }
+}
+
+#ifndef HEADLESS
 void updateCamera()
 {
     if(mouseRightButDown) {
@@ -1093,6 +1542,7 @@ void updateCamera()
     }
     setView(viewX, viewY, window.winWidth*viewZoom, window.winHeight*viewZoom);
 }
+#endif
 
 struct FitnessPair
 {
@@ -1100,8 +1550,53 @@ struct FitnessPair
     f64 fitness;
 };
 
+// mean fitness over the episodes of each genome
+void aggregateGenomeFitness()
+{
+    f64 maxFitness = 0.0;
+    f64 totalFitness = 0.0;
+    for(i32 g = 0; g < BIRD_COUNT; ++g) {
+        f64 sum = 0.0;
+        for(i32 e = 0; e < episodeCount; ++e) {
+            sum += birdFitness[e * BIRD_COUNT + g];
+        }
+        genomeFitness[g] = sum / episodeCount;
+        maxFitness = max(maxFitness, genomeFitness[g]);
+        totalFitness += genomeFitness[g];
+    }
+
+    curGenStats.maxFitness = maxFitness;
+    curGenStats.avgFitness = totalFitness / BIRD_COUNT;
+}
+
+// the best net of the generation is written out as C when it beats the last one exported
+void exportChampion()
+{
+    i32 best = 0;
+    for(i32 i = 1; i < BIRD_COUNT; ++i) {
+        if(genomeFitness[i] > genomeFitness[best]) best = i;
+    }
+    if(exportCGeneration >= 0 && genomeFitness[best] <= exportCBestFitness) return;
+
+    PROFILE_ZONE("exportC");
+#ifdef NNTYPE_RNN
+    const bool exported = rnnExportC(exportCPath, curGenNN[best], nnDef);
+#elif defined(NNTYPE_NN)
+    const bool exported = nnExportC(exportCPath, curGenNN[best], nnDef);
+#endif
+    if(exported) {
+        exportCBestFitness = genomeFitness[best];
+        exportCGeneration = generationNumber;
+        LOG("export> champion of generation #%d (fitness=%.5f)", generationNumber,
+            exportCBestFitness);
+    }
+}
+
 void nextGeneration()
 {
+    PROFILE_ZONE("evolve");
+    aggregateGenomeFitness();
+
     lastGenStats = curGenStats;
     memmove(pastGenStats, pastGenStats+1, sizeof(pastGenStats) - sizeof(pastGenStats[0]));
     pastGenStats[STATS_HISTORY_COUNT-1] = lastGenStats;
@@ -1112,23 +1607,86 @@ void nextGeneration()
     LOG("#%d maxFitness=%.5f avg=%.5f", generationNumber,
         lastGenStats.maxFitness, lastGenStats.avgFitness);
 
+    if(exportCEnabled) {
+        exportChampion();
+    }
+
 #ifdef NNTYPE_RNN
     rnnEvolve(&genEnv, true);
 #elif defined(NNTYPE_NN)
     nnEvolve(&genEnv, true);
 #endif
 
+    if(snapshotInterval > 0 && generationNumber % snapshotInterval == 0) {
+        writeSnapshot();
+    }
+
     if((curGenStats.number) % 10 == 0) {
         resetApplePath();
     }
     resetBirds();
 }
 
+// drop the birds that are dead and on the ground, nothing about them changes anymore
+void compactActiveBirds()
+{
+    i32 count = 0;
+    for(i32 k = 0; k < activeBirdCount; ++k) {
+        const i32 i = activeBirdIds[k];
+        if(birdDead[i] && birdPosY[i] >= GROUND_Y) {
+            inactiveFitnessTotal += birdFitness[i];
+            inactiveFitnessMax = max(inactiveFitnessMax, birdFitness[i]);
+            continue;
+        }
+        activeBirdIds[count++] = i;
+    }
+    activeBirdCount = count;
+}
+
+// one simulation step, shared by the window and headless loops
+void step()
+{
+    compactActiveBirds();
+
+    const i32 chunkCount = threadPoolThreadCount();
+    arr_zero(stepPartial, chunkCount);
+
+    // birds don't interact, each thread runs the whole step on its own slice
+    parallelFor(activeBirdCount, [this](i32 start, i32 end, i32 chunkId) {
+        const i32* ids = &activeBirdIds[start];
+        const i32 count = end - start;
+        updateNNs(ids, count);
+        updatePhysics(ids, count);
+        updateMechanics(ids, count, &stepPartial[chunkId]);
+    });
+
+    f64 maxFitness = inactiveFitnessMax;
+    f64 totalFitness = inactiveFitnessTotal;
+    i32 aliveCount = 0;
+    for(i32 c = 0; c < chunkCount; ++c) {
+        maxFitness = max(maxFitness, stepPartial[c].maxFitness);
+        totalFitness += stepPartial[c].totalFitness;
+        aliveCount += stepPartial[c].aliveCount;
+    }
+    aliveBirdCount = aliveCount;
+
+    curGenStats.avgFitness = totalFitness / birdSlotCount;
+    curGenStats.maxFitness = maxFitness;
+
+    // produce next generation
+    if(aliveBirdCount == 0) {
+        nextGeneration();
+    }
+}
+
+#ifndef HEADLESS
 void newFrame()
 {
     if(dbgAutoSelectBest) {
         f64 bestFitness = 0;
-        for(i32 i = 0; i < BIRD_COUNT; ++i) {
+        // only episode 0 is displayed, ids are sorted
+        for(i32 k = 0; k < activeBirdCount && activeBirdIds[k] < BIRD_COUNT; ++k) {
+            const i32 i = activeBirdIds[k];
             if(!birdDead[i] && birdFitness[i] > bestFitness) {
                 dbgViewerBirdId = i;
                 bestFitness = birdFitness[i];
@@ -1139,16 +1697,16 @@ void newFrame()
     doUI();
 
     if(dbgFollowBird) {
-        viewX = birdPos[dbgViewerBirdId].x - window.winWidth * viewZoom * 0.5;
-        viewY = birdPos[dbgViewerBirdId].y - window.winHeight * viewZoom * 0.5;
+        viewX = birdPosX[dbgViewerBirdId] - window.winWidth * viewZoom * 0.5;
+        viewY = birdPosY[dbgViewerBirdId] - window.winHeight * viewZoom * 0.5;
     }
 
     updateCamera();
-    updateNNs();
-
-    updatePhysics();
-    updateMechanics();
+}
 
+// render side state, once per presented frame
+void updateVisuals()
+{
     // update clouds
     const i32 cloud1Count2 = cloud1Count;
     const i32 cloud2Count2 = cloud2Count;
@@ -1165,10 +1723,19 @@ void newFrame()
         }
     }
 
+    // all birds, several steps can run between two frames so the active list may
+    // already have dropped birds that died since the last one
+    parallelFor(BIRD_COUNT, [this](i32 start, i32 end, i32 chunkId) {
+        updateBirdTransforms(start, end);
+    });
+}
+
+void updateBirdTransforms(const i32 start, const i32 end)
+{
     // update bird body transform
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        birdBodyTf[i].pos.x = birdPos[i].x;
-        birdBodyTf[i].pos.y = birdPos[i].y;
+    for(i32 i = start; i < end; ++i) {
+        birdBodyTf[i].pos.x = birdPosX[i];
+        birdBodyTf[i].pos.y = birdPosY[i];
         birdBodyTf[i].rot = birdRot[i] + PI * 0.5;
     }
 
@@ -1176,9 +1743,9 @@ void newFrame()
     const f32 wingDownAngle = PI * 0.6f;
 
     // update bird wing transform
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        birdLeftWingTf[i].pos.x = birdPos[i].x;
-        birdLeftWingTf[i].pos.y = birdPos[i].y;
+    for(i32 i = start; i < end; ++i) {
+        birdLeftWingTf[i].pos.x = birdPosX[i];
+        birdLeftWingTf[i].pos.y = birdPosY[i];
         if(birdBraking[i]) {
             birdLeftWingTf[i].rot = birdRot[i] + PI * 0.5 - wingUpAngle;
         }
@@ -1187,9 +1754,9 @@ void newFrame()
                 lerp(wingUpAngle, wingDownAngle, birdFlapLeftCd[i] / WING_FLAP_TIME);
         }
     }
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        birdRightWingTf[i].pos.x = birdPos[i].x;
-        birdRightWingTf[i].pos.y = birdPos[i].y;
+    for(i32 i = start; i < end; ++i) {
+        birdRightWingTf[i].pos.x = birdPosX[i];
+        birdRightWingTf[i].pos.y = birdPosY[i];
         if(birdBraking[i]) {
             birdRightWingTf[i].rot = birdRot[i] + PI * 0.5 + wingUpAngle;
         }
@@ -1200,37 +1767,35 @@ void newFrame()
     }
 
     // update apples position
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        appleTf[i].pos = applePosList[birdApplePositionId[i]];
+    for(i32 i = start; i < end; ++i) {
+        appleTf[i].pos = birdApplePos(i);
     }
 
     // update target lines
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
-        targetLine[i].p1 = birdPos[i];
+    for(i32 i = start; i < end; ++i) {
+        targetLine[i].p1 = birdPosition(i);
         targetLine[i].p2 = appleTf[i].pos;
     }
 
     const Color3 black = {0, 0, 0};
     const Color4 black4 = {0, 0, 0, 0};
-    Color3 birdColor[BIRD_COUNT];
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 i = start; i < end; ++i) {
         if(birdDead[i]) {
-            birdColor[i] = black;
             targetLine[i].c1 = black4;
             targetLine[i].c2 = black4;
         }
         else {
-            i32 species = curGenSpecies[i];
-            birdColor[i] = speciesColor[species];
-            targetLine[i].c1 = {birdColor[i].r, birdColor[i].g, birdColor[i].b, 255};
-            targetLine[i].c2 = {birdColor[i].r, birdColor[i].g, birdColor[i].b, 0};
+            const Color3 birdColor = speciesColor[curGenSpecies[i]];
+            targetLine[i].c1 = {birdColor.r, birdColor.g, birdColor.b, 255};
+            targetLine[i].c2 = {birdColor.r, birdColor.g, birdColor.b, 0};
         }
     }
 }
 
 void render()
 {
+    PROFILE_ZONE("render");
     glClear(GL_COLOR_BUFFER_BIT);
 
     // sky
@@ -1273,8 +1838,8 @@ void render()
     for(i32 i = 0; i < BIRD_COUNT; ++i) {
         Line& l = dirLine[i];
         Vec2 dir = { cos(birdRot[i]) * 100.0f, sin(birdRot[i]) * 100.0f };
-        l.p1 = birdPos[i];
-        l.p2 = vec2Add(&birdPos[i], &dir);
+        l.p1 = birdPosition(i);
+        l.p2 = vec2Add(&l.p1, &dir);
         l.c1 = {255, 0, 0, 255};
         l.c2 = {255, 0, 0, 255};
     }
@@ -1305,8 +1870,8 @@ void render()
     drawSpriteColorBatch(tex_apple, appleTf, birdColor, BIRD_COUNT);
 
     /*Transform pr;
-    pr.pos.x = birdPos[0].x + cosf(birdRot[0] -PI * 0.5f +PI * 0.15f) * 40.f;
-    pr.pos.y = birdPos[0].y + sinf(birdRot[0] -PI * 0.5f +PI * 0.15f) * 40.f;
+    pr.pos.x = birdPosX[0] + cosf(birdRot[0] -PI * 0.5f +PI * 0.15f) * 40.f;
+    pr.pos.y = birdPosY[0] + sinf(birdRot[0] -PI * 0.5f +PI * 0.15f) * 40.f;
     pr.size.x = 10;
     pr.size.y = 10;
     pr.center.x = 5;
@@ -1318,7 +1883,7 @@ void render()
 
     if(dbgHightlightBird) {
         f32 halfSize = 50;
-        Vec2 hlPos = birdPos[dbgViewerBirdId];
+        Vec2 hlPos = birdPosition(dbgViewerBirdId);
         Quad hlQuad = quadOneColor(hlPos.x - halfSize, hlPos.x + halfSize,
                                    hlPos.y - halfSize, hlPos.y + halfSize,
                                    {255, 0, 0, 128});
@@ -1327,22 +1892,77 @@ void render()
 
     imguiRender();
 }
+#endif
 
 void cleanup()
 {
+#ifndef HEADLESS
     window.cleanup();
+#endif
+    snapshotWait(&snapshotWriter);
 
 #ifdef NNTYPE_RNN
     rnnDealloc(curGenNN);
     rnnDealloc(nextGenNN);
+    rnnDealloc(episodeNN);
 #elif defined(NNTYPE_NN)
     nnDealloc(curGenNN);
     nnDealloc(nextGenNN);
+    nnDealloc(episodeNN);
 #endif
 }
 
 };
 
+#ifdef HEADLESS
+// usage: burds_app_headless [generation count] [thread count] [episodes per genome]
+i32 main(i32 argc, char** argv)
+{
+    LOG("Burds [NN] headless");
+
+    randSetSeed(randDefaultSeed());
+    timeInit();
+    traceStartFromEnv();
+
+    // too big for the stack with large populations
+    static App app;
+
+    // burds_app_headless physbench [iterations]
+    if(argc > 1 && strcmp(argv[1], "physbench") == 0) {
+#ifdef __AVX2__
+        app.benchPhysics(argc > 2 ? atoi(argv[2]) : 1000);
+        return 0;
+#else
+        LOG("physbench needs AVX2");
+        return 1;
+#endif
+    }
+
+    i32 maxGenerations = 0;
+    if(argc > 1) {
+        maxGenerations = atoi(argv[1]);
+    }
+
+    i32 threadCount = 0;
+    if(argc > 2) {
+        threadCount = atoi(argv[2]);
+    }
+    threadPoolInit(threadCount);
+
+    if(argc > 3) {
+        app.nextEpisodeCount = clamp(atoi(argv[3]), 1, EPISODE_MAX_COUNT);
+    }
+
+    if(!app.init()) {
+        return 1;
+    }
+
+    app.runHeadless(maxGenerations);
+    app.cleanup();
+    threadPoolShutdown();
+    return 0;
+}
+#else
 #ifdef _WIN32
 int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 #else
@@ -1351,8 +1971,9 @@ i32 main()
 {
     LOG("Burds [NEAT]");
 
-    randSetSeed(time(NULL));
+    randSetSeed(randDefaultSeed());
     timeInit();
+    traceStartFromEnv();
 
     /*for(i32 i = 0; i < 1000; ++i) {
         LOG("%g", randf64(0.0, 2.4578));
@@ -1367,7 +1988,10 @@ i32 main()
         return 1;
     }
 
-    App app;
+    threadPoolInit(0);
+
+    // too big for the stack with large populations
+    static App app;
 
     if(!app.init()) {
         return 1;
@@ -1375,7 +1999,9 @@ i32 main()
 
     app.run();
     app.cleanup();
+    threadPoolShutdown();
 
     SDL_Quit();
     return 0;
 }
+#endif
@@ -1,19 +1,25 @@
 #include "base.h"
+#ifndef HEADLESS
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
 #include <gl3w.h>
+#endif
 #include <stdlib.h>
 #include <float.h>
+#include <emmintrin.h>
 #include <assert.h>
 
-#include "window.h"
 #include "sprite.h"
 #include "neat.h"
+#ifndef HEADLESS
+#include "window.h"
 #include "neat_imgui.h"
+#include "profile_imgui.h"
 #include "imgui/imgui.h"
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include "imgui/imgui_internal.h"
 #include "imgui/imgui_sdl2_setup.h"
+#endif
 
 #define WINDOW_WIDTH 1600
 #define WINDOW_HEIGHT 900
@@ -60,9 +66,72 @@ struct BirdInput
     u8 left, right, flap, brake;
 };
 
+// two populations take turns: one is evaluated while the other one evolves in the
+// background on the thread pool, so generation changes don't stall the simulation
+#define POPULATION_COUNT 2
+
+struct Population
+{
+    Genome* curGen[BIRD_COUNT];
+    Genome* nextGen[BIRD_COUNT];
+    NeatNN* nn[BIRD_COUNT] = {0};
+    NeatSpeciation spec;
+    f64 fitness[BIRD_COUNT];
+};
+
+// snapshot sections of the app, next to the two populations (index 0: evaluated next,
+// index 1: evaluated and waiting for its evolution)
+#define APP_SNAPSHOT_KIND 0x4e445242 // "BRDN"
+#define APP_SNAPSHOT_STATE (SNAPSHOT_SECTION_USER + 0)
+#define APP_SNAPSHOT_PAST_STATS (SNAPSHOT_SECTION_USER + 1)
+#define APP_SNAPSHOT_FITNESS (SNAPSHOT_SECTION_USER + 2)
+
+#ifdef HEADLESS
+#define ISLAND_MAX_COUNT 64
+#define ISLAND_MIGRANT_MAX_COUNT 64
+
+struct IslandBarrier
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    i32 threadCount = 0;
+    i32 waitCount = 0;
+    u32 phase = 0;
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        const u32 curPhase = phase;
+        if(++waitCount == threadCount) {
+            waitCount = 0;
+            phase++;
+            cv.notify_all();
+            return;
+        }
+        cv.wait(lock, [&] { return phase != curPhase; });
+    }
+};
+
+// island model: each island is a whole population running on its own thread (islands block on
+// the barrier, so they stay off the pool), only their evolutions are scheduled on the pool
+// every migrationInterval generations the best genomes of an island replace the worst
+// genomes of the next island on the ring, islands only wait on each other at that point
+struct IslandRing
+{
+    i32 islandCount = 1;
+    i32 migrationInterval = 10;
+    i32 migrantCount = 4;
+    IslandBarrier barrier;
+    Genome* migrants; // [islandCount * migrantCount], written by their source island
+    f64 migrantFitness[ISLAND_MAX_COUNT * ISLAND_MIGRANT_MAX_COUNT];
+};
+#endif
+
 struct App {
 
+#ifndef HEADLESS
 AppWindow window;
+#endif
 
 i32 tex_birdBody;
 i32 tex_birdWing;
@@ -109,11 +178,20 @@ Transform appleTf[BIRD_COUNT];
 
 Line targetLine[BIRD_COUNT];
 
-Genome* birdCurGen[BIRD_COUNT];
-Genome* birdNextGen[BIRD_COUNT];
-NeatNN* birdNN[BIRD_COUNT] = {0};
+Population population[POPULATION_COUNT];
+i32 evalPopId = 0; // population being evaluated
+i32 idlePopId = 1; // evolved and kept on the main thread, -1 when handed to the evolution
+// the population being evaluated
+Genome** birdCurGen;
+NeatNN** birdNN;
+NeatSpeciation* neatSpec;
 NeatEvolutionParams evolParam;
-NeatSpeciation neatSpec;
+
+// neatEvolve, then the nets and the node positions are rebuilt in parallel
+// evolutions share the innovation history so only one runs at a time
+TaskGraph evolveGraph;
+i32 evolvingPopId = -1;
+RandStream evolveRandStream; // swapped in by the evolution on whichever worker runs it
 
 i32 birdAppleEatenCount[BIRD_COUNT];
 f32 birdDistToNextApple[BIRD_COUNT];
@@ -142,11 +220,31 @@ struct GenerationStats {
     f64 avgFitness = 0.0;
 };
 
+i32 islandId = 0;
+#ifdef HEADLESS
+IslandRing* islandRing = nullptr;
+#endif
+
 i32 generationNumber = 0;
 GenerationStats curGenStats;
 GenerationStats lastGenStats;
 GenerationStats pastGenStats[STATS_HISTORY_COUNT];
 
+struct SnapshotState {
+    i32 generationNumber;
+    GenerationStats curGenStats;
+    GenerationStats lastGenStats;
+};
+
+SnapshotWriter snapshotWriter;
+char snapshotPath[256];
+i32 snapshotInterval = 0; // generations, 0: no snapshots
+
+char exportCPath[256];
+bool exportCEnabled = false;
+f64 exportCBestFitness = 0.0; // of the last champion exported
+i32 exportCGeneration = -1;
+
 void resetBirdColors()
 {
     const u32 colorMax = 0xFF;
@@ -362,15 +460,104 @@ void resetSimulation()
     lastGenStats = {};
     mem_zero(pastGenStats);
 
-    neatSpec = {};
-    neatGenomeInit(birdCurGen, BIRD_COUNT, 6, 4, evolParam, &neatSpec); // INPUTS: 6, OUPUTS: 4
-    neatNnDealloc(birdNN);
-    neatGenomeAllocMakeNN(birdCurGen, BIRD_COUNT, birdNN);
-    neatGenomeComputeNodePos(birdCurGen, BIRD_COUNT);
+    waitEvolution();
+
+    for(i32 p = 0; p < POPULATION_COUNT; ++p) {
+        Population& pop = population[p];
+        pop.spec = {};
+        neatGenomeInit(pop.curGen, BIRD_COUNT, 6, 4, evolParam, &pop.spec); // INPUTS: 6, OUPUTS: 4
+        neatNnDealloc(pop.nn);
+        neatGenomeAllocMakeNN(pop.curGen, BIRD_COUNT, pop.nn);
+        neatGenomeComputeNodePos(pop.curGen, BIRD_COUNT);
+    }
+
+    setEvalPopulation(0);
+    idlePopId = 1;
+}
+
+void setEvalPopulation(i32 popId)
+{
+    evalPopId = popId;
+    birdCurGen = population[popId].curGen;
+    birdNN = population[popId].nn;
+    neatSpec = &population[popId].spec;
+}
+
+// evolveGraph nodes, on the thread pool
+void evolvePopulation()
+{
+    PROFILE_ZONE("evolve");
+    RandStreamScope streamScope(&evolveRandStream);
+    Population& pop = population[evolvingPopId];
+    neatEvolve(pop.curGen, pop.nextGen, pop.fitness, BIRD_COUNT, &pop.spec, evolParam, islandId == 0);
+}
+
+void makePopulationNNs()
+{
+    Population& pop = population[evolvingPopId];
+    neatNnDealloc(pop.nn);
+    neatGenomeAllocMakeNN(pop.curGen, BIRD_COUNT, pop.nn);
+}
+
+void computePopulationNodePos()
+{
+    Population& pop = population[evolvingPopId];
+    neatGenomeComputeNodePos(pop.curGen, BIRD_COUNT);
+}
+
+void initEvolveGraph()
+{
+    const i32 evolveNode = taskGraphAddRaw(&evolveGraph, 1, 1, [](void* userData, i32 start, i32 end, i32 chunkId) {
+        ((App*)userData)->evolvePopulation();
+    }, this);
+    const i32 makeNNsNode = taskGraphAddRaw(&evolveGraph, 1, 1, [](void* userData, i32 start, i32 end, i32 chunkId) {
+        ((App*)userData)->makePopulationNNs();
+    }, this);
+    const i32 nodePosNode = taskGraphAddRaw(&evolveGraph, 1, 1, [](void* userData, i32 start, i32 end, i32 chunkId) {
+        ((App*)userData)->computePopulationNodePos();
+    }, this);
+    taskGraphDepend(&evolveGraph, makeNNsNode, evolveNode);
+    taskGraphDepend(&evolveGraph, nodePosNode, evolveNode);
+
+    randStreamSeed(&evolveRandStream, randGetSeed(), RAND_STREAM_USER + islandId * 2 + 1);
+}
+
+void startEvolution(i32 popId)
+{
+    assert(evolvingPopId == -1);
+    evolvingPopId = popId;
+    taskGraphRunBackground(&evolveGraph);
+}
+
+// blocks until the next population is evolved, this only happens when evolution takes
+// longer than a whole generation
+i32 takeEvolvedPopulation()
+{
+    PROFILE_ZONE("evolveWait");
+    if(idlePopId != -1) {
+        const i32 popId = idlePopId;
+        idlePopId = -1;
+        return popId;
+    }
+
+    assert(evolvingPopId != -1);
+    taskGraphWait(&evolveGraph);
+    const i32 popId = evolvingPopId;
+    evolvingPopId = -1;
+    return popId;
+}
+
+// get the evolving population back
+void waitEvolution()
+{
+    if(evolvingPopId != -1) {
+        idlePopId = takeEvolvedPopulation();
+    }
 }
 
 bool init()
 {
+#ifndef HEADLESS
     if(!window.init("Burds [NEAT]", "burds_neat_imgui.ini")) {
         return false;
     }
@@ -401,6 +588,7 @@ bool init()
        ) {
         return false;
     }
+#endif
 
     timeScale = 1.0f;
 
@@ -412,13 +600,202 @@ bool init()
     evolParam.mutateAddNode = 0.1;
     evolParam.mutateWeightStep = 0.5;
 
-    neatGenomeAlloc(birdCurGen, BIRD_COUNT);
-    neatGenomeAlloc(birdNextGen, BIRD_COUNT);
+    for(i32 p = 0; p < POPULATION_COUNT; ++p) {
+        neatGenomeAlloc(population[p].curGen, BIRD_COUNT);
+        neatGenomeAlloc(population[p].nextGen, BIRD_COUNT);
+    }
     resetSimulation();
 
+    initEvolveGraph();
+
+    if(snapshotConfigFromEnv(snapshotPath, sizeof(snapshotPath), &snapshotInterval)) {
+#ifdef HEADLESS
+        if(islandRing) {
+            const i32 len = strlen(snapshotPath);
+            snprintf(snapshotPath + len, sizeof(snapshotPath) - len, ".island%d", islandId);
+        }
+#endif
+        loadSnapshot();
+    }
+
+    char exportCSuffix[32] = "";
+#ifdef HEADLESS
+    if(islandRing) snprintf(exportCSuffix, sizeof(exportCSuffix), "_island%d", islandId);
+#endif
+    exportCEnabled = exportCConfigFromEnv(exportCPath, sizeof(exportCPath), exportCSuffix);
+
     return true;
 }
 
+// both populations are idle between two generations, that's when they are written
+void writeSnapshot(i32 evaluatedPopId, i32 nextPopId)
+{
+    PROFILE_ZONE("snapshot");
+    snapshotBegin(&snapshotWriter, APP_SNAPSHOT_KIND);
+
+    const SnapshotState state = { generationNumber, curGenStats, lastGenStats };
+    snapshotAdd(&snapshotWriter, APP_SNAPSHOT_STATE, 0, &state, sizeof(state), 1);
+    snapshotAdd(&snapshotWriter, APP_SNAPSHOT_PAST_STATS, 0, pastGenStats, sizeof(pastGenStats[0]),
+                STATS_HISTORY_COUNT);
+
+    Population& evaluated = population[evaluatedPopId];
+    neatSnapshotAdd(&snapshotWriter, 0, population[nextPopId].curGen, BIRD_COUNT,
+                    population[nextPopId].spec);
+    neatSnapshotAdd(&snapshotWriter, 1, evaluated.curGen, BIRD_COUNT, evaluated.spec);
+    snapshotAdd(&snapshotWriter, APP_SNAPSHOT_FITNESS, 1, evaluated.fitness,
+                sizeof(evaluated.fitness[0]), BIRD_COUNT);
+
+    snapshotWriteAsync(&snapshotWriter, snapshotPath);
+}
+
+// picks up where writeSnapshot() left, after resetSimulation()
+bool loadSnapshot()
+{
+    Snapshot snap;
+    if(!snapshotOpen(&snap, snapshotPath, APP_SNAPSHOT_KIND)) {
+        return false;
+    }
+
+    const timept t0 = timeGet();
+    const SnapshotState* state = snapshotArrExact<SnapshotState>(snap, APP_SNAPSHOT_STATE, 0, 1);
+    const GenerationStats* pastStats = snapshotArrExact<GenerationStats>(snap, APP_SNAPSHOT_PAST_STATS,
+                                                                         0, STATS_HISTORY_COUNT);
+    const f64* fitness = snapshotArrExact<f64>(snap, APP_SNAPSHOT_FITNESS, 1, BIRD_COUNT);
+
+    bool restored = state && pastStats && fitness;
+    for(i32 p = 0; p < POPULATION_COUNT && restored; ++p) {
+        restored = neatSnapshotRestore(snap, p, population[p].curGen, BIRD_COUNT, &population[p].spec);
+    }
+    if(!restored) {
+        LOG("ERROR: snapshot> could not resume from %s, starting over", snapshotPath);
+        snapshotClose(&snap);
+        resetSimulation();
+        return false;
+    }
+
+    generationNumber = state->generationNumber;
+    curGenStats = state->curGenStats;
+    lastGenStats = state->lastGenStats;
+    memmove(pastGenStats, pastStats, sizeof(pastGenStats));
+    memmove(population[1].fitness, fitness, sizeof(population[1].fitness));
+    snapshotClose(&snap);
+
+    for(i32 p = 0; p < POPULATION_COUNT; ++p) {
+        Population& pop = population[p];
+        neatNnDealloc(pop.nn);
+        neatGenomeAllocMakeNN(pop.curGen, BIRD_COUNT, pop.nn);
+        neatGenomeComputeNodePos(pop.curGen, BIRD_COUNT);
+    }
+
+    setEvalPopulation(0);
+    idlePopId = -1;
+    startEvolution(1);
+
+    LOG("snapshot> resumed from %s at generation %d (%.3fms)", snapshotPath, generationNumber,
+        timeToMicrosec(timeGet() - t0) / 1000.0);
+    return true;
+}
+
+struct FitnessPair
+{
+    i32 id;
+    f64 fitness;
+};
+
+#ifdef HEADLESS
+// step the simulation as fast as possible, no window or rendering
+// maxGenerations <= 0 runs forever
+void runHeadless(i32 maxGenerations)
+{
+    const i64 reportIntervalMicro = 5000000;
+    const timept startTime = timeGet();
+    timept reportTime = startTime;
+    i64 stepCount = 0;
+    i64 reportStepCount = 0;
+    i32 reportGenNumber = generationNumber;
+
+    if(islandId == 0) {
+        profileResetTotals();
+    }
+
+    while(maxGenerations <= 0 || generationNumber <= maxGenerations) {
+        step();
+        stepCount++;
+
+        // islands advance in lockstep, the first one reports for all
+        // (its frames collect the zones of every island and of the pool)
+        if(islandId == 0) {
+            profileFrameEnd();
+        }
+        const i64 reportDelta = timeToMicrosec(timeGet() - reportTime);
+        if(islandId == 0 && reportDelta >= reportIntervalMicro) {
+            const f64 sec = reportDelta / 1000000.0;
+            LOG("headless> gen=%d steps/s=%.0f gen/s=%.3f", generationNumber,
+                (stepCount - reportStepCount) / sec, (generationNumber - reportGenNumber) / sec);
+            profileLogTotals("headless>");
+            profileResetTotals();
+            reportTime = timeGet();
+            reportStepCount = stepCount;
+            reportGenNumber = generationNumber;
+        }
+    }
+
+    const f64 totalSec = timeToMicrosec(timeGet() - startTime) / 1000000.0;
+    if(islandRing) {
+        LOG("headless> island %d: last generation maxFitness=%.5f avg=%.5f", islandId,
+            lastGenStats.maxFitness, lastGenStats.avgFitness);
+        return;
+    }
+
+    LOG("headless> done: %d generations, %lld steps in %.2fs (steps/s=%.0f gen/s=%.3f)",
+        generationNumber - 1, (long long)stepCount, totalSec,
+        stepCount / totalSec, (generationNumber - 1) / totalSec);
+}
+
+// send our best genomes to the next island, take in the best genomes of the previous one
+void migrate()
+{
+    IslandRing& ring = *islandRing;
+    const i32 migrantCount = ring.migrantCount;
+
+    FitnessPair fpair[BIRD_COUNT];
+    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+        fpair[i] = { i, birdFitness[i] };
+    }
+    qsort(fpair, BIRD_COUNT, sizeof(FitnessPair), [](const void* a, const void* b) {
+        const f64 fa = ((const FitnessPair*)a)->fitness;
+        const f64 fb = ((const FitnessPair*)b)->fitness;
+        if(fa > fb) return -1;
+        if(fa < fb) return 1;
+        return 0;
+    });
+
+    Genome* outbox = &ring.migrants[islandId * migrantCount];
+    f64* outboxFitness = &ring.migrantFitness[islandId * migrantCount];
+    for(i32 m = 0; m < migrantCount; ++m) {
+        outbox[m] = *birdCurGen[fpair[m].id];
+        outboxFitness[m] = fpair[m].fitness;
+    }
+
+    ring.barrier.wait();
+
+    const i32 srcIsland = (islandId + ring.islandCount - 1) % ring.islandCount;
+    const Genome* inbox = &ring.migrants[srcIsland * migrantCount];
+    const f64* inboxFitness = &ring.migrantFitness[srcIsland * migrantCount];
+    for(i32 m = 0; m < migrantCount; ++m) {
+        // species ids are local to each island, the migrant joins the species of the
+        // genome it replaces until the next speciation pass
+        const i32 id = fpair[BIRD_COUNT - 1 - m].id;
+        const i32 species = birdCurGen[id]->species;
+        *birdCurGen[id] = inbox[m];
+        birdCurGen[id]->species = species;
+        birdFitness[id] = inboxFitness[m];
+    }
+
+    // the outboxes get overwritten at the next migration
+    ring.barrier.wait();
+}
+#else
 void run()
 {
     while(window.running) {
@@ -433,6 +810,7 @@ void run()
         newFrame();
         render();
         window.swap();
+        profileFrameEnd();
 
         const i64 frameDtMicro = FRAME_DT/timeScale * 1000000;
         while(((frameDtMicro - timeToMicrosec(timeGet() - t0)) / 1000) > 1) {
@@ -657,7 +1035,7 @@ void ui_generationViewer()
 void ui_speciation()
 {
     ImVec4 subPopColors[SUBPOP_MAX_COUNT];
-    const i32 speciesCount = neatSpec.speciesCount;
+    const i32 speciesCount = neatSpec->speciesCount;
     for(i32 i = 0; i < speciesCount; ++i) {
         Color3 sc = speciesColor[i];
         subPopColors[i] = ImVec4(sc.r/255.f, sc.g/255.f, sc.b/255.f, 1.f);
@@ -665,21 +1043,21 @@ void ui_speciation()
 
     i32 maxPopCount = 0;
     for(i32 i = 0; i < speciesCount; ++i) {
-        maxPopCount = max(neatSpec.speciesPopCount[i], maxPopCount);
+        maxPopCount = max(neatSpec->speciesPopCount[i], maxPopCount);
     }
 
     ImGui::Begin("Speciation");
 
     for(i32 i = 0; i < speciesCount; ++i) {
-        if(neatSpec.speciesPopCount[i] == 0) continue;
+        if(neatSpec->speciesPopCount[i] == 0) continue;
 
         ImGui::PushStyleColor(ImGuiCol_PlotHistogram, subPopColors[i]);
 
         char buff[64];
-        sprintf(buff, "%d", neatSpec.speciesPopCount[i]);
-        ImGui::ProgressBar(neatSpec.speciesPopCount[i]/(f32)maxPopCount, ImVec2(100,0), buff);
+        sprintf(buff, "%d", neatSpec->speciesPopCount[i]);
+        ImGui::ProgressBar(neatSpec->speciesPopCount[i]/(f32)maxPopCount, ImVec2(100,0), buff);
         ImGui::SameLine();
-        ImGui::TextColored(subPopColors[i], "%g | %d", neatSpec.maxFitness[i], neatSpec.stagnation[i]);
+        ImGui::TextColored(subPopColors[i], "%g | %d", neatSpec->maxFitness[i], neatSpec->stagnation[i]);
 
         ImGui::PopStyleColor(1);
     }
@@ -724,21 +1102,33 @@ void doUI()
     ui_birdViewer();
     ui_generationViewer();
     ui_speciation();
+    ImGui_ProfileWindow();
 }
+#endif
 
 
 void updateNNs()
 {
-    NeatNN* aliveNN[BIRD_COUNT];
+    PROFILE_ZONE("updateNNs");
+    // birds don't interact, each chunk runs its own slice through the nets
+    parallelFor(BIRD_COUNT, [this](i32 start, i32 end, i32 chunkId) {
+        updateNNsRange(start, end);
+    });
+}
+
+void updateNNsRange(const i32 start, const i32 end)
+{
+    NeatNN** aliveNN = scratchArr<NeatNN*>(end - start);
     i32 aliveCount = 0;
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 i = start; i < end; ++i) {
         if(birdDead[i]) continue;
         aliveNN[aliveCount++] = birdNN[i];
     }
 
     // setup neural net inputs
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    PROFILE_SCOPE(inputZone, "nnInputs");
+    for(i32 i = start; i < end; ++i) {
         if(birdDead[i]) continue;
         Vec2 applePos = applePosList[birdApplePositionId[i]];
         f64 appleOffsetX = applePos.x - birdPos[i].x;
@@ -765,14 +1155,18 @@ void updateNNs()
 
         birdNN[i]->setInputs(inputs, arr_count(inputs));
     }
+    inputZone.stop();
 
-    neatNnPropagate(aliveNN, aliveCount);
+    {
+        PROFILE_ZONE("propagate");
+        neatNnPropagate(aliveNN, aliveCount);
+    }
 
     // get neural net output
     const i32 firstOutputId = birdCurGen[0]->inputNodeCount;
     const i32 outputCount = birdCurGen[0]->outputNodeCount;
 
-    for(i32 i = 0; i < BIRD_COUNT; ++i) {
+    for(i32 i = start; i < end; ++i) {
         if(birdDead[i]) continue;
         f64 out[4];
         memmove(out, &birdNN[i]->nodeValues[firstOutputId], sizeof(out[0]) * outputCount);
@@ -797,6 +1191,7 @@ void updateNNs()
 
 void updateMechanics()
 {
+    PROFILE_ZONE("mechanics");
     // wing anim time
     for(i32 i = 0; i < BIRD_COUNT; ++i) {
         if(birdDead[i]) continue;
@@ -902,6 +1297,7 @@ void updateMechanics()
 
 void updatePhysics()
 {
+    PROFILE_ZONE("physics");
 #if 0
     // apply bird input
     for(i32 i = 0; i < BIRD_COUNT; ++i) {
@@ -1041,6 +1437,7 @@ void updatePhysics()
     }
 }
 
+#ifndef HEADLESS
 void updateCamera()
 {
     if(mouseRightButDown) {
@@ -1051,12 +1448,26 @@ void updateCamera()
     }
     setView(viewX, viewY, WINDOW_WIDTH*viewZoom, WINDOW_HEIGHT*viewZoom);
 }
+#endif
 
-struct FitnessPair
+// the best genome of the evaluated population is written out as C when it beats the last one
+// exported, before the population goes to the evolution
+void exportChampion(const Population& evaluated)
 {
-    i32 id;
-    f64 fitness;
-};
+    i32 best = 0;
+    for(i32 i = 1; i < BIRD_COUNT; ++i) {
+        if(evaluated.fitness[i] > evaluated.fitness[best]) best = i;
+    }
+    if(exportCGeneration >= 0 && evaluated.fitness[best] <= exportCBestFitness) return;
+
+    PROFILE_ZONE("exportC");
+    if(neatExportC(exportCPath, evaluated.curGen[best])) {
+        exportCBestFitness = evaluated.fitness[best];
+        exportCGeneration = generationNumber;
+        LOG("export> [%d] champion of generation #%d (fitness=%.5f)", islandId, generationNumber,
+            exportCBestFitness);
+    }
+}
 
 void nextGeneration()
 {
@@ -1067,19 +1478,39 @@ void nextGeneration()
     curGenStats = {};
     curGenStats.number = generationNumber++;
 
-    LOG("#%d maxFitness=%.5f avg=%.5f", generationNumber,
+    LOG("#%d [%d] maxFitness=%.5f avg=%.5f", generationNumber, islandId,
         lastGenStats.maxFitness, lastGenStats.avgFitness);
 
-    neatEvolve(birdCurGen, birdNextGen, birdFitness, BIRD_COUNT, &neatSpec, evolParam, true);
-
-    neatNnDealloc(birdNN);
-    neatGenomeAllocMakeNN(birdCurGen, BIRD_COUNT, birdNN);
+#ifdef HEADLESS
+    if(islandRing && generationNumber % islandRing->migrationInterval == 0) {
+        migrate();
+    }
+#endif
 
-    neatGenomeComputeNodePos(birdCurGen, BIRD_COUNT);
+    // hand the population over to the evolution and evaluate the other one meanwhile
+    memmove(population[evalPopId].fitness, birdFitness, sizeof(birdFitness));
+    if(exportCEnabled) {
+        exportChampion(population[evalPopId]);
+    }
+    const i32 nextPopId = takeEvolvedPopulation();
+    if(snapshotInterval > 0 && generationNumber % snapshotInterval == 0) {
+        writeSnapshot(evalPopId, nextPopId);
+    }
+    startEvolution(evalPopId);
+    setEvalPopulation(nextPopId);
 
     resetBirds();
 }
 
+// one simulation step, shared by the window and headless loops
+void step()
+{
+    updateNNs();
+    updatePhysics();
+    updateMechanics();
+}
+
+#ifndef HEADLESS
 void newFrame()
 {
     if(dbgAutoSelectBest) {
@@ -1100,10 +1531,7 @@ void newFrame()
     }
 
     updateCamera();
-    updateNNs();
-
-    updatePhysics();
-    updateMechanics();
+    step();
 
     // update clouds
     const i32 cloud1Count2 = cloud1Count;
@@ -1188,6 +1616,7 @@ void newFrame()
 
 void render()
 {
+    PROFILE_ZONE("render");
     glClear(GL_COLOR_BUFFER_BIT);
 
     // sky
@@ -1285,17 +1714,124 @@ void render()
 
     imguiRender();
 }
+#endif
 
 void cleanup()
 {
+#ifndef HEADLESS
     window.cleanup();
-    neatGenomeDealloc(birdCurGen);
-    neatGenomeDealloc(birdNextGen);
-    neatNnDealloc(birdNN);
+#endif
+    waitEvolution();
+    snapshotWait(&snapshotWriter);
+
+    for(i32 p = 0; p < POPULATION_COUNT; ++p) {
+        neatGenomeDealloc(population[p].curGen);
+        neatGenomeDealloc(population[p].nextGen);
+        neatNnDealloc(population[p].nn);
+    }
 }
 
 };
 
+#ifdef HEADLESS
+static i32 runIslands(i32 maxGenerations, IslandRing* ring)
+{
+    const i32 islandCount = ring->islandCount;
+    App* islands[ISLAND_MAX_COUNT];
+
+    // init on this thread, neatGenomeInit resets the shared innovation number
+    for(i32 i = 0; i < islandCount; ++i) {
+        islands[i] = new App;
+        islands[i]->islandId = i;
+        islands[i]->islandRing = ring;
+        if(!islands[i]->init()) {
+            return 1;
+        }
+    }
+
+    ring->migrants = new Genome[islandCount * ring->migrantCount];
+    ring->barrier.threadCount = islandCount;
+
+    LOG("headless> %d islands, migrating %d genomes every %d generations", islandCount,
+        ring->migrantCount, ring->migrationInterval);
+
+    const timept startTime = timeGet();
+
+    std::thread threads[ISLAND_MAX_COUNT];
+    for(i32 i = 0; i < islandCount; ++i) {
+        threads[i] = std::thread([=] {
+            randSeedThread(RAND_STREAM_USER + i * 2);
+            islands[i]->runHeadless(maxGenerations);
+        });
+    }
+
+    for(i32 i = 0; i < islandCount; ++i) {
+        threads[i].join();
+    }
+
+    const f64 totalSec = timeToMicrosec(timeGet() - startTime) / 1000000.0;
+    LOG("headless> done: %d islands x %d generations in %.2fs (gen/s=%.3f)", islandCount,
+        islands[0]->generationNumber - 1, totalSec,
+        (islands[0]->generationNumber - 1) * islandCount / totalSec);
+
+    for(i32 i = 0; i < islandCount; ++i) {
+        islands[i]->cleanup();
+        delete islands[i];
+    }
+    delete[] ring->migrants;
+    return 0;
+}
+
+// usage: burds_neat_headless [generation count] [island count] [migration interval] [migrant count]
+//                            [thread count]
+i32 main(i32 argc, char** argv)
+{
+    LOG("Burds [NEAT] headless");
+
+    randSetSeed(randDefaultSeed());
+    timeInit();
+    traceStartFromEnv();
+
+    i32 maxGenerations = 0;
+    if(argc > 1) {
+        maxGenerations = atoi(argv[1]);
+    }
+
+    IslandRing ring;
+    if(argc > 2) {
+        ring.islandCount = clamp(atoi(argv[2]), 1, ISLAND_MAX_COUNT);
+    }
+    if(argc > 3) {
+        ring.migrationInterval = max(atoi(argv[3]), 1);
+    }
+    if(argc > 4) {
+        ring.migrantCount = clamp(atoi(argv[4]), 0, ISLAND_MIGRANT_MAX_COUNT);
+    }
+
+    i32 threadCount = 0;
+    if(argc > 5) {
+        threadCount = atoi(argv[5]);
+    }
+    threadPoolInit(threadCount);
+
+    if(ring.islandCount > 1) {
+        const i32 ret = runIslands(maxGenerations, &ring);
+        threadPoolShutdown();
+        return ret;
+    }
+
+    App app;
+
+    if(!app.init()) {
+        return 1;
+    }
+
+    app.runHeadless(maxGenerations);
+    app.cleanup();
+    threadPoolShutdown();
+    return 0;
+}
+#else
 #ifdef _WIN32
 int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 #else
@@ -1304,8 +1840,9 @@ i32 main()
 {
     LOG("Burds [NEAT]");
 
-    randSetSeed(time(NULL));
+    randSetSeed(randDefaultSeed());
     timeInit();
+    traceStartFromEnv();
 
     /*for(i32 i = 0; i < 1000; ++i) {
         LOG("%g", randf64(0.0, 2.4578));
@@ -1320,6 +1857,8 @@ i32 main()
         return 1;
     }
 
+    threadPoolInit(0);
+
     App app;
 
     if(!app.init()) {
@@ -1328,7 +1867,9 @@ i32 main()
 
     app.run();
     app.cleanup();
+    threadPoolShutdown();
 
     SDL_Quit();
     return 0;
 }
+#endif
@@ -0,0 +1,234 @@
+#include "export_c.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void exportCBaseName(char* out, i32 outSize, const char* path)
+{
+    const char* base = path;
+    for(const char* c = path; *c; ++c) {
+        if(*c == '/' || *c == '\\') base = c + 1;
+    }
+    snprintf(out, outSize, "%s", base);
+}
+
+bool exportCBegin(CExport* ex, const char* path, const char* description, i32 inputCount,
+                  i32 outputCount, i32 stateCount, bool relu)
+{
+    snprintf(ex->path, sizeof(ex->path), "%s", path);
+    ex->inputCount = inputCount;
+    ex->outputCount = outputCount;
+    ex->stateCount = stateCount;
+
+    // function name: file name without extension, made a valid C identifier
+    char base[256];
+    exportCBaseName(base, sizeof(base), path);
+    char* ext = strrchr(base, '.');
+    if(ext) *ext = 0;
+    i32 len = 0;
+    if(base[0] >= '0' && base[0] <= '9') ex->name[len++] = '_';
+    for(const char* c = base; *c && len < (i32)sizeof(ex->name) - 1; ++c) {
+        const bool alnum = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+                           (*c >= '0' && *c <= '9');
+        ex->name[len++] = alnum ? *c : '_';
+    }
+    ex->name[len] = 0;
+    if(len == 0) snprintf(ex->name, sizeof(ex->name), "net");
+    for(i32 i = 0; i < (i32)sizeof(ex->name); ++i) {
+        const char c = ex->name[i];
+        ex->upperName[i] = (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+    }
+
+    ex->file = fopen(path, "wb");
+    if(!ex->file) {
+        LOG("ERROR: export> could not open %s", path);
+        return false;
+    }
+
+    FILE* f = ex->file;
+    fprintf(f, "// %s: %s\n", ex->name, description);
+    fprintf(f, "// generated, topology and weights are baked in\n");
+    fprintf(f, "#include <math.h>\n\n");
+    fprintf(f, "#define %s_INPUT_COUNT %d\n", ex->upperName, inputCount);
+    fprintf(f, "#define %s_OUTPUT_COUNT %d\n", ex->upperName, outputCount);
+    fprintf(f, "#define %s_STATE_COUNT %d\n\n", ex->upperName, stateCount);
+
+    fprintf(f, "static double %s_act(double x)\n{\n", ex->name);
+    if(relu) {
+        fprintf(f, "    if(x < 0.0) return 0.0;\n");
+        fprintf(f, "    if(x > 10000000.0) return 10000000.0;\n");
+        fprintf(f, "    return x;\n");
+    }
+    else {
+        fprintf(f, "    if(x < -10.0) x = -10.0;\n");
+        fprintf(f, "    if(x > 10.0) x = 10.0;\n");
+        fprintf(f, "    return tanh(x);\n");
+    }
+    fprintf(f, "}\n\n");
+    return true;
+}
+
+void exportCFunctionBegin(CExport* ex)
+{
+    if(ex->stateCount > 0) {
+        fprintf(ex->file, "// state has to be zeroed before the first call\n");
+        fprintf(ex->file, "void %s(const double* in, double* out, double* state)\n{\n", ex->name);
+    }
+    else {
+        fprintf(ex->file, "void %s(const double* in, double* out)\n{\n", ex->name);
+    }
+}
+
+void exportCFunctionEnd(CExport* ex)
+{
+    fprintf(ex->file, "}\n");
+}
+
+// round-trips exactly, always reads as a double
+static void exportCWriteF64(FILE* f, f64 val)
+{
+    char str[32];
+    snprintf(str, sizeof(str), "%.17g", val);
+    fprintf(f, strpbrk(str, ".eni") ? "%s" : "%s.0", str);
+}
+
+void exportCSumBegin(CExport* ex, const char* lhs, f64 bias)
+{
+    fprintf(ex->file, "    %s = %s_act(", lhs, ex->name);
+    exportCWriteF64(ex->file, bias);
+}
+
+void exportCSumTerm(CExport* ex, f64 weight, const char* valueFmt, ...)
+{
+    fprintf(ex->file, "\n        + ");
+    exportCWriteF64(ex->file, weight);
+    fprintf(ex->file, " * ");
+    va_list args;
+    va_start(args, valueFmt);
+    vfprintf(ex->file, valueFmt, args);
+    va_end(args);
+}
+
+void exportCSumEnd(CExport* ex)
+{
+    fprintf(ex->file, ");\n");
+}
+
+bool exportCEnd(CExport* ex)
+{
+    const bool ok = !ferror(ex->file);
+    fclose(ex->file);
+    ex->file = nullptr;
+    if(!ok) {
+        LOG("ERROR: export> could not write %s", ex->path);
+        return false;
+    }
+    LOG("export> %s written (%s)", ex->path, ex->name);
+    return true;
+}
+
+void exportCTestInputs(f64* inputs, i32 count)
+{
+    u64 x = 0x5EED; // splitmix64
+    for(i32 i = 0; i < count; ++i) {
+        u64 z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z = z ^ (z >> 31);
+        inputs[i] = (z >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+    }
+}
+
+static void exportCWriteArray(FILE* f, const char* name, const f64* arr, i32 count)
+{
+    fprintf(f, "static const double %s[%d] = {", name, count);
+    for(i32 i = 0; i < count; ++i) {
+        fprintf(f, "%s", i % 4 == 0 ? "\n    " : " ");
+        exportCWriteF64(f, arr[i]);
+        fprintf(f, ",");
+    }
+    fprintf(f, "\n};\n\n");
+}
+
+bool exportCWriteHarness(const CExport& ex, const f64* inputs, const f64* expected,
+                         i32 sampleCount)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s", ex.path);
+    i32 len = strlen(path);
+    if(len > 2 && strcmp(path + len - 2, ".c") == 0) len -= 2;
+    snprintf(path + len, sizeof(path) - len, "_test.c");
+
+    char include[256];
+    exportCBaseName(include, sizeof(include), ex.path);
+
+    FILE* f = fopen(path, "wb");
+    if(!f) {
+        LOG("ERROR: export> could not open %s", path);
+        return false;
+    }
+
+    const char* name = ex.name;
+    const char* upper = ex.upperName;
+    fprintf(f, "// %s test harness: fed the same inputs, it has to give the outputs the\n", name);
+    fprintf(f, "// interpreter gave when it was exported\n");
+    fprintf(f, "#include <stdio.h>\n");
+    fprintf(f, "#include <math.h>\n");
+    fprintf(f, "#include \"%s\"\n\n", include);
+    fprintf(f, "#define SAMPLE_COUNT %d\n", sampleCount);
+    fprintf(f, "#define TOLERANCE %g\n\n", EXPORT_C_TOLERANCE);
+    exportCWriteArray(f, "sampleInputs", inputs, sampleCount * ex.inputCount);
+    exportCWriteArray(f, "sampleOutputs", expected, sampleCount * ex.outputCount);
+
+    fprintf(f, "int main(void)\n{\n");
+    fprintf(f, "    double out[%s_OUTPUT_COUNT];\n", upper);
+    if(ex.stateCount > 0) {
+        fprintf(f, "    double state[%s_STATE_COUNT] = {0};\n", upper);
+    }
+    fprintf(f, "    double maxError = 0.0;\n");
+    fprintf(f, "    int failed = 0;\n\n");
+    fprintf(f, "    // in sequence, the state is carried over like it was in the interpreter\n");
+    fprintf(f, "    for(int s = 0; s < SAMPLE_COUNT; ++s) {\n");
+    fprintf(f, "        %s(&sampleInputs[s * %s_INPUT_COUNT], out%s);\n", name, upper,
+            ex.stateCount > 0 ? ", state" : "");
+    fprintf(f, "        for(int o = 0; o < %s_OUTPUT_COUNT; ++o) {\n", upper);
+    fprintf(f, "            const double expected = sampleOutputs[s * %s_OUTPUT_COUNT + o];\n", upper);
+    fprintf(f, "            const double error = fabs(out[o] - expected);\n");
+    fprintf(f, "            if(error > maxError) maxError = error;\n");
+    fprintf(f, "            if(!(error <= TOLERANCE)) {\n");
+    fprintf(f, "                printf(\"sample %%d output %%d: %%.17g, expected %%.17g\\n\", s, o, out[o], expected);\n");
+    fprintf(f, "                failed++;\n");
+    fprintf(f, "            }\n");
+    fprintf(f, "        }\n");
+    fprintf(f, "    }\n\n");
+    fprintf(f, "    printf(\"%s: %%d samples, max error %%g, %%s\\n\", SAMPLE_COUNT, maxError,\n", name);
+    fprintf(f, "           failed ? \"FAILED\" : \"ok\");\n");
+    fprintf(f, "    return failed ? 1 : 0;\n");
+    fprintf(f, "}\n");
+
+    const bool ok = !ferror(f);
+    fclose(f);
+    if(!ok) {
+        LOG("ERROR: export> could not write %s", path);
+        return false;
+    }
+    return true;
+}
+
+bool exportCConfigFromEnv(char* path, i32 pathSize, const char* suffix)
+{
+    const char* file = getenv("EXPORT_C_FILE");
+    if(!file || !file[0]) return false;
+
+    // before the extension
+    char base[256];
+    snprintf(base, sizeof(base), "%s", file);
+    const char* ext = "";
+    char* dot = strrchr(base, '.');
+    if(dot && !strchr(dot, '/') && !strchr(dot, '\\')) {
+        ext = file + (dot - base);
+        *dot = 0;
+    }
+    snprintf(path, pathSize, "%s%s%s", base, suffix, ext);
+    return true;
+}
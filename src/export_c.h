@@ -0,0 +1,40 @@
+#pragma once
+#include "base.h"
+
+// writes an evolved net as a standalone C function (weights baked in, straight-line code, no
+// allocation) next to a harness that checks it against the interpreter outputs:
+//     void name(const double* in, double* out[, double* state])
+// state only exists when values carry over from one call to the next, it starts zeroed
+#define EXPORT_C_TEST_SAMPLES 32
+#define EXPORT_C_TOLERANCE 1e-9
+
+struct CExport
+{
+    FILE* file = nullptr;
+    char path[256];
+    char name[64];
+    char upperName[64];
+    i32 inputCount;
+    i32 outputCount;
+    i32 stateCount;
+};
+
+// name is taken from the file name, writes the preamble and the activation helper (name_act)
+bool exportCBegin(CExport* ex, const char* path, const char* description, i32 inputCount,
+                  i32 outputCount, i32 stateCount, bool relu);
+void exportCFunctionBegin(CExport* ex);
+void exportCFunctionEnd(CExport* ex);
+// "<lhs> = name_act(<bias> + w0 * <value0> + w1 * <value1> ...);", summed left to right like the
+// interpreters do
+void exportCSumBegin(CExport* ex, const char* lhs, f64 bias);
+void exportCSumTerm(CExport* ex, f64 weight, const char* valueFmt, ...);
+void exportCSumEnd(CExport* ex);
+bool exportCEnd(CExport* ex);
+// deterministic values in [-1, 1), the rand streams of the app are left untouched
+void exportCTestInputs(f64* inputs, i32 count);
+// <path without .c>_test.c, runs the samples in sequence (state is carried over)
+bool exportCWriteHarness(const CExport& ex, const f64* inputs, const f64* expected,
+                         i32 sampleCount);
+
+// $EXPORT_C_FILE enables exporting the champion, suffix goes before the extension
+bool exportCConfigFromEnv(char* path, i32 pathSize, const char* suffix = "");
@@ -1,18 +1,25 @@
 #include "base.h"
+#ifndef HEADLESS
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
 #include <gl3w.h>
+#endif
 #include <stdlib.h>
 #include <float.h>
 #include <assert.h>
 
-#include "window.h"
 #include "sprite.h"
 #include "neural.h"
+#include "wide_math.h"
+#ifndef HEADLESS
+#include "window.h"
+#include "neural_imgui.h"
+#include "profile_imgui.h"
 #include "imgui/imgui.h"
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include "imgui/imgui_internal.h"
 #include "imgui/imgui_sdl2_setup.h"
+#endif
 
 #define WINDOW_WIDTH 1600
 #define WINDOW_HEIGHT 900
@@ -28,8 +35,18 @@ constexpr i32 MAP_SIZE = MAP_WIDTH*MAP_HEIGHT;
 constexpr i32 MAP_WATER_AVG_WIDTH = MAP_WIDTH/MAP_WATER_AVG_GRID_SIZE;
 constexpr i32 MAP_WATER_AVG_HEIGHT = MAP_HEIGHT/MAP_WATER_AVG_GRID_SIZE;
 constexpr i32 MAP_WATER_AVG_SIZE = MAP_WATER_AVG_WIDTH*MAP_WATER_AVG_HEIGHT;
+constexpr i32 MAP_SAT_WIDTH = MAP_WIDTH+1;
+// terrain is stored in 8x8 tile blocks, tiles in Z order inside a block
+#define MAP_BLOCK_SIZE 8
+static_assert(MAP_WIDTH % MAP_BLOCK_SIZE == 0,"");
+static_assert(MAP_HEIGHT % MAP_BLOCK_SIZE == 0,"");
+constexpr i32 MAP_BLOCK_WIDTH = MAP_WIDTH/MAP_BLOCK_SIZE;
+constexpr i32 MAP_BLOCK_HEIGHT = MAP_HEIGHT/MAP_BLOCK_SIZE;
+constexpr i32 MAP_BLOCK_COUNT = MAP_BLOCK_WIDTH*MAP_BLOCK_HEIGHT;
+constexpr i32 MAP_SAT_SIZE = (MAP_WIDTH+1)*(MAP_HEIGHT+1);
 #define TILE_SIZE 32
-#define MAP_POND_MAX_COUNT 24
+#define MAP_POND_MAX_COUNT 256
+#define MAP_POND_NONE 0xFFFF
 #define MAP_POND_MIN_RADIUS 12
 #define MAP_POND_MAX_RADIUS 40
 
@@ -42,6 +59,8 @@ constexpr i32 MAP_WATER_AVG_SIZE = MAP_WATER_AVG_WIDTH*MAP_WATER_AVG_HEIGHT;
 #define FROG_JUMP_CD 450
 #define FROG_TONGUE_CD 300
 #define FROG_WATER_SENSOR_OFFSET (FROG_SIZE + 100.f)
+#define FROG_WATER_SENSOR_RADIUS 4 // in tiles, the sensor averages a (2r+1)² square
+#define FROG_WATER_SENSOR_COUNT 5 // center + 4 around
 
 #define ENERGY_TOTAL 100.0f
 #define ENERGY_JUMP_DRAIN 2.0f
@@ -57,10 +76,20 @@ constexpr i32 MAP_WATER_AVG_SIZE = MAP_WATER_AVG_WIDTH*MAP_WATER_AVG_HEIGHT;
 
 #define SIMULATION_MAX_TIME 60.0
 
+// steady state mode: every STEADY_STATE_INTERVAL frames the dead frogs and the worst frog
+// evaluated for at least FROG_MIN_EVAL_TIME are replaced by offspring
+#define STEADY_STATE_INTERVAL 30
+#define FROG_MIN_EVAL_TIME 5.0
+
 #define NEURAL_NET_LAYERS { 12, 6, 4 }
 
 #define NNTYPE_NN
 
+// snapshot sections of the app, next to the population (index 0)
+#define APP_SNAPSHOT_KIND 0x4e4e4746 // "FGNN"
+#define APP_SNAPSHOT_STATE (SNAPSHOT_SECTION_USER + 0)
+#define APP_SNAPSHOT_PAST_STATS (SNAPSHOT_SECTION_USER + 1)
+
 enum {
     MAP_TILE_GRASS=0,
     MAP_TILE_WATER,
@@ -95,7 +124,9 @@ struct WaterSensors
 
 struct App {
 
+#ifndef HEADLESS
 AppWindow window;
+#endif
 
 i32 timeScale = 1;
 
@@ -104,12 +135,25 @@ i32 viewX = 0;
 i32 viewY = 0;
 u8 mouseRightButDown;
 
-u8 mapData[MAP_SIZE];
+// per block: 64 2-bit tile codes and a water occupancy bit per tile (see mapTile/mapIsWater)
+u64 mapTileCodes[MAP_BLOCK_COUNT * 2];
+u64 mapWaterMask[MAP_BLOCK_COUNT];
 f32 mapAvgWater[MAP_WATER_AVG_SIZE];
+// per tile distance (in tiles) to the closest water tile and the pond it belongs to
+f32 mapWaterDist[MAP_SIZE];
+u16 mapClosestPond[MAP_SIZE];
+// closest water tile row in the same column, only used while computing mapWaterDist
+i16 mapColWaterY[MAP_SIZE];
+// summed-area table of water tiles, mapWaterSat[y * MAP_SAT_WIDTH + x] = water count in [0,x)x[0,y)
+i32 mapWaterSat[MAP_SAT_SIZE];
+#ifndef HEADLESS
 u32 mapTextureData[MAP_SIZE];
 u32 mapAvgWaterTextureData[MAP_WATER_AVG_SIZE];
 u32 tex_map;
 u32 tex_mapAvgWater;
+bool mapTexturesDirty = true; // map changed, re-upload textures on next render
+u64 mapNoiseSeed = 0;
+#endif
 
 i32 pondPos[MAP_POND_MAX_COUNT];
 i32 pondRadius[MAP_POND_MAX_COUNT];
@@ -134,6 +178,15 @@ f64 frogClosestMapBorderFactor[FROG_COUNT];
 f32 frogEnergy[FROG_COUNT];
 f32 frogHydration[FROG_COUNT];
 u8 frogDead[FROG_COUNT];
+f32 frogAge[FROG_COUNT]; // seconds since spawn
+
+// frogs alive at the start of the frame, only these get simulated
+i32 activeFrogIds[FROG_COUNT];
+i32 activeFrogCount = 0;
+i32 aliveFrogCount = 0;
+// fitness of the frogs dropped from the active list this generation
+f64 inactiveFitnessTotal = 0.0;
+f64 inactiveFitnessMax = 0.0;
 
 f64 frogFitness[FROG_COUNT];
 
@@ -154,7 +207,13 @@ i32 curGenSpecies[FROG_COUNT];
 i32 nextGenSpecies[FROG_COUNT];
 i32 generationNumber = 0;
 
-f32 simulationTime = 0;
+// no generations, offspring take the slots of the frogs as they get removed
+bool steadyState = false;
+i64 steadyFrameCount = 0;
+i32 steadyBirthCount = 0; // a generation is counted every FROG_COUNT births
+f64 retiredFitnessTotal = 0.0;
+f64 retiredFitnessMax = 0.0;
+i32 retiredCount = 0;
 
 bool showUi = true;
 bool dbgTimeMaxSpeed = false;
@@ -176,8 +235,25 @@ GenerationStats curGenStats;
 GenerationStats lastGenStats;
 GenerationStats pastGenStats[STATS_HISTORY_COUNT];
 
+struct SnapshotState {
+    i32 generationNumber;
+    GenerationStats curGenStats;
+    GenerationStats lastGenStats;
+};
+
+SnapshotWriter snapshotWriter;
+char snapshotPath[256];
+i32 snapshotInterval = 0; // generations, 0: no snapshots
+
+char exportCPath[256];
+bool exportCEnabled = false;
+f64 exportCBestFitness = 0.0; // of the last champion exported
+i32 exportCGeneration = -1;
+
+
 bool init()
 {
+#ifndef HEADLESS
     if(!window.init("Frogs [RNN]", "frogs_app_imgui.ini")) {
         LOG("ERROR: can't create window");
         return false;
@@ -198,6 +274,7 @@ bool init()
 
     glGenTextures(1, &tex_map);
     glGenTextures(1, &tex_mapAvgWater);
+#endif
 
     evolParams.popCount = FROG_COUNT;
     evolParams.fitness = frogFitness;
@@ -228,11 +305,75 @@ bool init()
 
     resetSimulation();
 
+    if(snapshotConfigFromEnv(snapshotPath, sizeof(snapshotPath), &snapshotInterval)) {
+        loadSnapshot();
+    }
+    exportCEnabled = exportCConfigFromEnv(exportCPath, sizeof(exportCPath));
+
+    return true;
+}
+
+// the population is written right after its evolution (every FROG_COUNT births in steady state,
+// the frogs being evaluated then start over when resumed)
+void writeSnapshot()
+{
+    PROFILE_ZONE("snapshot");
+    snapshotBegin(&snapshotWriter, APP_SNAPSHOT_KIND);
+
+    const SnapshotState state = { generationNumber, curGenStats, lastGenStats };
+    snapshotAdd(&snapshotWriter, APP_SNAPSHOT_STATE, 0, &state, sizeof(state), 1);
+    snapshotAdd(&snapshotWriter, APP_SNAPSHOT_PAST_STATS, 0, pastGenStats, sizeof(pastGenStats[0]),
+                STATS_HISTORY_COUNT);
+#ifdef NNTYPE_RNN
+    rnnSnapshotAdd(&snapshotWriter, 0, curGenNN, FROG_COUNT, curGenSpecies, speciation, nnDef);
+#elif defined(NNTYPE_NN)
+    nnSnapshotAdd(&snapshotWriter, 0, curGenNN, FROG_COUNT, curGenSpecies, speciation, nnDef);
+#endif
+
+    snapshotWriteAsync(&snapshotWriter, snapshotPath);
+}
+
+// after resetSimulation()
+bool loadSnapshot()
+{
+    Snapshot snap;
+    if(!snapshotOpen(&snap, snapshotPath, APP_SNAPSHOT_KIND)) {
+        return false;
+    }
+
+    const timept t0 = timeGet();
+    const SnapshotState* state = snapshotArrExact<SnapshotState>(snap, APP_SNAPSHOT_STATE, 0, 1);
+    const GenerationStats* pastStats = snapshotArrExact<GenerationStats>(snap, APP_SNAPSHOT_PAST_STATS,
+                                                                         0, STATS_HISTORY_COUNT);
+    bool restored = state && pastStats;
+#ifdef NNTYPE_RNN
+    restored = restored && rnnSnapshotRestore(snap, 0, curGenNN, FROG_COUNT, curGenSpecies,
+                                              &speciation, nnDef);
+#elif defined(NNTYPE_NN)
+    restored = restored && nnSnapshotRestore(snap, 0, curGenNN, FROG_COUNT, curGenSpecies,
+                                             &speciation, nnDef);
+#endif
+    if(!restored) {
+        LOG("ERROR: snapshot> could not resume from %s, starting over", snapshotPath);
+        snapshotClose(&snap);
+        resetSimulation();
+        return false;
+    }
+
+    generationNumber = state->generationNumber;
+    curGenStats = state->curGenStats;
+    lastGenStats = state->lastGenStats;
+    memmove(pastGenStats, pastStats, sizeof(pastGenStats));
+    snapshotClose(&snap);
+
+    LOG("snapshot> resumed from %s at generation %d (%.3fms)", snapshotPath, generationNumber,
+        timeToMicrosec(timeGet() - t0) / 1000.0);
     return true;
 }
 
 void cleanup()
 {
+    snapshotWait(&snapshotWriter);
 #ifdef NNTYPE_RNN
     rnnDealloc(curGenNN);
     rnnDealloc(nextGenNN);
@@ -242,6 +383,46 @@ void cleanup()
 #endif
 }
 
+#ifdef HEADLESS
+// step the simulation as fast as possible, no window or rendering
+// maxGenerations <= 0 runs forever
+void runHeadless(i32 maxGenerations)
+{
+    const i64 reportIntervalMicro = 5000000;
+    const timept startTime = timeGet();
+    const i32 startGenNumber = generationNumber;
+    timept reportTime = startTime;
+    i32 reportGenNumber = generationNumber;
+    i64 totalFrameCount = 0;
+    profileResetTotals();
+
+    while(maxGenerations <= 0 || generationNumber - startGenNumber < maxGenerations) {
+        step();
+        profileFrameEnd();
+
+        const i64 reportDelta = timeToMicrosec(timeGet() - reportTime);
+        if(reportDelta >= reportIntervalMicro) {
+            const f64 sec = reportDelta / 1000000.0;
+            const i32 genCount = generationNumber - reportGenNumber;
+            const i64 frameCount = profileTotals().frameCount;
+            LOG("headless> gen=%d fps=%.0f gen/s=%.3f", generationNumber, frameCount / sec, genCount / sec);
+            profileLogTotals("headless>");
+
+            totalFrameCount += frameCount;
+            profileResetTotals();
+            reportTime = timeGet();
+            reportGenNumber = generationNumber;
+        }
+    }
+
+    totalFrameCount += profileTotals().frameCount;
+    const f64 totalSec = timeToMicrosec(timeGet() - startTime) / 1000000.0;
+    const i32 totalGenCount = generationNumber - startGenNumber;
+    LOG("headless> done: %d generations, %lld frames in %.2fs (fps=%.0f gen/s=%.3f)",
+        totalGenCount, (long long)totalFrameCount, totalSec,
+        totalFrameCount / totalSec, totalGenCount / totalSec);
+}
+#else
 void run()
 {
     while(window.running) {
@@ -256,6 +437,7 @@ void run()
         newFrame();
         render();
         window.swap();
+        profileFrameEnd();
 
         if(!dbgTimeMaxSpeed) {
             const i64 frameDtMicro = FRAME_DT/timeScale * 1000000;
@@ -365,82 +547,289 @@ void updateCamera()
 
     setView(viewX, viewY, WINDOW_WIDTH*viewZoom, WINDOW_HEIGHT*viewZoom);
 }
+#endif
 
-inline u32 noiseColor(Color3 baseColor, u8 variance)
+// bit of tile (x, y) inside its block, x and y bits interleaved
+inline i32 mapTileBit(i32 x, i32 y)
 {
-    u8 r = clamp((i32)baseColor.r + (i32)randi64(-variance, variance), 0, 0xff);
-    u8 g = clamp((i32)baseColor.g + (i32)randi64(-variance, variance), 0, 0xff);
-    u8 b = clamp((i32)baseColor.b + (i32)randi64(-variance, variance), 0, 0xff);
-    return (0xff000000 | (b << 16) | (g << 8) | r);
+    const i32 bx = (x & 1) | ((x & 2) << 1) | ((x & 4) << 2);
+    const i32 by = (y & 1) | ((y & 2) << 1) | ((y & 4) << 2);
+    return bx | (by << 1);
 }
 
-void resetMap()
+inline i32 mapBlockId(i32 x, i32 y)
 {
-    memset(mapData, MAP_TILE_GRASS, sizeof(mapData));
+    return (y / MAP_BLOCK_SIZE) * MAP_BLOCK_WIDTH + (x / MAP_BLOCK_SIZE);
+}
 
+inline u8 mapTile(i32 x, i32 y)
+{
+    assert(x >= 0 && x < MAP_WIDTH && y >= 0 && y < MAP_HEIGHT);
+    const i32 bit = mapTileBit(x, y);
+    return (mapTileCodes[mapBlockId(x, y) * 2 + (bit >> 5)] >> ((bit & 31) * 2)) & 3;
+}
+
+inline bool mapIsWater(i32 x, i32 y)
+{
+    assert(x >= 0 && x < MAP_WIDTH && y >= 0 && y < MAP_HEIGHT);
+    return (mapWaterMask[mapBlockId(x, y)] >> mapTileBit(x, y)) & 1;
+}
+
+// not thread safe within a block
+inline void mapSetTile(i32 x, i32 y, u8 tile)
+{
+    assert(x >= 0 && x < MAP_WIDTH && y >= 0 && y < MAP_HEIGHT);
+    const i32 block = mapBlockId(x, y);
+    const i32 bit = mapTileBit(x, y);
+    u64& codes = mapTileCodes[block * 2 + (bit >> 5)];
+    const i32 shift = (bit & 31) * 2;
+    codes = (codes & ~(3ULL << shift)) | ((u64)tile << shift);
+    mapWaterMask[block] = (mapWaterMask[block] & ~(1ULL << bit)) | ((u64)(tile == MAP_TILE_WATER) << bit);
+}
+
+void resetMap()
+{
     for(i32 i = 0; i < pondCount; ++i) {
-        pondPos[i] = xorshift64star() % MAP_SIZE;
+        pondPos[i] = randBelow(MAP_SIZE);
         pondRadius[i] = randi64(MAP_POND_MIN_RADIUS, MAP_POND_MAX_RADIUS);
         //LOG("pond#%d pos=%d radius=%d", i, pondPos[i], pondRadius[i]);
     }
+#ifndef HEADLESS
+    mapNoiseSeed = randu64();
+#endif
 
-    for(i32 i = 0; i < MAP_SIZE; ++i) {
-        i32 x = i % MAP_WIDTH;
-        i32 y = i / MAP_WIDTH;
+    // rows are independent: rasterize the ponds crossing each row (only their span) and
+    // compute the row prefix sums of the summed-area table in the same pass
+    // a thread gets whole block rows since blocks are shared by 8 rows
+    parallelFor(MAP_BLOCK_HEIGHT, [this](i32 start, i32 end, i32 chunkId) {
+        // the pool rewinds the scratch arena after each task
+        u8* row = scratchArr<u8>(MAP_WIDTH);
+        f32* rowDepth = scratchArr<f32>(MAP_WIDTH);
+
+        static_assert(MAP_TILE_GRASS == 0, "");
+        memset(&mapTileCodes[start * MAP_BLOCK_WIDTH * 2], 0, sizeof(u64) * (end - start) * MAP_BLOCK_WIDTH * 2);
+        memset(&mapWaterMask[start * MAP_BLOCK_WIDTH], 0, sizeof(u64) * (end - start) * MAP_BLOCK_WIDTH);
+
+        for(i32 y = start * MAP_BLOCK_SIZE; y < end * MAP_BLOCK_SIZE; ++y) {
+            u16* rowPond = &mapClosestPond[y * MAP_WIDTH];
+            memset(row, MAP_TILE_GRASS, MAP_WIDTH);
+            for(i32 x = 0; x < MAP_WIDTH; ++x) {
+                rowPond[x] = MAP_POND_NONE;
+            }
 
-        for(i32 p = 0; p < pondCount; ++p) {
-            i32 px = pondPos[p] % MAP_WIDTH;
-            i32 py = pondPos[p] / MAP_WIDTH;
-            i32 dist = sqrtf((px - x) * (px - x) + (py - y) * (py - y));
+            for(i32 p = 0; p < pondCount; ++p) {
+                const i32 px = pondPos[p] % MAP_WIDTH;
+                const i32 py = pondPos[p] / MAP_WIDTH;
+                const i32 dy = py - y;
+                // (i32)dist <= radius <=> dist² < (radius+1)²
+                const i32 outerSq = (pondRadius[p] + 1) * (pondRadius[p] + 1);
+                if(dy * dy >= outerSq) continue;
+
+                i32 halfSpan = sqrtf(outerSq - dy * dy);
+                while(halfSpan * halfSpan + dy * dy >= outerSq) halfSpan--;
+                const i32 x0 = max(px - halfSpan, 0);
+                const i32 x1 = min(px + halfSpan, MAP_WIDTH-1);
+
+                // overlapping ponds: the tile belongs to the one we are the deepest in
+                for(i32 x = x0; x <= x1; ++x) {
+                    const f32 depth = sqrtf((px - x) * (px - x) + dy * dy) - pondRadius[p];
+                    if(row[x] != MAP_TILE_WATER || depth < rowDepth[x]) {
+                        row[x] = MAP_TILE_WATER;
+                        rowDepth[x] = depth;
+                        rowPond[x] = p;
+                    }
+                }
+            }
 
-            if(dist <= pondRadius[p]) {
-                mapData[i] = MAP_TILE_WATER;
+            i32* satRow = &mapWaterSat[(y+1) * MAP_SAT_WIDTH];
+            i32 rowSum = 0;
+            satRow[0] = 0;
+            for(i32 x = 0; x < MAP_WIDTH; ++x) {
+                if(row[x] != MAP_TILE_GRASS) {
+                    mapSetTile(x, y, row[x]);
+                }
+                rowSum += row[x] == MAP_TILE_WATER ? 1 : 0;
+                satRow[x+1] = rowSum;
             }
         }
-    }
+    });
 
     /*for(i32 i = 0; i < MAP_SIZE; ++i) {
         i32 x = i % MAP_WIDTH;
         i32 y = i / MAP_WIDTH;
 
         if(x == 0) {
-            mapData[i] = MAP_TILE_DEATH;
+            mapSetTile(x, y, MAP_TILE_DEATH);
         }
         else if(x == MAP_WIDTH-1) {
-            mapData[i] = MAP_TILE_DEATH;
+            mapSetTile(x, y, MAP_TILE_DEATH);
         }
         else if(y == 0) {
-            mapData[i] = MAP_TILE_DEATH;
+            mapSetTile(x, y, MAP_TILE_DEATH);
         }
         else if(y == MAP_HEIGHT-1) {
-            mapData[i] = MAP_TILE_DEATH;
+            mapSetTile(x, y, MAP_TILE_DEATH);
         }
     }*/
 
-    memset(mapAvgWater, 0, sizeof(mapAvgWater));
-    for(i32 i = 0; i < MAP_SIZE; ++i) {
-        i32 maX = (i % MAP_WIDTH) / MAP_WATER_AVG_GRID_SIZE;
-        i32 maY = (i / MAP_WIDTH) / MAP_WATER_AVG_GRID_SIZE;
-        mapAvgWater[maY * MAP_WATER_AVG_WIDTH + maX] += mapData[i] == MAP_TILE_WATER ? 1.0f : 0.0f;
+    // summed-area table: accumulate the row prefix sums down the columns
+    memset(mapWaterSat, 0, sizeof(i32) * MAP_SAT_WIDTH);
+    for(i32 y = 1; y <= MAP_HEIGHT; ++y) {
+        i32* satRow = &mapWaterSat[y * MAP_SAT_WIDTH];
+        const i32* satPrevRow = &mapWaterSat[(y-1) * MAP_SAT_WIDTH];
+        for(i32 x = 1; x < MAP_SAT_WIDTH; ++x) {
+            satRow[x] += satPrevRow[x];
+        }
     }
 
+    // kept for the debug view
     for(i32 i = 0; i < MAP_WATER_AVG_SIZE; ++i) {
-        mapAvgWater[i] /= (f32)MAP_WATER_AVG_GRID_SIZE * MAP_WATER_AVG_GRID_SIZE;
+        i32 maX = (i % MAP_WATER_AVG_WIDTH) * MAP_WATER_AVG_GRID_SIZE;
+        i32 maY = (i / MAP_WATER_AVG_WIDTH) * MAP_WATER_AVG_GRID_SIZE;
+        mapAvgWater[i] = mapWaterCount(maX, maY, maX + MAP_WATER_AVG_GRID_SIZE,
+                                       maY + MAP_WATER_AVG_GRID_SIZE) /
+                         ((f32)MAP_WATER_AVG_GRID_SIZE * MAP_WATER_AVG_GRID_SIZE);
     }
 
+    computeWaterDistanceField();
+
+#ifndef HEADLESS
+    mapTexturesDirty = true;
+#endif
+}
+
+// water tiles in [x0,x1)x[y0,y1), clipped to the map
+inline i32 mapWaterCount(i32 x0, i32 y0, i32 x1, i32 y1)
+{
+    x0 = clamp(x0, 0, MAP_WIDTH);
+    x1 = clamp(x1, 0, MAP_WIDTH);
+    y0 = clamp(y0, 0, MAP_HEIGHT);
+    y1 = clamp(y1, 0, MAP_HEIGHT);
+    return mapWaterSat[y1 * MAP_SAT_WIDTH + x1] - mapWaterSat[y0 * MAP_SAT_WIDTH + x1] -
+           mapWaterSat[y1 * MAP_SAT_WIDTH + x0] + mapWaterSat[y0 * MAP_SAT_WIDTH + x0];
+}
+
+// exact euclidean distance transform of the water tiles (Felzenszwalb & Huttenlocher),
+// keeping track of the closest water tile to propagate its pond index
+void computeWaterDistanceField()
+{
+    const f32 inf = 1e20f;
+
+    // columns: closest water tile row in the same column
+    i16* colWaterY = mapColWaterY;
+    parallelFor(MAP_WIDTH, [this, colWaterY](i32 start, i32 end, i32 chunkId) {
+        for(i32 x = start; x < end; ++x) {
+            i32 lastY = -1;
+            for(i32 y = 0; y < MAP_HEIGHT; ++y) {
+                if(mapIsWater(x, y)) {
+                    lastY = y;
+                }
+                colWaterY[y * MAP_WIDTH + x] = lastY;
+            }
+
+            lastY = -1;
+            for(i32 y = MAP_HEIGHT-1; y >= 0; --y) {
+                if(mapIsWater(x, y)) {
+                    lastY = y;
+                }
+                const i32 cur = colWaterY[y * MAP_WIDTH + x];
+                if(lastY != -1 && (cur == -1 || lastY - y < y - cur)) {
+                    colWaterY[y * MAP_WIDTH + x] = lastY;
+                }
+            }
+        }
+    });
+
+    // rows: lower envelope of the column parabolas
+    // water tiles keep the pond index from rasterization, other rows read it concurrently
+    parallelFor(MAP_HEIGHT, [this, colWaterY, inf](i32 start, i32 end, i32 chunkId) {
+        f32* f = scratchArr<f32>(MAP_WIDTH);
+        i32* v = scratchArr<i32>(MAP_WIDTH);
+        f32* z = scratchArr<f32>(MAP_WIDTH + 1);
+
+        for(i32 y = start; y < end; ++y) {
+            for(i32 x = 0; x < MAP_WIDTH; ++x) {
+                const i32 wy = colWaterY[y * MAP_WIDTH + x];
+                f[x] = wy == -1 ? inf : (f32)((wy - y) * (wy - y));
+            }
+
+            // columns without water don't take part in the envelope
+            i32 k = -1;
+            for(i32 q = 0; q < MAP_WIDTH; ++q) {
+                if(f[q] >= inf) continue;
+                f32 s = -inf;
+                while(k >= 0) {
+                    const i32 p = v[k];
+                    s = ((f[q] + q * q) - (f[p] + p * p)) / (2.0f * (q - p));
+                    if(s > z[k]) break;
+                    k--;
+                }
+                k++;
+                v[k] = q;
+                z[k] = k == 0 ? -inf : s;
+                z[k+1] = inf;
+            }
+
+            if(k == -1) {
+                for(i32 x = 0; x < MAP_WIDTH; ++x) {
+                    mapWaterDist[y * MAP_WIDTH + x] = inf;
+                    mapClosestPond[y * MAP_WIDTH + x] = MAP_POND_NONE;
+                }
+                continue;
+            }
+
+            k = 0;
+            for(i32 x = 0; x < MAP_WIDTH; ++x) {
+                while(z[k+1] < x) {
+                    k++;
+                }
+                const i32 wx = v[k];
+                const i32 i = y * MAP_WIDTH + x;
+                if(mapIsWater(x, y)) {
+                    mapWaterDist[i] = 0;
+                    continue;
+                }
+                const i32 wy = colWaterY[y * MAP_WIDTH + wx];
+                mapWaterDist[i] = sqrtf((x - wx) * (x - wx) + f[wx]);
+                mapClosestPond[i] = mapClosestPond[wy * MAP_WIDTH + wx];
+            }
+        }
+    });
+}
+
+#ifndef HEADLESS
+// per tile hash instead of the global rng so rows can be filled in parallel
+inline u32 noiseColor(Color3 baseColor, i32 variance, u64 hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    const i32 range = variance * 2 + 1;
+    u8 r = clamp((i32)baseColor.r + (i32)((hash & 0xffff) % range) - variance, 0, 0xff);
+    u8 g = clamp((i32)baseColor.g + (i32)(((hash >> 16) & 0xffff) % range) - variance, 0, 0xff);
+    u8 b = clamp((i32)baseColor.b + (i32)(((hash >> 32) & 0xffff) % range) - variance, 0, 0xff);
+    return (0xff000000 | (b << 16) | (g << 8) | r);
+}
+
+// render side: build and upload map textures from the map tiles and mapAvgWater
+void updateMapTextures()
+{
     const Color3 grassColor = {30, 60, 20};
     const Color3 waterColor = {0, 117, 205};
     const Color3 deathColor = {0, 0, 0};
     const i32 grassVariance = 4;
     const i32 waterVariance = 10;
     const i32 deathVariance = 10;
-    for(i32 i = 0; i < MAP_SIZE; ++i) {
-        switch(mapData[i]) {
-            case MAP_TILE_GRASS: mapTextureData[i] = noiseColor(grassColor, grassVariance); break;
-            case MAP_TILE_WATER: mapTextureData[i] = noiseColor(waterColor, waterVariance); break;
-            case MAP_TILE_DEATH: mapTextureData[i] = noiseColor(deathColor, deathVariance); break;
+    parallelFor(MAP_HEIGHT, [&](i32 start, i32 end, i32 chunkId) {
+        for(i32 i = start * MAP_WIDTH; i < end * MAP_WIDTH; ++i) {
+            const u64 hash = mapNoiseSeed + (u64)i * 0x9e3779b97f4a7c15ULL;
+            switch(mapTile(i % MAP_WIDTH, i / MAP_WIDTH)) {
+                case MAP_TILE_GRASS: mapTextureData[i] = noiseColor(grassColor, grassVariance, hash); break;
+                case MAP_TILE_WATER: mapTextureData[i] = noiseColor(waterColor, waterVariance, hash); break;
+                case MAP_TILE_DEATH: mapTextureData[i] = noiseColor(deathColor, deathVariance, hash); break;
+            }
         }
-    }
+    });
 
     for(i32 i = 0; i < MAP_WATER_AVG_SIZE; ++i) {
         mapAvgWaterTextureData[i] = 0xffff0000 | ((u32)(0xff * (1.0f - mapAvgWater[i])) << 8) |
@@ -478,7 +867,10 @@ void resetMap()
                  GL_RGBA,
                  GL_UNSIGNED_BYTE,
                  mapAvgWaterTextureData);
+
+    mapTexturesDirty = false;
 }
+#endif
 
 void resetFrogColors()
 {
@@ -496,51 +888,56 @@ void resetFrogColors()
     }
 }
 
-void resetFrogs()
+void spawnFrog(i32 i)
 {
-    simulationTime = 0;
-
-    mem_zero(frogAngle);
-    mem_zero(frogJumpTime);
-    mem_zero(frogTongueTime);
-    mem_zero(frogDead);
-    mem_zero(frogFitness);
-    mem_zero(frogInput);
+    frogAngle[i] = 0;
+    frogJumpTime[i] = 0;
+    frogTongueTime[i] = 0;
+    frogDead[i] = false;
+    frogAge[i] = 0;
+    frogFitness[i] = 0;
+    frogInput[i] = {};
+
+    bool retry = true;
+    while(retry) {
+        retry = false;
+
+        frogPos[i] = vec2Make(randf64(TILE_SIZE + 1.0, (MAP_WIDTH-1) * TILE_SIZE - 1),
+                              randf64(TILE_SIZE + 1.0, (MAP_HEIGHT-1) * TILE_SIZE - 1));
+        i32 mx = frogPos[i].x / TILE_SIZE;
+        i32 my = frogPos[i].y / TILE_SIZE;
+        assert(mapTile(mx, my) != MAP_TILE_DEATH);
+        if(mapIsWater(mx, my)) {
+            retry = true;
+            continue;
+        }
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
-        bool retry = true;
-        while(retry) {
-            retry = false;
-
-            frogPos[i] = vec2Make(randf64(TILE_SIZE + 1.0, (MAP_WIDTH-1) * TILE_SIZE - 1),
-                                  randf64(TILE_SIZE + 1.0, (MAP_HEIGHT-1) * TILE_SIZE - 1));
-            i32 mx = frogPos[i].x / TILE_SIZE;
-            i32 my = frogPos[i].y / TILE_SIZE;
-            assert(mapData[my * MAP_WIDTH + mx] != MAP_TILE_DEATH);
-            if(mapData[my * MAP_WIDTH + mx] == MAP_TILE_WATER) {
-                retry = true;
-                continue;
-            }
+        // restrict frogs from spawning too far off ponds
+        retry |= mapWaterDist[my * MAP_WIDTH + mx] * TILE_SIZE > 1000.f;
+    }
 
-            // restrict frogs from spawning too far off ponds
-            f32 minDist = FLT_MAX;
-            for(i32 p = 0; p < pondCount; ++p) {
-                const Vec2 pondTilePos = vec2Make((pondPos[p] % MAP_WIDTH) * TILE_SIZE,
-                                                  (pondPos[p] / MAP_WIDTH) * TILE_SIZE);
-                f32 dist = vec2Distance(&frogPos[i], &pondTilePos) - (pondRadius[p] * TILE_SIZE);
-                if(dist < minDist) {
-                    minDist = dist;
-                }
-            }
+    frogEnergy[i] = ENERGY_TOTAL;
+    frogHydration[i] = HYDRATION_TOTAL;
+}
 
-            retry |= minDist > 1000.f;
-        }
+void resetFrogs()
+{
+    for(i32 i = 0; i < FROG_COUNT; ++i) {
+        spawnFrog(i);
     }
 
     for(i32 i = 0; i < FROG_COUNT; ++i) {
-        frogEnergy[i] = ENERGY_TOTAL;
-        frogHydration[i] = HYDRATION_TOTAL;
+        activeFrogIds[i] = i;
     }
+    activeFrogCount = FROG_COUNT;
+    aliveFrogCount = FROG_COUNT;
+    inactiveFitnessTotal = 0.0;
+    inactiveFitnessMax = 0.0;
+
+    steadyBirthCount = 0;
+    retiredFitnessTotal = 0.0;
+    retiredFitnessMax = 0.0;
+    retiredCount = 0;
 }
 
 void resetSimulation()
@@ -562,6 +959,7 @@ void resetSimulation()
 #endif
 }
 
+#ifndef HEADLESS
 void ImGui_ColoredRect(const ImVec2& size, const ImVec4& color)
 {
     ImGuiWindow* window = ImGui::GetCurrentWindow();
@@ -795,6 +1193,7 @@ void ui_simulationOptions()
     ImGui::PopItemWidth();
 
     ImGui::Checkbox("Max speed", &dbgTimeMaxSpeed);
+    ImGui::Checkbox("Steady state", &steadyState);
 
     if(ImGui::Button("Reset game")) {
         resetFrogs();
@@ -817,9 +1216,11 @@ void doUI()
     ui_subPopulations();
     ui_lastGeneration();
     ui_simulationOptions();
+    ImGui_ProfileWindow();
 
     //ImGui::ShowDemoWindow();
 }
+#endif
 
 inline bool frogIsJumping(i32 id)
 {
@@ -833,6 +1234,8 @@ inline bool frogIsEating(i32 id)
 
 void updateNNs()
 {
+    PROFILE_ZONE("updateNNs");
+    PROFILE_SCOPE(inputZone, "nnInputs");
 #ifdef NNTYPE_RNN
     RecurrentNeuralNet* nnets[FROG_COUNT];
 #elif defined(NNTYPE_NN)
@@ -842,91 +1245,102 @@ void updateNNs()
     i32 nnetsCount = 0;
     //const f32 waterSmellSquareCount = VISION_WIDTH * VISION_WIDTH * 0.25;
 
-    constexpr f32 sensorOffsetPos[4][2] {
+    // center sensor is the frog tile, the others average a square around an offset position
+    constexpr f32 sensorOffsetPos[FROG_WATER_SENSOR_COUNT][2] {
+        {  0, 0 },
         {  -FROG_WATER_SENSOR_OFFSET,  -FROG_WATER_SENSOR_OFFSET },
         {   FROG_WATER_SENSOR_OFFSET,  -FROG_WATER_SENSOR_OFFSET },
         {  -FROG_WATER_SENSOR_OFFSET,  FROG_WATER_SENSOR_OFFSET },
         {   FROG_WATER_SENSOR_OFFSET,  FROG_WATER_SENSOR_OFFSET }
     };
+    constexpr i32 sensorRadius[FROG_WATER_SENSOR_COUNT] {
+        0,
+        FROG_WATER_SENSOR_RADIUS,
+        FROG_WATER_SENSOR_RADIUS,
+        FROG_WATER_SENSOR_RADIUS,
+        FROG_WATER_SENSOR_RADIUS
+    };
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    // gather every sensor box corner of every frog, then query the summed-area table in one batch
+    // the part of a box outside the map counts as dry
+    // temporary arrays of this frame, released together at the end
+    const i64 scratchStart = scratchMark();
+    const i32 sensorMaxCount = activeFrogCount * FROG_WATER_SENSOR_COUNT;
+    i32* sensorI00 = scratchArr<i32>(sensorMaxCount);
+    i32* sensorI01 = scratchArr<i32>(sensorMaxCount);
+    i32* sensorI10 = scratchArr<i32>(sensorMaxCount);
+    i32* sensorI11 = scratchArr<i32>(sensorMaxCount);
+    f32* sensorScale = scratchArr<f32>(sensorMaxCount);
+    f32* sensorValue = scratchArr<f32>(sensorMaxCount);
+    i32* sensorFrogId = scratchArr<i32>(activeFrogCount);
+    i32 sensorFrogCount = 0;
+
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
 
-        // center sensor
-        i32 centerX = frogPos[i].x / TILE_SIZE;
-        i32 centerY = frogPos[i].y / TILE_SIZE;
-        frogWaterSensors[i].center = mapData[centerX + centerY * MAP_WIDTH] == MAP_TILE_WATER ? 1.0:0.0;
-
-        for(i32 s = 0; s < 4; ++s) {
-            i32 sensorX = (frogPos[i].x + sensorOffsetPos[s][0]) / (TILE_SIZE * MAP_WATER_AVG_GRID_SIZE);
-            i32 sensorY = (frogPos[i].y + sensorOffsetPos[s][1]) / (TILE_SIZE * MAP_WATER_AVG_GRID_SIZE);
-            if(sensorX < 0 || sensorX >= MAP_WATER_AVG_WIDTH || sensorY < 0 ||
-               sensorY >= MAP_WATER_AVG_HEIGHT) {
-                frogWaterSensors[i].sens[s] = 0.0;
-            }
-            else {
-                assert(sensorX + sensorY * MAP_WATER_AVG_WIDTH < MAP_WATER_AVG_SIZE);
-                frogWaterSensors[i].sens[s] = mapAvgWater[sensorX + sensorY * MAP_WATER_AVG_WIDTH];
-            }
+        for(i32 s = 0; s < FROG_WATER_SENSOR_COUNT; ++s) {
+            const i32 r = sensorRadius[s];
+            const i32 tx = floorf((frogPos[i].x + sensorOffsetPos[s][0]) / TILE_SIZE);
+            const i32 ty = floorf((frogPos[i].y + sensorOffsetPos[s][1]) / TILE_SIZE);
+            const i32 x0 = clamp(tx - r, 0, MAP_WIDTH);
+            const i32 x1 = clamp(tx + r + 1, 0, MAP_WIDTH);
+            const i32 y0 = clamp(ty - r, 0, MAP_HEIGHT);
+            const i32 y1 = clamp(ty + r + 1, 0, MAP_HEIGHT);
+
+            const i32 n = sensorFrogCount * FROG_WATER_SENSOR_COUNT + s;
+            sensorI00[n] = y0 * MAP_SAT_WIDTH + x0;
+            sensorI01[n] = y0 * MAP_SAT_WIDTH + x1;
+            sensorI10[n] = y1 * MAP_SAT_WIDTH + x0;
+            sensorI11[n] = y1 * MAP_SAT_WIDTH + x1;
+            sensorScale[n] = 1.0f / ((2 * r + 1) * (2 * r + 1));
         }
+        sensorFrogId[sensorFrogCount++] = i;
     }
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
-        if(frogDead[i]) continue;
-        const i32 frogTileX = frogPos[i].x / TILE_SIZE;
-        const i32 frogTileY = frogPos[i].y / TILE_SIZE;
-        const Vec2 frogTilePos = vec2Make(frogTileX, frogTileY);
-
-        f32 minDist = FLT_MAX;
-        Vec2 chosenPondPos;
-        for(i32 p = 0; p < pondCount; ++p) {
-            const Vec2 pondTilePos = vec2Make(pondPos[p] % MAP_WIDTH, pondPos[p] / MAP_WIDTH);
-            f32 dist = vec2Distance(&frogTilePos, &pondTilePos) - pondRadius[p];
-
-            if(dist < minDist) {
-                minDist = dist;
-                chosenPondPos = {pondTilePos.x * TILE_SIZE, pondTilePos.y * TILE_SIZE};
-            }
-        }
+    batchRectSum(mapWaterSat, sensorI00, sensorI01, sensorI10, sensorI11, sensorScale, sensorValue,
+                 sensorFrogCount * FROG_WATER_SENSOR_COUNT);
 
-        Vec2 pondV = vec2Minus(&chosenPondPos, &frogPos[i]);
-        Vec2 dir = {cosf(frogAngle[i]), sinf(frogAngle[i])};
-        f32 diff = vec2AngleBetween(&dir, &pondV);
-        frogClosestPondAngleDiff[i] = diff / PI;
-        assert(frogClosestPondAngleDiff[i] >= -1.0 && frogClosestPondAngleDiff[i] <= 1.0);
+    for(i32 f = 0; f < sensorFrogCount; ++f) {
+        const f32* val = &sensorValue[f * FROG_WATER_SENSOR_COUNT];
+        WaterSensors& ws = frogWaterSensors[sensorFrogId[f]];
+        ws.center = val[0];
+        for(i32 s = 0; s < 4; ++s) {
+            ws.sens[s] = val[s+1];
+        }
     }
 
-    f64 oldClosestPondFactor[FROG_COUNT];
-    memmove(oldClosestPondFactor, frogClosestPondFactor, sizeof(frogClosestPondFactor));
-
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    // closest pond, looked up from the map distance field
+    // the angle to it is gathered in SoA arrays and computed in batch
+    f32* frogDirX = scratchArr<f32>(activeFrogCount);
+    f32* frogDirY = scratchArr<f32>(activeFrogCount);
+    f32* pondDirX = scratchArr<f32>(activeFrogCount);
+    f32* pondDirY = scratchArr<f32>(activeFrogCount);
+    i32* pondDirFrogId = scratchArr<i32>(activeFrogCount);
+    i32 pondDirCount = 0;
+
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
-        const i32 frogTileX = frogPos[i].x / TILE_SIZE;
-        const i32 frogTileY = frogPos[i].y / TILE_SIZE;
-        const Vec2 frogTilePos = vec2Make(frogTileX, frogTileY);
-
-        f32 minDist = FLT_MAX;
-        f32 chosenPondRadius = 0;
-        for(i32 p = 0; p < pondCount; ++p) {
-            const Vec2 pondTilePos = vec2Make(pondPos[p] % MAP_WIDTH, pondPos[p] / MAP_WIDTH);
-            f32 dist = vec2Distance(&frogTilePos, &pondTilePos) - pondRadius[p];
-
-            if(dist < minDist) {
-                minDist = dist;
-                chosenPondRadius = pondRadius[p];
-            }
-        }
+        const i32 frogTileX = clamp((i32)(frogPos[i].x / TILE_SIZE), 0, MAP_WIDTH-1);
+        const i32 frogTileY = clamp((i32)(frogPos[i].y / TILE_SIZE), 0, MAP_HEIGHT-1);
+        const i32 frogTile = frogTileY * MAP_WIDTH + frogTileX;
+        const i32 closestPond = mapClosestPond[frogTile];
+        assert(closestPond != MAP_POND_NONE);
 
+        const Vec2 chosenPondPos = vec2Make((pondPos[closestPond] % MAP_WIDTH) * TILE_SIZE,
+                                            (pondPos[closestPond] / MAP_WIDTH) * TILE_SIZE);
+        const f32 minDist = mapWaterDist[frogTile];
+
+        const f64 oldClosestPondFactor = frogClosestPondFactor[i];
         if(minDist < 1.0) {
             frogClosestPondFactor[i] = 1.0;
         }
         else {
             frogClosestPondFactor[i] = 1.0 / minDist;
         }
-    }
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
-        f64 offset = frogClosestPondFactor[i] - oldClosestPondFactor[i];
+        f64 offset = frogClosestPondFactor[i] - oldClosestPondFactor;
         if(offset > 0) {
             frogClosestPondFactorOffsetSign[i] = 1;
         }
@@ -936,17 +1350,24 @@ void updateNNs()
         else {
             frogClosestPondFactorOffsetSign[i] = 0;
         }
+
+        frogDirX[pondDirCount] = frogAngle[i];
+        pondDirX[pondDirCount] = chosenPondPos.x - frogPos[i].x;
+        pondDirY[pondDirCount] = chosenPondPos.y - frogPos[i].y;
+        pondDirFrogId[pondDirCount++] = i;
     }
 
-    u8 frogIsInWater[FROG_COUNT];
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
-       const i32 frogTileX = frogPos[i].x / TILE_SIZE;
-       const i32 frogTileY = frogPos[i].y / TILE_SIZE;
-       frogIsInWater[i] = mapData[frogTileX + frogTileY * MAP_WIDTH] == MAP_TILE_WATER;
+    batchSinCos(frogDirX, frogDirY, frogDirX, pondDirCount);
+    batchAngleBetween(frogDirX, frogDirY, pondDirX, pondDirY, pondDirX, pondDirCount);
+
+    for(i32 d = 0; d < pondDirCount; ++d) {
+        // (f32)PI is slightly above PI
+        frogClosestPondAngleDiff[pondDirFrogId[d]] = clamp(pondDirX[d] / PI, -1.0, 1.0);
     }
 
     // how close are we to map bounds
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
         const f32 halfMapWidth  = MAP_WIDTH  * 0.5f * TILE_SIZE;
         const f32 halfMapHeight = MAP_HEIGHT * 0.5f * TILE_SIZE;
@@ -955,7 +1376,8 @@ void updateNNs()
         frogClosestMapBorderFactor[i] = db * db * db;
     }
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
         f64 input[12];
         assert(arr_count(input) == nnDef.inputNeuronCount);
@@ -976,23 +1398,30 @@ void updateNNs()
         curGenNN[i]->setInputs(input, arr_count(input));
         nnets[nnetsCount++] = curGenNN[i];
     }
+    inputZone.stop();
 
+    PROFILE_SCOPE(propagateZone, "propagate");
+    // each chunk propagates its own slice of the batch
+    parallelFor(nnetsCount, [&](i32 start, i32 end, i32 chunkId) {
 #ifdef NNTYPE_RNN
     #ifdef CONF_DEBUG
-        rnnPropagate(nnets, nnetsCount, nnDef);
+        rnnPropagate(&nnets[start], end - start, nnDef);
     #else
-        rnnPropagateWide(nnets, nnetsCount, nnDef);
+        rnnPropagateWide(&nnets[start], end - start, nnDef);
     #endif
 #elif defined(NNTYPE_NN)
     #ifdef CONF_DEBUG
-        nnPropagate(nnets, nnetsCount, nnDef);
+        nnPropagate(&nnets[start], end - start, nnDef);
     #else
-        nnPropagate(nnets, nnetsCount, nnDef); // TODO: make wide
+        nnPropagate(&nnets[start], end - start, nnDef); // TODO: make wide
     #endif
 #endif
+    });
+    propagateZone.stop();
 
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
         f64 output[4];
         assert(arr_count(output) == nnDef.outputNeuronCount);
@@ -1023,39 +1452,62 @@ void updateNNs()
             frogInput[i].action = INPUT_ACTION_EAT;
         }
     }
+
+    scratchRewind(scratchStart);
 }
 
 void updatePhysics()
 {
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    PROFILE_ZONE("physics");
+    // jumping frogs, their direction is computed in batch
+    const i64 scratchStart = scratchMark();
+    f32* jumpCos = scratchArr<f32>(activeFrogCount);
+    f32* jumpSin = scratchArr<f32>(activeFrogCount);
+    i32* jumpFrogId = scratchArr<i32>(activeFrogCount);
+    i32 jumpCount = 0;
+
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
         if(frogInput[i].turn != 0.0) {
             frogAngle[i] = frogInput[i].turn;
         }
 
         if(frogIsJumping(i)) {
-            const f32 angle = frogAngle[i];
-            const Vec2 moveVec = vec2Make(cosf(angle) * FROG_SPEED * FRAME_DT,
-                                    sinf(angle) * FROG_SPEED * FRAME_DT);
-            frogPos[i] = vec2Add(&frogPos[i], &moveVec);
-
-            //frogPos[i].x = clampf64(frogPos[i].x, 0, MAP_WIDTH * TILE_SIZE - 1.0);
-            //frogPos[i].y = clampf64(frogPos[i].y, 0, MAP_HEIGHT * TILE_SIZE - 1.0);
+            jumpCos[jumpCount] = frogAngle[i];
+            jumpFrogId[jumpCount++] = i;
         }
     }
+
+    batchSinCos(jumpCos, jumpSin, jumpCos, jumpCount);
+
+    for(i32 j = 0; j < jumpCount; ++j) {
+        const i32 i = jumpFrogId[j];
+        const Vec2 moveVec = vec2Make(jumpCos[j] * FROG_SPEED * FRAME_DT,
+                                      jumpSin[j] * FROG_SPEED * FRAME_DT);
+        frogPos[i] = vec2Add(&frogPos[i], &moveVec);
+
+        //frogPos[i].x = clampf64(frogPos[i].x, 0, MAP_WIDTH * TILE_SIZE - 1.0);
+        //frogPos[i].y = clampf64(frogPos[i].y, 0, MAP_HEIGHT * TILE_SIZE - 1.0);
+    }
+
+    scratchRewind(scratchStart);
 }
 
-void updateMechanics()
+// returns true when every frog is dead
+bool updateMechanics()
 {
+    PROFILE_ZONE("mechanics");
     i32 frogRewards[FROG_COUNT] = {0};
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
 
         frogHydration[i] -= HYDRATION_DRAIN_PER_SEC * FRAME_DT;
         if(frogHydration[i] <= 0) {
             frogHydration[i] = 0;
-            frogDead[i] = true;
+            killFrog(i);
             curGenStats.deathsByDehydratation++;
 
             const i32 mx = frogPos[i].x / TILE_SIZE;
@@ -1067,7 +1519,8 @@ void updateMechanics()
         }
     }
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
 
         FrogInput& fi = frogInput[i];
@@ -1114,7 +1567,8 @@ void updateMechanics()
         }*/
     }
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
 
         if(frogEnergy[i] <= 0) {
@@ -1124,7 +1578,8 @@ void updateMechanics()
     }
 
     // recuperate energy while standing still
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
         if(!frogIsEating(i) && !frogIsJumping(i)) {
             frogEnergy[i] += ENERGY_REST_GAIN;
@@ -1132,7 +1587,8 @@ void updateMechanics()
     }
 
     u8 frogInWater[FROG_COUNT] = {0};
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
 
         i32 mx = frogPos[i].x / TILE_SIZE;
@@ -1146,28 +1602,28 @@ void updateMechanics()
         assert(mx >= 0 && mx < MAP_WIDTH);
         assert(my >= 0 && my < MAP_HEIGHT);
 
-        if(mapData[my * MAP_WIDTH + mx] == MAP_TILE_WATER) {
+        if(mapIsWater(mx, my)) {
             frogHydration[i] += HYDRATION_GAIN_PER_SEC * FRAME_DT;
             frogHydration[i] = min(frogHydration[i], HYDRATION_TOTAL);
             frogInWater[i] = true;
             frogRewards[i] += 10;
         }
-        /*else if(mapData[my * MAP_WIDTH + mx] == MAP_TILE_DEATH) {
+        /*else if(mapTile(mx, my) == MAP_TILE_DEATH) {
             frogDead[i] = true;
             curGenStats.deathsByBorder++;
         }*/
     }
 
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i] || frogInWater[i]) continue;
         if(frogClosestPondFactorOffsetSign[i] > 0) {
             frogRewards[i] += 1;
         }
     }
 
-    simulationTime += FRAME_DT;
-
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) continue;
 
         //frogFitness[i] += FRAME_DT;
@@ -1177,21 +1633,18 @@ void updateMechanics()
         //frogFitness[i] += (frogEnergy[i] / ENERGY_TOTAL) * 0.5;
         //frogFitness[i] += frogFliesEatenCount;
 
-        if(simulationTime >= SIMULATION_MAX_TIME) {
-            frogDead[i] = true;
+        frogAge[i] += FRAME_DT;
+        if(frogAge[i] >= SIMULATION_MAX_TIME) {
+            killFrog(i);
         }
     }
 
-    bool everyoneIsDead = true;
-    for(i32 i = 0; i < FROG_COUNT && everyoneIsDead; ++i) {
-        if(!frogDead[i]) {
-            everyoneIsDead = false;
-        }
-    }
+    const bool everyoneIsDead = aliveFrogCount == 0;
 
-    f64 maxFitness = 0.0;
-    f64 totalFitness = 0.0;
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    f64 maxFitness = inactiveFitnessMax;
+    f64 totalFitness = inactiveFitnessTotal;
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         totalFitness += frogFitness[i];
         if(frogFitness[i] > maxFitness) {
             maxFitness = frogFitness[i];
@@ -1201,12 +1654,10 @@ void updateMechanics()
     curGenStats.avgFitness = totalFitness / FROG_COUNT;
     curGenStats.maxFitness = maxFitness;
 
-    if(everyoneIsDead) {
-        newGeneration();
-    }
+    return everyoneIsDead;
 }
 
-void newGeneration()
+void pushGenerationStats()
 {
     lastGenStats = curGenStats;
     memmove(pastGenStats, pastGenStats+1, sizeof(pastGenStats) - sizeof(pastGenStats[0]));
@@ -1217,6 +1668,39 @@ void newGeneration()
 
     LOG("#%d maxFitness=%.5f avg=%.5f", generationNumber,
         lastGenStats.maxFitness, lastGenStats.avgFitness);
+}
+
+// the net of frogId is written out as C when it beats the last champion exported
+void exportChampion(i32 frogId)
+{
+    if(exportCGeneration >= 0 && frogFitness[frogId] <= exportCBestFitness) return;
+
+    PROFILE_ZONE("exportC");
+#ifdef NNTYPE_RNN
+    const bool exported = rnnExportC(exportCPath, curGenNN[frogId], nnDef);
+#elif defined(NNTYPE_NN)
+    const bool exported = nnExportC(exportCPath, curGenNN[frogId], nnDef);
+#endif
+    if(exported) {
+        exportCBestFitness = frogFitness[frogId];
+        exportCGeneration = generationNumber;
+        LOG("export> champion of generation #%d (fitness=%.5f)", generationNumber,
+            exportCBestFitness);
+    }
+}
+
+void newGeneration()
+{
+    PROFILE_ZONE("evolve");
+    pushGenerationStats();
+
+    if(exportCEnabled) {
+        i32 best = 0;
+        for(i32 i = 1; i < FROG_COUNT; ++i) {
+            if(frogFitness[i] > frogFitness[best]) best = i;
+        }
+        exportChampion(best);
+    }
 
 #ifdef NNTYPE_RNN
     rnnEvolve(&evolParams, true);
@@ -1224,23 +1708,161 @@ void newGeneration()
     nnEvolve(&evolParams, true);
 #endif
 
+    if(snapshotInterval > 0 && generationNumber % snapshotInterval == 0) {
+        writeSnapshot();
+    }
+
     if((generationNumber) % 10 == 0) {
         resetMap();
     }
     resetFrogs();
 }
 
+// steady state: the dead frogs and the worst frog evaluated long enough are replaced by
+// offspring of the frogs still running, the step loop never waits on the last survivors
+void replaceFrogs()
+{
+    PROFILE_ZONE("evolve");
+    i32 slots[FROG_COUNT];
+    i32 slotCount = 0;
+    f64 parentFitness[FROG_COUNT];
+    i32 worstId = -1;
+    f64 worstFitness = DBL_MAX;
+
+    for(i32 i = 0; i < FROG_COUNT; ++i) {
+        parentFitness[i] = 0.0;
+        if(frogDead[i]) {
+            slots[slotCount++] = i;
+            continue;
+        }
+        if(frogAge[i] < FROG_MIN_EVAL_TIME) continue;
+
+        // fitness accumulates over time, compare the rates
+        parentFitness[i] = frogFitness[i] / frogAge[i];
+        if(parentFitness[i] < worstFitness) {
+            worstFitness = parentFitness[i];
+            worstId = i;
+        }
+    }
+
+    if(worstId != -1) {
+        parentFitness[worstId] = 0.0;
+        slots[slotCount++] = worstId;
+        aliveFrogCount--;
+    }
+
+    if(slotCount == 0) return;
+
+    i32 bestRetired = slots[0];
+    for(i32 k = 0; k < slotCount; ++k) {
+        const i32 i = slots[k];
+        retiredFitnessTotal += frogFitness[i];
+        retiredFitnessMax = max(retiredFitnessMax, frogFitness[i]);
+        retiredCount++;
+        if(frogFitness[i] > frogFitness[bestRetired]) bestRetired = i;
+    }
+
+    // before its net is replaced
+    if(exportCEnabled) {
+        exportChampion(bestRetired);
+    }
+
+#ifdef NNTYPE_RNN
+    rnnReplaceWithOffspring(&evolParams, slots, slotCount, parentFitness);
+#elif defined(NNTYPE_NN)
+    nnReplaceWithOffspring(&evolParams, slots, slotCount, parentFitness);
+#endif
+
+    for(i32 k = 0; k < slotCount; ++k) {
+        spawnFrog(slots[k]);
+    }
+    aliveFrogCount += slotCount;
+
+    // frogs that died this frame are still listed, rebuild the list
+    activeFrogCount = 0;
+    for(i32 i = 0; i < FROG_COUNT; ++i) {
+        if(!frogDead[i]) {
+            activeFrogIds[activeFrogCount++] = i;
+        }
+    }
+
+    steadyBirthCount += slotCount;
+    if(steadyBirthCount >= FROG_COUNT) {
+        steadyBirthCount -= FROG_COUNT;
+
+        curGenStats.maxFitness = retiredFitnessMax;
+        curGenStats.avgFitness = retiredFitnessTotal / retiredCount;
+        retiredFitnessTotal = 0.0;
+        retiredFitnessMax = 0.0;
+        retiredCount = 0;
+        pushGenerationStats();
+
+        if(snapshotInterval > 0 && generationNumber % snapshotInterval == 0) {
+            writeSnapshot();
+        }
+
+        if((generationNumber) % 10 == 0) {
+            resetMap();
+        }
+    }
+}
+
+void killFrog(i32 frogId)
+{
+    assert(!frogDead[frogId]);
+    frogDead[frogId] = true;
+    aliveFrogCount--;
+}
+
+// drop the frogs that died last frame, dead frogs don't move or score anymore
+// done at the start of a frame so the render side still sees the frogs that just died
+void compactActiveFrogs()
+{
+    i32 count = 0;
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
+        if(frogDead[i]) {
+            // in steady state there is no generation to reset them, replaceFrogs counts
+            // the retired frogs instead
+            if(!steadyState) {
+                inactiveFitnessTotal += frogFitness[i];
+                inactiveFitnessMax = max(inactiveFitnessMax, frogFitness[i]);
+            }
+            continue;
+        }
+        activeFrogIds[count++] = i;
+    }
+    activeFrogCount = count;
+}
+
+// one simulation frame, shared by the window and headless loops
+void step()
+{
+    compactActiveFrogs();
+    updateNNs();
+    const bool everyoneIsDead = updateMechanics();
+    if(steadyState) {
+        if(++steadyFrameCount % STEADY_STATE_INTERVAL == 0) {
+            replaceFrogs();
+        }
+    }
+    else if(everyoneIsDead) {
+        newGeneration();
+    }
+    updatePhysics();
+}
+
+#ifndef HEADLESS
 void newFrame()
 {
     doUI();
 
     updateCamera();
-    updateNNs();
-    updateMechanics();
-    updatePhysics();
+    step();
 
     // assign frog sprite
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         if(frogDead[i]) {
             frogTexId[i] = FROG_TEX_DEAD;
             continue;
@@ -1258,7 +1880,8 @@ void newFrame()
     }
 
     // frog transforms
-    for(i32 i = 0; i < FROG_COUNT; ++i) {
+    for(i32 k = 0; k < activeFrogCount; ++k) {
+        const i32 i = activeFrogIds[k];
         frogTf[i].pos = frogPos[i];
         frogTf[i].rot = frogAngle[i] + PI * 0.5;
 
@@ -1284,6 +1907,11 @@ void newFrame()
 
 void render()
 {
+    PROFILE_ZONE("render");
+    if(mapTexturesDirty) {
+        updateMapTextures();
+    }
+
     glClear(GL_COLOR_BUFFER_BIT);
 
     Transform mapTf = {};
@@ -1397,9 +2025,47 @@ void render()
 
     imguiRender();
 }
+#endif
 
 };
 
+#ifdef HEADLESS
+// usage: frogs_app_headless [generation count] [thread count] [steady state (0/1)]
+i32 main(i32 argc, char** argv)
+{
+    LOG("Frogs [NN] headless");
+
+    timeInit();
+    traceStartFromEnv();
+    randSetSeed(randDefaultSeed());
+
+    i32 maxGenerations = 0;
+    if(argc > 1) {
+        maxGenerations = atoi(argv[1]);
+    }
+
+    i32 threadCount = 0;
+    if(argc > 2) {
+        threadCount = atoi(argv[2]);
+    }
+    threadPoolInit(threadCount);
+
+    App app;
+
+    if(!app.init()) {
+        return 1;
+    }
+
+    if(argc > 3) {
+        app.steadyState = atoi(argv[3]) != 0;
+    }
+
+    app.runHeadless(maxGenerations);
+    app.cleanup();
+    threadPoolShutdown();
+    return 0;
+}
+#else
 #ifdef _WIN32
 int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 #else
@@ -1415,7 +2081,8 @@ i32 main()
     LOG("\n");
 
     timeInit();
-    randSetSeed(time(NULL));
+    traceStartFromEnv();
+    randSetSeed(randDefaultSeed());
 
 
 #ifdef CONF_DEBUG
@@ -1434,6 +2101,8 @@ i32 main()
         return 1;
     }
 
+    threadPoolInit(0);
+
     App app;
 
     if(!app.init()) {
@@ -1443,6 +2112,8 @@ i32 main()
     app.run();
 
     app.cleanup();
+    threadPoolShutdown();
     SDL_Quit();
     return 0;
 }
+#endif
@@ -1,19 +1,25 @@
 #include "base.h"
+#ifndef HEADLESS
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
 #include <gl3w.h>
+#endif
 #include <stdlib.h>
 #include <float.h>
+#include <emmintrin.h>
 #include <assert.h>
 
-#include "window.h"
 #include "sprite.h"
 #include "neat.h"
+#ifndef HEADLESS
+#include "window.h"
 #include "neat_imgui.h"
+#include "profile_imgui.h"
 #include "imgui/imgui.h"
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include "imgui/imgui_internal.h"
 #include "imgui/imgui_sdl2_setup.h"
+#endif
 
 #define WINDOW_WIDTH 1600
 #define WINDOW_HEIGHT 900
@@ -90,9 +96,16 @@ struct WaterSensors
     f32 sens[4];
 };
 
+// snapshot sections of the app, next to the population (index 0)
+#define APP_SNAPSHOT_KIND 0x4e474f46 // "FOGN"
+#define APP_SNAPSHOT_STATE (SNAPSHOT_SECTION_USER + 0)
+#define APP_SNAPSHOT_PAST_STATS (SNAPSHOT_SECTION_USER + 1)
+
 struct App {
 
+#ifndef HEADLESS
 AppWindow window;
+#endif
 i32 timeScale = 1;
 
 f32 viewZoom = 5.0f;
@@ -102,10 +115,13 @@ u8 mouseRightButDown;
 
 u8 mapData[MAP_SIZE];
 f32 mapAvgWater[MAP_WATER_AVG_SIZE];
+#ifndef HEADLESS
 u32 mapTextureData[MAP_SIZE];
 u32 mapAvgWaterTextureData[MAP_WATER_AVG_SIZE];
 u32 tex_map;
 u32 tex_mapAvgWater;
+bool mapTexturesDirty = true; // map changed, re-upload textures on next render
+#endif
 
 i32 pondPos[MAP_POND_MAX_COUNT];
 i32 pondRadius[MAP_POND_MAX_COUNT];
@@ -137,7 +153,7 @@ NeatSpeciation neatSpec;
 
 Genome* frogCurGen[FROG_COUNT];
 Genome* frogNextGen[FROG_COUNT];
-NeatNN* frogNN[FROG_COUNT];
+NeatNN* frogNN[FROG_COUNT] = {0};
 i32 generationNumber = 0;
 
 f32 simulationTime = 0;
@@ -160,8 +176,24 @@ GenerationStats curGenStats;
 GenerationStats lastGenStats;
 GenerationStats pastGenStats[STATS_HISTORY_COUNT];
 
+struct SnapshotState {
+    i32 generationNumber;
+    GenerationStats curGenStats;
+    GenerationStats lastGenStats;
+};
+
+SnapshotWriter snapshotWriter;
+char snapshotPath[256];
+i32 snapshotInterval = 0; // generations, 0: no snapshots
+
+char exportCPath[256];
+bool exportCEnabled = false;
+f64 exportCBestFitness = 0.0; // of the last champion exported
+i32 exportCGeneration = -1;
+
 bool init()
 {
+#ifndef HEADLESS
     if(!window.init("Frogs [NEAT]", "frogs_neat_imgui.ini")) {
         return false;
     }
@@ -181,6 +213,7 @@ bool init()
 
     glGenTextures(1, &tex_map);
     glGenTextures(1, &tex_mapAvgWater);
+#endif
 
     resetMap();
     resetFrogColors();
@@ -197,16 +230,112 @@ bool init()
     neatGenomeAlloc(frogNextGen, FROG_COUNT);
     resetSimulation();
 
+    if(snapshotConfigFromEnv(snapshotPath, sizeof(snapshotPath), &snapshotInterval)) {
+        loadSnapshot();
+    }
+    exportCEnabled = exportCConfigFromEnv(exportCPath, sizeof(exportCPath));
+
+    return true;
+}
+
+// the population is written right after its evolution
+void writeSnapshot()
+{
+    PROFILE_ZONE("snapshot");
+    snapshotBegin(&snapshotWriter, APP_SNAPSHOT_KIND);
+
+    const SnapshotState state = { generationNumber, curGenStats, lastGenStats };
+    snapshotAdd(&snapshotWriter, APP_SNAPSHOT_STATE, 0, &state, sizeof(state), 1);
+    snapshotAdd(&snapshotWriter, APP_SNAPSHOT_PAST_STATS, 0, pastGenStats, sizeof(pastGenStats[0]),
+                STATS_HISTORY_COUNT);
+    neatSnapshotAdd(&snapshotWriter, 0, frogCurGen, FROG_COUNT, neatSpec);
+
+    snapshotWriteAsync(&snapshotWriter, snapshotPath);
+}
+
+// after resetSimulation()
+bool loadSnapshot()
+{
+    Snapshot snap;
+    if(!snapshotOpen(&snap, snapshotPath, APP_SNAPSHOT_KIND)) {
+        return false;
+    }
+
+    const timept t0 = timeGet();
+    const SnapshotState* state = snapshotArrExact<SnapshotState>(snap, APP_SNAPSHOT_STATE, 0, 1);
+    const GenerationStats* pastStats = snapshotArrExact<GenerationStats>(snap, APP_SNAPSHOT_PAST_STATS,
+                                                                         0, STATS_HISTORY_COUNT);
+    if(!state || !pastStats ||
+       !neatSnapshotRestore(snap, 0, frogCurGen, FROG_COUNT, &neatSpec)) {
+        LOG("ERROR: snapshot> could not resume from %s, starting over", snapshotPath);
+        snapshotClose(&snap);
+        resetSimulation();
+        return false;
+    }
+
+    generationNumber = state->generationNumber;
+    curGenStats = state->curGenStats;
+    lastGenStats = state->lastGenStats;
+    memmove(pastGenStats, pastStats, sizeof(pastGenStats));
+    snapshotClose(&snap);
+
+    neatNnDealloc(frogNN);
+    neatGenomeAllocMakeNN(frogCurGen, FROG_COUNT, frogNN);
+    neatGenomeComputeNodePos(frogCurGen, FROG_COUNT);
+
+    LOG("snapshot> resumed from %s at generation %d (%.3fms)", snapshotPath, generationNumber,
+        timeToMicrosec(timeGet() - t0) / 1000.0);
     return true;
 }
 
 void cleanup()
 {
+    snapshotWait(&snapshotWriter);
     neatGenomeDealloc(frogCurGen);
     neatGenomeDealloc(frogNextGen);
     neatNnDealloc(frogNN);
 }
 
+#ifdef HEADLESS
+// step the simulation as fast as possible, no window or rendering
+// maxGenerations <= 0 runs forever
+void runHeadless(i32 maxGenerations)
+{
+    const i64 reportIntervalMicro = 5000000;
+    const timept startTime = timeGet();
+    const i32 startGenNumber = generationNumber;
+    timept reportTime = startTime;
+    i32 reportGenNumber = generationNumber;
+    i64 totalFrameCount = 0;
+    profileResetTotals();
+
+    while(maxGenerations <= 0 || generationNumber - startGenNumber < maxGenerations) {
+        step();
+        profileFrameEnd();
+
+        const i64 reportDelta = timeToMicrosec(timeGet() - reportTime);
+        if(reportDelta >= reportIntervalMicro) {
+            const f64 sec = reportDelta / 1000000.0;
+            const i32 genCount = generationNumber - reportGenNumber;
+            const i64 frameCount = profileTotals().frameCount;
+            LOG("headless> gen=%d fps=%.0f gen/s=%.3f", generationNumber, frameCount / sec, genCount / sec);
+            profileLogTotals("headless>");
+
+            totalFrameCount += frameCount;
+            profileResetTotals();
+            reportTime = timeGet();
+            reportGenNumber = generationNumber;
+        }
+    }
+
+    totalFrameCount += profileTotals().frameCount;
+    const f64 totalSec = timeToMicrosec(timeGet() - startTime) / 1000000.0;
+    const i32 totalGenCount = generationNumber - startGenNumber;
+    LOG("headless> done: %d generations, %lld frames in %.2fs (fps=%.0f gen/s=%.3f)",
+        totalGenCount, (long long)totalFrameCount, totalSec,
+        totalFrameCount / totalSec, totalGenCount / totalSec);
+}
+#else
 void run()
 {
     while(window.running) {
@@ -223,6 +352,7 @@ void run()
         newFrame();
         render();
         window.swap();
+        profileFrameEnd();
 
         const i64 frameDtMicro = FRAME_DT/timeScale * 1000000;
         while(((frameDtMicro - timeToMicrosec(timeGet() - t0)) / 1000) > 1) {
@@ -325,21 +455,14 @@ void updateCamera()
 
     setView(viewX, viewY, WINDOW_WIDTH*viewZoom, WINDOW_HEIGHT*viewZoom);
 }
-
-inline u32 noiseColor(Color3 baseColor, u8 variance)
-{
-    u8 r = clamp((i32)baseColor.r + (i32)randi64(-variance, variance), 0, 0xff);
-    u8 g = clamp((i32)baseColor.g + (i32)randi64(-variance, variance), 0, 0xff);
-    u8 b = clamp((i32)baseColor.b + (i32)randi64(-variance, variance), 0, 0xff);
-    return (0xff000000 | (b << 16) | (g << 8) | r);
-}
+#endif
 
 void resetMap()
 {
     memset(mapData, MAP_TILE_GRASS, sizeof(mapData));
 
     for(i32 i = 0; i < pondCount; ++i) {
-        pondPos[i] = xorshift64star() % MAP_SIZE;
+        pondPos[i] = randBelow(MAP_SIZE);
         pondRadius[i] = randi64(MAP_POND_MIN_RADIUS, MAP_POND_MAX_RADIUS);
         //LOG("pond#%d pos=%d radius=%d", i, pondPos[i], pondRadius[i]);
     }
@@ -388,6 +511,23 @@ void resetMap()
         mapAvgWater[i] /= (f32)MAP_WATER_AVG_GRID_SIZE * MAP_WATER_AVG_GRID_SIZE;
     }
 
+#ifndef HEADLESS
+    mapTexturesDirty = true;
+#endif
+}
+
+#ifndef HEADLESS
+inline u32 noiseColor(Color3 baseColor, u8 variance)
+{
+    u8 r = clamp((i32)baseColor.r + (i32)randi64(-variance, variance), 0, 0xff);
+    u8 g = clamp((i32)baseColor.g + (i32)randi64(-variance, variance), 0, 0xff);
+    u8 b = clamp((i32)baseColor.b + (i32)randi64(-variance, variance), 0, 0xff);
+    return (0xff000000 | (b << 16) | (g << 8) | r);
+}
+
+// render side: build and upload map textures from mapData/mapAvgWater
+void updateMapTextures()
+{
     const Color3 grassColor = {10, 50, 0};
     const Color3 waterColor = {0, 157, 255};
     const Color3 deathColor = {0, 0, 0};
@@ -438,7 +578,10 @@ void resetMap()
                  GL_RGBA,
                  GL_UNSIGNED_BYTE,
                  mapAvgWaterTextureData);
+
+    mapTexturesDirty = false;
 }
+#endif
 
 void resetFrogColors()
 {
@@ -448,9 +591,9 @@ void resetFrogColors()
 
     for(i32 i = 0; i < FROG_COUNT; ++i) {
         Color3 c;
-        c.r = (xorshift64star() % colorDelta) + colorMin;
-        c.g = (xorshift64star() % colorDelta) + colorMin;
-        c.b = (xorshift64star() % colorDelta) + colorMin;
+        c.r = randBelow(colorDelta) + colorMin;
+        c.g = randBelow(colorDelta) + colorMin;
+        c.b = randBelow(colorDelta) + colorMin;
         speciesColor[i] = c;
     }
 }
@@ -504,6 +647,7 @@ void resetSimulation()
     neatGenomeComputeNodePos(frogCurGen, FROG_COUNT);
 }
 
+#ifndef HEADLESS
 void ImGui_ColoredRect(const ImVec2& size, const ImVec4& color)
 {
     ImGuiWindow* window = ImGui::GetCurrentWindow();
@@ -726,12 +870,16 @@ void doUI()
     ui_frogViewer();
     ui_speciation();
     ui_lastGeneration();
+    ImGui_ProfileWindow();
 
     //ImGui::ShowDemoWindow();
 }
+#endif
 
 void updateNNs()
 {
+    PROFILE_ZONE("updateNNs");
+    PROFILE_SCOPE(inputZone, "nnInputs");
     NeatNN* nnets[FROG_COUNT];
     i32 nnetsCount = 0;
     //const f32 waterSmellSquareCount = VISION_WIDTH * VISION_WIDTH * 0.25;
@@ -909,8 +1057,14 @@ void updateNNs()
 
         nnets[nnetsCount++] = frogNN[i];
     }
+    inputZone.stop();
 
-    neatNnPropagate(nnets, nnetsCount);
+    {
+        PROFILE_ZONE("propagate");
+        parallelFor(nnetsCount, [&](i32 start, i32 end, i32 chunkId) {
+            neatNnPropagate(&nnets[start], end - start);
+        });
+    }
 
     const i32 firstOutputId = frogCurGen[0]->inputNodeCount;
     const i32 outputCount = frogCurGen[0]->outputNodeCount;
@@ -937,6 +1091,7 @@ void updateNNs()
 
 void updatePhysics()
 {
+    PROFILE_ZONE("physics");
     for(i32 i = 0; i < FROG_COUNT; ++i) {
         if(frogDead[i]) continue;
         frogAngle[i] = frogInput[i].angle;
@@ -958,8 +1113,10 @@ void updatePhysics()
     }
 }
 
-void updateMechanics()
+// returns true when every frog is dead
+bool updateMechanics()
 {
+    PROFILE_ZONE("mechanics");
     i32 frogRewards[FROG_COUNT] = {0};
 
     for(i32 i = 0; i < FROG_COUNT; ++i) {
@@ -1071,13 +1228,30 @@ void updateMechanics()
     curGenStats.avgFitness = totalFitness / FROG_COUNT;
     curGenStats.maxFitness = maxFitness;
 
-    if(everyoneIsDead) {
-        nexGeneration();
+    return everyoneIsDead;
+}
+
+// the best genome of the generation is written out as C when it beats the last one exported
+void exportChampion()
+{
+    i32 best = 0;
+    for(i32 i = 1; i < FROG_COUNT; ++i) {
+        if(frogFitness[i] > frogFitness[best]) best = i;
+    }
+    if(exportCGeneration >= 0 && frogFitness[best] <= exportCBestFitness) return;
+
+    PROFILE_ZONE("exportC");
+    if(neatExportC(exportCPath, frogCurGen[best])) {
+        exportCBestFitness = frogFitness[best];
+        exportCGeneration = lastGenStats.number;
+        LOG("export> champion of generation #%d (fitness=%.5f)", lastGenStats.number,
+            exportCBestFitness);
     }
 }
 
 void nexGeneration()
 {
+    PROFILE_ZONE("evolve");
     lastGenStats = curGenStats;
     memmove(pastGenStats, pastGenStats+1, sizeof(pastGenStats) - sizeof(pastGenStats[0]));
     pastGenStats[STATS_HISTORY_COUNT-1] = lastGenStats;
@@ -1088,6 +1262,10 @@ void nexGeneration()
     LOG("#%d maxFitness=%.5f avg=%.5f", lastGenStats.number, lastGenStats.maxFitness,
         lastGenStats.avgFitness);
 
+    if(exportCEnabled) {
+        exportChampion();
+    }
+
     neatEvolve(frogCurGen, frogNextGen, frogFitness, FROG_COUNT, &neatSpec, evolParam, true);
 
     neatNnDealloc(frogNN);
@@ -1095,18 +1273,32 @@ void nexGeneration()
 
     neatGenomeComputeNodePos(frogCurGen, FROG_COUNT);
 
+    if(snapshotInterval > 0 && generationNumber % snapshotInterval == 0) {
+        writeSnapshot();
+    }
+
     resetMap();
     resetFrogs();
 }
 
+// one simulation frame, shared by the window and headless loops
+void step()
+{
+    updateNNs();
+    updatePhysics();
+    const bool everyoneIsDead = updateMechanics();
+    if(everyoneIsDead) {
+        nexGeneration();
+    }
+}
+
+#ifndef HEADLESS
 void newFrame()
 {
     window.uiNewFrame();
     doUI();
 
-    updateNNs();
-    updatePhysics();
-    updateMechanics();
+    step();
 
     // assign frog sprite
     for(i32 i = 0; i < FROG_COUNT; ++i) {
@@ -1157,6 +1349,11 @@ void newFrame()
 
 void render()
 {
+    PROFILE_ZONE("render");
+    if(mapTexturesDirty) {
+        updateMapTextures();
+    }
+
     glClear(GL_COLOR_BUFFER_BIT);
 
 #if 0
@@ -1306,9 +1503,43 @@ void render()
 
     window.uiRender();
 }
+#endif
 
 };
 
+#ifdef HEADLESS
+// usage: frogs_neat_headless [generation count] [thread count]
+i32 main(i32 argc, char** argv)
+{
+    LOG("Frogs [NEAT] headless");
+
+    timeInit();
+    traceStartFromEnv();
+    randSetSeed(randDefaultSeed());
+
+    i32 maxGenerations = 0;
+    if(argc > 1) {
+        maxGenerations = atoi(argv[1]);
+    }
+
+    i32 threadCount = 0;
+    if(argc > 2) {
+        threadCount = atoi(argv[2]);
+    }
+    threadPoolInit(threadCount);
+
+    App app;
+
+    if(!app.init()) {
+        return 1;
+    }
+
+    app.runHeadless(maxGenerations);
+    app.cleanup();
+    threadPoolShutdown();
+    return 0;
+}
+#else
 #ifdef _WIN32
 int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 #else
@@ -1324,7 +1555,8 @@ i32 main()
     LOG("\n");
 
     timeInit();
-    randSetSeed(time(NULL));
+    traceStartFromEnv();
+    randSetSeed(randDefaultSeed());
 
     SDL_SetMainReady();
     i32 sdl = SDL_Init(SDL_INIT_VIDEO);
@@ -1333,6 +1565,8 @@ i32 main()
         return 1;
     }
 
+    threadPoolInit(0);
+
     App app;
 
     if(!app.init()) {
@@ -1342,6 +1576,8 @@ i32 main()
     app.run();
 
     app.cleanup();
+    threadPoolShutdown();
     SDL_Quit();
     return 0;
 }
+#endif
@@ -6,6 +6,9 @@
 #include <malloc.h>
 
 #define activation(x) tanh(x)
+
+// offspring and speciation are split finer than the thread count, their cost varies per genome
+#define EVOLVE_CHUNK_COUNT 64
 //#define activation(x) (1.0/(1.0+exp(-4.9*x)))
 
 NeatSpeciation::~NeatSpeciation()
@@ -15,7 +18,8 @@ NeatSpeciation::~NeatSpeciation()
     }
 }
 
-static i32 g_innovationNumber = 0;
+// shared by every population so innovation numbers stay unique across islands
+static std::atomic<i32> g_innovationNumber{0};
 
 // geneCount -> larger genome geneCount
 static f64 compatibilityDistance(const Gene* genes1, const Gene* genes2, i32 geneCount1, i32 geneCount2,
@@ -48,11 +52,14 @@ static f64 compatibilityDistance(const Gene* genes1, const Gene* genes2, i32 gen
     f64 totalWeightDiff = 0.0;
     i32 matches = 0;
 
-    u8* resultL = stack_arr(u8,geneCountL);
-    u8* resultS = stack_arr(u8,geneCountS);
+    const i64 scratchStart = scratchMark();
+    const i64 resultCountL = max(geneCountL, 0);
+    const i64 resultCountS = max(geneCountS, 0);
+    u8* resultL = scratchArr<u8>(resultCountL);
+    u8* resultS = scratchArr<u8>(resultCountS);
     // DISJOINT by default
-    memset(resultL, 0, geneCountL);
-    memset(resultS, 0, geneCountS);
+    memset(resultL, 0, resultCountL);
+    memset(resultS, 0, resultCountS);
 
     enum {
         DISJOINT=0,
@@ -100,6 +107,7 @@ static f64 compatibilityDistance(const Gene* genes1, const Gene* genes2, i32 gen
         if(resultS[s] == DISJOINT) disjoint++;
         else if(resultS[s] == EXCESS) excess++;
     }
+    scratchRewind(scratchStart);
 
     f64 avgWeightDiff = totalWeightDiff / matches;
 
@@ -145,10 +153,14 @@ void neatGenomeInit(Genome** genomes, const i32 popCount, i32 inputCount, i32 ou
             g.nodeOriginMarker[n] = n;
         }
 
+        f64 weights[NEAT_MAX_GENES];
+        assert(inputCount * outputCount <= NEAT_MAX_GENES);
+        randFillF64(weights, inputCount * outputCount, -1.0, 1.0);
+
         for(i16 in = 0; in < inputCount; ++in) {
             for(i16 out = 0; out < outputCount; ++out) {
                 i32 gid = g.geneCount++;
-                g.genes[gid] = { gid, in, (i16)(inputCount + out), randf64(-1.0, 1.0) };
+                g.genes[gid] = { gid, in, (i16)(inputCount + out), weights[gid] };
             }
         }
     }
@@ -211,8 +223,9 @@ i32 compareNeatNNComputations(void const* a, void const* b)
 static void sortComputationsByDependency(NeatNN::Computation* computations, const i32 compCount,
                                          i16 firstOutNode, i16 lastOutNodePlusOne, const i32 nodeCount)
 {
-    i16* dependList = stack_arr(i16,nodeCount);
-    i16* nextDependList = stack_arr(i16,nodeCount);
+    const i64 scratchStart = scratchMark();
+    i16* dependList = scratchArr<i16>(nodeCount);
+    i16* nextDependList = scratchArr<i16>(nodeCount);
     i32 nextDependListCount = 0;
     i32 sortCompCount = compCount;
 
@@ -290,6 +303,8 @@ static void sortComputationsByDependency(NeatNN::Computation* computations, cons
             }
         }
     }
+
+    scratchRewind(scratchStart);
 }
 
 static void sortGenesByHistoricalMarker(Genome* genome)
@@ -320,6 +335,7 @@ static void sortGenesByHistoricalMarker(Genome* genome)
 
 void neatGenomeAllocMakeNN(Genome** genomes, const i32 count, NeatNN** nn, bool verbose)
 {
+    PROFILE_ZONE("nnCompile");
     i64 blockSize = 0;
 
     i32 nnSize[2048];
@@ -439,10 +455,11 @@ struct StructuralConnection
     i32 nodeOutMarker;
 };
 
-i32 g_innNumPool[2048];
-StructuralConnection g_posPool[2048];
-i32 g_structPoolCount;
-i32 g_structMatchesFound;
+// structural changes of the generation being evolved, per thread
+static thread_local i32 g_innNumPool[2048];
+static thread_local StructuralConnection g_posPool[2048];
+static thread_local i32 g_structPoolCount;
+static thread_local i32 g_structMatchesFound;
 
 static void resetStructuralChanges()
 {
@@ -472,7 +489,7 @@ static i32 newInnovationNumber(i16 nodeIn, i16 nodeOut, const i32* nodeOrignMark
     }
 
     if(innovationNumber == -1) {
-        innovationNumber = g_innovationNumber++;
+        innovationNumber = g_innovationNumber.fetch_add(1);
     }
 
     assert(poolCount2 < 2048);
@@ -656,8 +673,9 @@ static void rnnCrossover(Genome* dest, const Genome* parentA, const Genome* pare
     i16 checkNodeIn = -1;
     i16 checkNodeOut = -1;
     i32 sameConnCount = 0;
-    Gene* genesPurged = stack_arr(Gene,geneCountOut2);
-    u8* genesPurgedDisabled = stack_arr(u8,geneCountOut2);
+    const i64 scratchStart = scratchMark();
+    Gene* genesPurged = scratchArr<Gene>(geneCountOut2);
+    u8* genesPurgedDisabled = scratchArr<u8>(geneCountOut2);
     i32 genesPurgedCount = 0;
 
     for(i32 i = 0; i < geneCountOut2; ++i) {
@@ -680,6 +698,7 @@ static void rnnCrossover(Genome* dest, const Genome* parentA, const Genome* pare
 
     memmove(genesOut, genesPurged, sizeof(genesOut[0]) * genesPurgedCount);
     const i32 geneOutCountFinal = genesPurgedCount;
+    scratchRewind(scratchStart);
 
     // reconstruct metadata
     const i32 inputCount = parentA->inputNodeCount;
@@ -717,6 +736,9 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
 
     timept t0 = timeGet();
 
+    // temporary arrays of this generation, released together at the end
+    const i64 scratchStart = scratchMark();
+
     f64 speciesMaxFitness[NEAT_MAX_SPECIES];
     i32* speciesPopCount = neatSpec->speciesPopCount;
     i32& speciesCount = neatSpec->speciesCount;
@@ -728,7 +750,8 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
     }
 
     // species stagnation
-    u8* deleteSpecies = stack_arr(u8,speciesCount);
+    PROFILE_SCOPE(stagnationZone, "stagnation");
+    u8* deleteSpecies = scratchArr<u8>(speciesCount);
     const i32 stagnationT = params.speciesStagnationMax;
     u16* specStagnation = neatSpec->stagnation;
     f64* specStagMaxFitness = neatSpec->maxFitness;
@@ -763,9 +786,11 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
     assert(bestSpecies != -1);
     deleteSpecies[bestSpecies] = false;
     specStagnation[bestSpecies] = 0;
+    stagnationZone.stop();
 
 #if 1
-    FitnessPair* fpair = stack_arr(FitnessPair,popCount);
+    PROFILE_SCOPE(selectionZone, "selection");
+    FitnessPair* fpair = scratchArr<FitnessPair>(popCount);
     for(i32 i = 0; i < popCount; ++i) {
         fpair[i] = { i, genomes[i]->species, fitness[i] };
     }
@@ -773,12 +798,12 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
     qsort(fpair, popCount, sizeof(FitnessPair), compareFitnessDesc);
 
     // eliminate worst half of each species
-    i32* speciesPopCountHalf = stack_arr(i32,speciesCount);
+    i32* speciesPopCountHalf = scratchArr<i32>(speciesCount);
     for(i32 s = 0; s < speciesCount; ++s) {
         speciesPopCountHalf[s] = max(speciesPopCount[s] / 2, 1);
     }
 
-    f64* parentFitness = stack_arr(f64,popCount);
+    f64* parentFitness = scratchArr<f64>(popCount);
     i32 parentCount = 0;
     i32 curSpecies = genomes[fpair[0].id]->species;
     i32 curSpeciesPopCount = 0;
@@ -838,27 +863,35 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
     const i32 popCountMinusChamps = popCount - championCount;
 
     // fitness sharing
-    f64* normFitness = stack_arr(f64,parentCount);
+    f64* normFitness = scratchArr<f64>(parentCount);
     f64 totalNormFitness = 0.0;
     for(i32 i = 0; i < parentCount; ++i) {
         normFitness[i] = parentFitness[i] / speciesPopCount[genomes[i]->species];
         totalNormFitness += normFitness[i];
     }
 
+    selectionZone.stop();
+
     // crossover
+    // parents are picked in order from the evolution stream, the children are then made in
+    // parallel, each one drawing from its own stream so the result doesn't depend on the thread count
+    PROFILE_SCOPE(crossoverZone, "crossover");
     i32 noMatesFoundCount = 0;
-    Genome** potentialMates = stack_arr(Genome*,parentCount);
-    f64* pmFitness = stack_arr(f64,parentCount);
+    Genome** potentialMates = scratchArr<Genome*>(parentCount);
+    f64* pmFitness = scratchArr<f64>(parentCount);
+    const Genome** childParentA = scratchArr<const Genome*>(popCountMinusChamps);
+    const Genome** childParentB = scratchArr<const Genome*>(popCountMinusChamps); // null: copy of A
 
     for(i32 i = 0; i < popCountMinusChamps; ++i) {
         //const i32 idA = randi64(0, parentCount-1);
         const i32 idA = selectRoulette(parentCount, normFitness, totalNormFitness);
         const Genome* mateA = genomes[idA];
         const i32 speciesA = mateA->species;
+        childParentA[i] = mateA;
+        childParentB[i] = nullptr;
 
         // no crossover
         if(randf64(0.0, 1.0) < 0.25) {
-            memmove(nextGenomes[i], mateA, sizeof(Genome));
             continue;
         }
 
@@ -879,32 +912,48 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
 
         if(potentialMatesCount < 1) {
             noMatesFoundCount++;
-            memmove(nextGenomes[i], mateA, sizeof(Genome));
         }
         else {
             const i32 idB = selectRoulette(potentialMatesCount, pmFitness, pmTotalFitness);
             const Genome* mateB = potentialMates[idB];
 
             // parentA is the most fit
-            const Genome* parentA = mateA;
-            const Genome* parentB = mateB;
             if(normFitness[idA] < normFitness[idB]) {
-                parentA = mateB;
-                parentB = mateA;
+                childParentA[i] = mateB;
+                childParentB[i] = mateA;
+            }
+            else {
+                childParentB[i] = mateB;
             }
-            rnnCrossover(nextGenomes[i], parentA, parentB);
         }
     }
 
-    for(i32 i = 0; i < popCount; ++i) {
-        sortGenesByHistoricalMarker(nextGenomes[i]);
-    }
+    const u64 childStreamKey = randu64();
+    parallelForChunks(popCount, EVOLVE_CHUNK_COUNT, [&](i32 start, i32 end, i32 chunkId) {
+        for(i32 i = start; i < end; ++i) {
+            // champions are already in place
+            if(i < popCountMinusChamps) {
+                if(childParentB[i]) {
+                    RandStream stream;
+                    randStreamSeed(&stream, childStreamKey, i);
+                    RandStreamScope streamScope(&stream);
+                    rnnCrossover(nextGenomes[i], childParentA[i], childParentB[i]);
+                }
+                else {
+                    memmove(nextGenomes[i], childParentA[i], sizeof(Genome));
+                }
+            }
+            sortGenesByHistoricalMarker(nextGenomes[i]);
+        }
+    });
 
     if(verbose) LOG("NEAT> noMatesFoundCount=%d", noMatesFoundCount);
+    crossoverZone.stop();
 #endif
 
 #if 1
     // Mutation
+    PROFILE_SCOPE(mutationZone, "mutation");
 
     // save this evolution pass structural changes and use it to check if
     // a new structural change has already been assigned an innovation number
@@ -915,19 +964,43 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
     i32 mutGenesDisabled = 0;
     i32 mutGenesRemoved = 0;
 
+    // sample each mutation type for the whole population up front (one pass per type,
+    // skipping ahead between events), then only visit the genomes that got one
+    enum {
+        MUTATE_DISABLE_GENE = 0x1,
+        MUTATE_REMOVE_GENE = 0x2,
+        MUTATE_WEIGHT = 0x4,
+        MUTATE_ADD_CONN = 0x8,
+        MUTATE_ADD_NODE = 0x10,
+    };
+
+    const f64 mutateChance[] = { params.mutateDisableGene, params.mutateRemoveGene,
+                                 params.mutateWeight, params.mutateAddConn, params.mutateAddNode };
+    u8* mutateFlags = scratchArr<u8>(popCountMinusChamps);
+    i32* eventIds = scratchArr<i32>(popCountMinusChamps);
+    arr_zero(mutateFlags, popCountMinusChamps);
+
+    for(i32 t = 0; t < (i32)arr_count(mutateChance); ++t) {
+        const i32 eventCount = randSampleEvents(eventIds, popCountMinusChamps, mutateChance[t]);
+        for(i32 e = 0; e < eventCount; ++e) {
+            mutateFlags[eventIds[e]] |= 1 << t;
+        }
+    }
+
     for(i32 i = 0; i < popCountMinusChamps; ++i) {
+        const u8 flags = mutateFlags[i];
+        if(!flags) continue;
         Genome& g = *nextGenomes[i];
-        //Genome& g = *genomes[i];
 
         // disable gene
-        if(randf64(0.0, 1.0) < params.mutateDisableGene) {
+        if(flags & MUTATE_DISABLE_GENE) {
             const i32 gid = randi64(0, g.geneCount-1);
             g.geneDisabled[gid] = true;
             mutGenesDisabled++;
         }
 
         // remove gene
-        if(randf64(0.0, 1.0) < params.mutateRemoveGene) {
+        if(flags & MUTATE_REMOVE_GENE) {
             assert(g.geneCount > 1);
             const i32 gid = randi64(0, g.geneCount-1);
             g.genes[gid] = g.genes[g.geneCount-1];
@@ -937,7 +1010,7 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
         }
 
         // change weight
-        if(randf64(0.0, 1.0) < params.mutateWeight) {
+        if(flags & MUTATE_WEIGHT) {
             i32 gid = randi64(0, g.geneCount-1);
 
             // add to weight or reset weight
@@ -951,7 +1024,7 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
         }
 
         // add connection
-        if(randf64(0.0, 1.0) < params.mutateAddConn) {
+        if(flags & MUTATE_ADD_CONN) {
 			auto isOutput = [](i32 id, const Genome& g) {
                 return id >= g.inputNodeCount && id < g.inputNodeCount + g.outputNodeCount;
             };
@@ -986,7 +1059,7 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
         }
 
         // split connection -> 2 new connections (new node)
-        if(randf64(0.0, 1.0) < params.mutateAddNode) {
+        if(flags & MUTATE_ADD_NODE) {
             i32 splitId = randi64(0, g.geneCount-1);
             g.geneDisabled[splitId] = true;
             const i16 splitNodeIn = g.genes[splitId].nodeIn;
@@ -1025,11 +1098,13 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
             mutGenesDisabled, mutGenesRemoved);
         LOG("NEAT> structural matches=%d", g_structMatchesFound);
     }
+    mutationZone.stop();
 #endif
 
     memmove(genomes[0], nextGenomes[0], sizeof(Genome) * popCount);
 
     // speciation
+    PROFILE_SCOPE(speciationZone, "speciation");
     u8 speciesPrevExisted[NEAT_MAX_SPECIES] = {0};
     for(i32 s = 0; s < speciesCount; ++s) {
         speciesPrevExisted[s] = (speciesPopCount[s] != 0);
@@ -1044,46 +1119,78 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
     const f64 c3 = params.compC3;
     const f64 compatibilityThreshold = params.compT;
 
+    // first match among the species of the previous generation, in parallel
+    // species created below come from this generation, they are only compared in the ordered pass
+    i32* prevSpeciesMatch = scratchArr<i32>(popCount);
+    f64* prevSpeciesBiggestDist = scratchArr<f64>(popCount);
+    const i32 prevSpeciesCount = speciesCount;
+
+    parallelForChunks(popCount, EVOLVE_CHUNK_COUNT, [&](i32 start, i32 end, i32 chunkId) {
+        for(i32 i = start; i < end; ++i) {
+            const Genome& g = *genomes[i];
+            prevSpeciesMatch[i] = -1;
+            prevSpeciesBiggestDist[i] = 0.0;
+
+            for(i32 s = 0; s < prevSpeciesCount; ++s) {
+                if(!speciesPrevExisted[s]) continue;
+
+                f64 dist = compatibilityDistance(g.genes, speciesRep[s].genes, g.geneCount,
+                                                 speciesRep[s].geneCount, c1, c2, c3);
+                prevSpeciesBiggestDist[i] = max(dist, prevSpeciesBiggestDist[i]);
+                if(dist < compatibilityThreshold) {
+                    prevSpeciesMatch[i] = s;
+                    break;
+                }
+            }
+        }
+    });
+
+    // species are checked in slot order, so a new species in a lower slot wins over the match above
     for(i32 i = 0; i < popCount; ++i) {
         Genome& g = *genomes[i];
+        i32 sid = prevSpeciesMatch[i];
+        biggestDist = max(prevSpeciesBiggestDist[i], biggestDist);
 
-        bool found = false;
-        for(i32 s = 0; s < speciesCount; ++s) {
-            if(!speciesPrevExisted[s] && speciesPopCount[s] == 0) continue;
+        const i32 newSpeciesEnd = sid == -1 ? speciesCount : sid;
+        for(i32 s = 0; s < newSpeciesEnd; ++s) {
+            if(speciesPrevExisted[s] || speciesPopCount[s] == 0) continue;
 
             f64 dist = compatibilityDistance(g.genes, speciesRep[s].genes, g.geneCount,
                                              speciesRep[s].geneCount, c1, c2, c3);
             biggestDist = max(dist, biggestDist);
             if(dist < compatibilityThreshold) {
-                g.species = s;
-                speciesPopCount[s]++;
-                found = true;
+                sid = s;
                 break;
             }
         }
 
-        if(!found) {
-            assert(speciesCount < NEAT_MAX_SPECIES);
+        if(sid != -1) {
+            g.species = sid;
+            speciesPopCount[sid]++;
+            continue;
+        }
 
-            // find a species slot
-            i32 sid = -1;
-            for(i32 s = 0; s < NEAT_MAX_SPECIES; ++s) {
-                if(!speciesPrevExisted[s] && speciesPopCount[s] == 0) {
-                    sid = s;
-                    break;
-                }
-            }
-            assert(sid != -1);
-            speciesCount = max(speciesCount, sid+1);
+        assert(speciesCount < NEAT_MAX_SPECIES);
 
-            speciesRep[sid] = g;
-            speciesPopCount[sid] = 1;
-            g.species = sid;
+        // find a species slot
+        for(i32 s = 0; s < NEAT_MAX_SPECIES; ++s) {
+            if(!speciesPrevExisted[s] && speciesPopCount[s] == 0) {
+                sid = s;
+                break;
+            }
         }
+        assert(sid != -1);
+        speciesCount = max(speciesCount, sid+1);
+
+        speciesRep[sid] = g;
+        speciesPopCount[sid] = 1;
+        g.species = sid;
     }
 
     if(verbose) LOG("NEAT> species count: %d (biggestDist=%g)", speciesCount, biggestDist);
 
+    scratchRewind(scratchStart);
+
     if(verbose) LOG("NEAT> evolution took %.3fs", timeToMicrosec(timeGet() - t0)/1000000.0);
 }
 
@@ -1123,6 +1230,167 @@ void neatGenomeComputeNodePos(Genome** genomes, const i32 popCount)
     }
 }
 
+void neatSnapshotAdd(SnapshotWriter* sw, u32 index, Genome** genomes, const i32 popCount,
+                     const NeatSpeciation& speciation)
+{
+    const i32 speciesCount = speciation.speciesCount;
+    const NeatSnapshotInfo info = { popCount, speciesCount, g_innovationNumber.load() };
+    snapshotAdd(sw, NEAT_SNAPSHOT_INFO, index, &info, sizeof(info), 1);
+
+    Genome* genomesOut = (Genome*)snapshotAdd(sw, NEAT_SNAPSHOT_GENOMES, index, nullptr,
+                                              sizeof(Genome), popCount);
+    for(i32 i = 0; i < popCount; ++i) {
+        memmove(&genomesOut[i], genomes[i], sizeof(Genome));
+    }
+
+    snapshotAdd(sw, NEAT_SNAPSHOT_SPECIES_REP, index, speciation.speciesRep, sizeof(Genome),
+                speciesCount);
+    snapshotAdd(sw, NEAT_SNAPSHOT_SPECIES_POP_COUNT, index, speciation.speciesPopCount,
+                sizeof(speciation.speciesPopCount[0]), speciesCount);
+    snapshotAdd(sw, NEAT_SNAPSHOT_SPECIES_STAGNATION, index, speciation.stagnation,
+                sizeof(speciation.stagnation[0]), speciesCount);
+    snapshotAdd(sw, NEAT_SNAPSHOT_SPECIES_MAX_FITNESS, index, speciation.maxFitness,
+                sizeof(speciation.maxFitness[0]), speciesCount);
+}
+
+bool neatSnapshotRestore(const Snapshot& snap, u32 index, Genome** genomes, const i32 popCount,
+                         NeatSpeciation* speciation)
+{
+    const NeatSnapshotInfo* info = snapshotArrExact<NeatSnapshotInfo>(snap, NEAT_SNAPSHOT_INFO, index, 1);
+    if(!info || info->popCount != popCount ||
+       info->speciesCount < 0 || info->speciesCount > NEAT_MAX_SPECIES) {
+        LOG("ERROR: NEAT> snapshot %u does not match a population of %d", index, popCount);
+        return false;
+    }
+
+    const i32 speciesCount = info->speciesCount;
+    const Genome* genomesIn = snapshotArrExact<Genome>(snap, NEAT_SNAPSHOT_GENOMES, index, popCount);
+    const Genome* repIn = snapshotArrExact<Genome>(snap, NEAT_SNAPSHOT_SPECIES_REP, index, speciesCount);
+    const i32* popCountIn = snapshotArrExact<i32>(snap, NEAT_SNAPSHOT_SPECIES_POP_COUNT, index,
+                                                  speciesCount);
+    const u16* stagnationIn = snapshotArrExact<u16>(snap, NEAT_SNAPSHOT_SPECIES_STAGNATION, index,
+                                                    speciesCount);
+    const f64* maxFitnessIn = snapshotArrExact<f64>(snap, NEAT_SNAPSHOT_SPECIES_MAX_FITNESS, index,
+                                                    speciesCount);
+    if(!genomesIn || !repIn || !popCountIn || !stagnationIn || !maxFitnessIn) {
+        LOG("ERROR: NEAT> snapshot %u is incomplete", index);
+        return false;
+    }
+
+    for(i32 i = 0; i < popCount; ++i) {
+        memmove(genomes[i], &genomesIn[i], sizeof(Genome));
+    }
+
+    if(!speciation->speciesRep) {
+        speciation->speciesRep = (Genome*)malloc(sizeof(Genome) * NEAT_MAX_SPECIES);
+    }
+    mem_zero(speciation->speciesPopCount);
+    mem_zero(speciation->stagnation);
+    mem_zero(speciation->maxFitness);
+    speciation->speciesCount = speciesCount;
+    memmove(speciation->speciesRep, repIn, sizeof(Genome) * speciesCount);
+    memmove(speciation->speciesPopCount, popCountIn, sizeof(popCountIn[0]) * speciesCount);
+    memmove(speciation->stagnation, stagnationIn, sizeof(stagnationIn[0]) * speciesCount);
+    memmove(speciation->maxFitness, maxFitnessIn, sizeof(maxFitnessIn[0]) * speciesCount);
+
+    // the innovation history is shared, a population restored later must not lower it
+    i32 innovationNumber = g_innovationNumber.load();
+    while(innovationNumber < info->innovationNumber &&
+          !g_innovationNumber.compare_exchange_weak(innovationNumber, info->innovationNumber));
+    return true;
+}
+
+// EXPORT
+struct ExportNodeValue
+{
+    char expr[24]; // in[i], a local or 0.0 for a node not computed yet
+    bool zero;
+};
+
+bool neatExportC(const char* path, Genome* genome)
+{
+    NeatNN* nn;
+    neatGenomeAllocMakeNN(&genome, 1, &nn);
+    const i32 compCount = nn->computationsCount;
+    const NeatNN::Computation* computations = nn->computations;
+    const i32 nodeCount = nn->nodeCount;
+    const i32 inputCount = genome->inputNodeCount;
+    const i32 outputCount = genome->outputNodeCount;
+
+    if(compCount == 0) {
+        LOG("ERROR: NEAT> nothing to export, the genome has no enabled connection");
+        neatNnDealloc(&nn);
+        return false;
+    }
+
+    // setInputs() zeroes every other node, a node read before it is computed reads 0
+    const i64 mark = scratchMark();
+    i32* writeCount = scratchArr<i32>(nodeCount);
+    ExportNodeValue* value = scratchArr<ExportNodeValue>(nodeCount);
+    arr_zero(writeCount, nodeCount);
+    for(i32 n = 0; n < nodeCount; ++n) {
+        value[n].zero = n >= inputCount;
+        if(value[n].zero) snprintf(value[n].expr, sizeof(value[n].expr), "0.0");
+        else snprintf(value[n].expr, sizeof(value[n].expr), "in[%d]", n);
+    }
+
+    char description[128];
+    snprintf(description, sizeof(description), "NEAT genome, %d nodes, %d connections",
+             nodeCount, compCount);
+    CExport ex;
+    bool ok = exportCBegin(&ex, path, description, inputCount, outputCount, 0, false);
+    if(ok) {
+        exportCFunctionBegin(&ex);
+
+        // same order as neatNnPropagate, every run of computations with the same nodeOut is a node
+        for(i32 c = 0; c < compCount;) {
+            const i32 nodeOut = computations[c].nodeOut;
+            char var[24];
+            if(writeCount[nodeOut] == 0) snprintf(var, sizeof(var), "n%d", nodeOut);
+            else snprintf(var, sizeof(var), "n%d_%d", nodeOut, writeCount[nodeOut]);
+            writeCount[nodeOut]++;
+
+            char lhs[40];
+            snprintf(lhs, sizeof(lhs), "const double %s", var);
+            exportCSumBegin(&ex, lhs, 1.0);
+            for(; c < compCount && computations[c].nodeOut == nodeOut; ++c) {
+                const ExportNodeValue& in = value[computations[c].nodeIn];
+                if(in.zero) continue;
+                exportCSumTerm(&ex, computations[c].weight, "%s", in.expr);
+            }
+            exportCSumEnd(&ex);
+
+            snprintf(value[nodeOut].expr, sizeof(value[nodeOut].expr), "%s", var);
+            value[nodeOut].zero = false;
+        }
+
+        fprintf(ex.file, "\n");
+        for(i32 o = 0; o < outputCount; ++o) {
+            fprintf(ex.file, "    out[%d] = %s;\n", o, value[inputCount + o].expr);
+        }
+        exportCFunctionEnd(&ex);
+        ok = exportCEnd(&ex);
+    }
+
+    if(ok) {
+        const i32 sampleCount = EXPORT_C_TEST_SAMPLES;
+        f64* inputs = scratchArr<f64>(sampleCount * inputCount);
+        f64* expected = scratchArr<f64>(sampleCount * outputCount);
+        exportCTestInputs(inputs, sampleCount * inputCount);
+        for(i32 s = 0; s < sampleCount; ++s) {
+            nn->setInputs(&inputs[s * inputCount], inputCount);
+            neatNnPropagate(&nn, 1);
+            memmove(&expected[s * outputCount], &nn->nodeValues[inputCount],
+                    sizeof(f64) * outputCount);
+        }
+        ok = exportCWriteHarness(ex, inputs, expected, sampleCount);
+    }
+
+    scratchRewind(mark);
+    neatNnDealloc(&nn);
+    return ok;
+}
+
 void neatTestTryReproduce(const Genome& g1, const Genome& g2)
 {
     const Gene* genes1 = g1.genes;
@@ -1,5 +1,7 @@
 #pragma once
 #include "base.h"
+#include "snapshot.h"
+#include "export_c.h"
 #include <assert.h>
 #include <string.h>
 
@@ -98,6 +100,34 @@ void neatEvolve(Genome** genomes, Genome** nextGenomes, f64* fitness, const i32
                 NeatSpeciation* neatSpec, const NeatEvolutionParams& params,
                 bool verbose = false);
 
+// SNAPSHOT
+// sections of a population, index tells apart several populations in the same snapshot
+#define NEAT_SNAPSHOT_INFO 1
+#define NEAT_SNAPSHOT_GENOMES 2
+#define NEAT_SNAPSHOT_SPECIES_REP 3
+#define NEAT_SNAPSHOT_SPECIES_POP_COUNT 4
+#define NEAT_SNAPSHOT_SPECIES_STAGNATION 5
+#define NEAT_SNAPSHOT_SPECIES_MAX_FITNESS 6
+
+struct NeatSnapshotInfo
+{
+    i32 popCount;
+    i32 speciesCount;
+    i32 innovationNumber;
+    i32 reserved;
+};
+
+void neatSnapshotAdd(SnapshotWriter* sw, u32 index, Genome** genomes, const i32 popCount,
+                     const NeatSpeciation& speciation);
+// the nets and node positions have to be rebuilt from the restored genomes
+bool neatSnapshotRestore(const Snapshot& snap, u32 index, Genome** genomes, const i32 popCount,
+                         NeatSpeciation* speciation);
+
+// EXPORT
+// the genome compiled to a standalone C function, with a harness checking it against
+// neatNnPropagate (see exportCBegin)
+bool neatExportC(const char* path, Genome* genome);
+
 void neatTestTryReproduce(const Genome& g1, const Genome& g2);
 void neatTestCrossover(const Genome* parentA, const Genome* parentB, Genome* dest);
 f64 neatTestCompability(const Genome* ga, const Genome* gb, const NeatEvolutionParams& params);
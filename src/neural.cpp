@@ -6,9 +6,6 @@
 #include <assert.h>
 #include <float.h>
 #include <stddef.h>
-#include "imgui/imgui.h"
-#define IMGUI_DEFINE_MATH_OPERATORS
-#include "imgui/imgui_internal.h"
 
 #define ACTFUNC_TANH 0x1
 #define ACTFUNC_RELU 0x2
@@ -211,9 +208,7 @@ void nnCopy(NeuralNet* dest, NeuralNet* src, const NeuralNetDef& def)
 void nnInit(NeuralNet** nn, const i32 nnCount, const NeuralNetDef& def)
 {
     for(i32 i = 0; i < nnCount; ++i) {
-        for(i32 s = 0; s < def.weightTotalCount; ++s) {
-            nn[i]->weights[s] = randf64(-1.0, 1.0);
-        }
+        randFillF64(nn[i]->weights, def.weightTotalCount, -1.0, 1.0);
     }
 }
 
@@ -312,18 +307,160 @@ void nnPropagate(NeuralNet** nn, const i32 nnCount, const NeuralNetDef& def)
     }
 }
 
+// the old per net loop `while(m > 0) { if(rand < m) { mutate; m -= 1; } }` always ended after
+// exactly ceil(rate) mutations, so those are sampled in bulk and applied in one pass
+#define MUTATION_CHUNK 256
+
+template<typename Net>
+static i32 mutateWeights(Net** nets, const i32 netCount, const i32 weightTotalCount, const f64 rate,
+                         const f64 step, const f64 resetChance)
+{
+    const i32 perNet = (i32)ceil(rate);
+    const i32 total = netCount * max(perNet, 0);
+
+    i32 weightIds[MUTATION_CHUNK];
+    f64 resetRolls[MUTATION_CHUNK];
+    f64 values[MUTATION_CHUNK];
+
+    for(i32 c = 0; c < total; c += MUTATION_CHUNK) {
+        const i32 chunkCount = min(total - c, MUTATION_CHUNK);
+        randFillBelow(weightIds, chunkCount, weightTotalCount);
+        randFillUnit(resetRolls, chunkCount);
+        randFillF64(values, chunkCount, -1.0, 1.0);
+
+        for(i32 e = 0; e < chunkCount; ++e) {
+            f64& weight = nets[(c + e) / perNet]->weights[weightIds[e]];
+            if(resetRolls[e] < resetChance) {
+                weight = values[e];
+            }
+            else {
+                weight += values[e] * step;
+            }
+        }
+    }
+    return total;
+}
+
+// one random bit per weight
+static void crossoverWeights(f64* outWeights, const f64* parentAWeights, const f64* parentBWeights,
+                             i32 weightCount)
+{
+    u64 bits[MUTATION_CHUNK / 64];
+    for(i32 c = 0; c < weightCount; c += MUTATION_CHUNK) {
+        const i32 chunkCount = min(weightCount - c, MUTATION_CHUNK);
+        randFillU64(bits, (chunkCount + 63) / 64);
+        for(i32 s = 0; s < chunkCount; ++s) {
+            // get weight from parent A or B
+            const bool fromA = (bits[s >> 6] >> (s & 63)) & 1;
+            outWeights[c + s] = fromA ? parentAWeights[c + s] : parentBWeights[c + s];
+        }
+    }
+}
+
 void nnCrossover(f64* outWeights, f64* parentBWeights, f64* parentAWeights, i32 weightCount)
 {
-    for(i32 s = 0; s < weightCount; ++s) {
-        // get weight from parent A
-        if(xorshift64star() & 1) {
-            outWeights[s] = parentAWeights[s];
+    crossoverWeights(outWeights, parentAWeights, parentBWeights, weightCount);
+}
+
+static inline void netCopy(NeuralNet* dest, NeuralNet* src, const NeuralNetDef& def)
+{
+    nnCopy(dest, src, def);
+}
+
+static inline void netCopy(RecurrentNeuralNet* dest, RecurrentNeuralNet* src,
+                           const RecurrentNeuralNetDef& def)
+{
+    rnnCopy(dest, src, def);
+}
+
+// offspring and speciation are split finer than the thread count, their cost varies per net
+#define EVOLVE_CHUNK_COUNT 64
+
+// parents are picked in order beforehand (parentB null: copy of parentA), the children are then
+// made in parallel, each one drawing from its own stream so the result doesn't depend on the
+// thread count
+template<typename Net, typename Def>
+static void makeOffspring(Net** children, Net** parentA, Net** parentB, const i32 childCount,
+                          const Def& def)
+{
+    const u64 childStreamKey = randu64();
+    parallelForChunks(childCount, EVOLVE_CHUNK_COUNT, [&](i32 start, i32 end, i32 chunkId) {
+        for(i32 i = start; i < end; ++i) {
+            if(parentB[i]) {
+                RandStream stream;
+                randStreamSeed(&stream, childStreamKey, i);
+                RandStreamScope streamScope(&stream);
+                crossoverWeights(children[i]->weights, parentB[i]->weights, parentA[i]->weights,
+                                 def.weightTotalCount);
+            }
+            else {
+                netCopy(children[i], parentA[i], def);
+            }
         }
-        // get weight from parent B
-        else {
-            outWeights[s] = parentBWeights[s];
+    });
+}
+
+// first match among the species of the previous generation, in parallel, then in order for
+// the species created by this generation: a new species in a lower slot wins over that match
+template<typename Net, typename Def>
+static void assignSpecies(Net** nets, const i32 popCount, i32* species, Net** speciesRep,
+                          i32* speciesPopCount, const u8* speciesPrevExisted, const f64 compT,
+                          const Def& def)
+{
+    const i32 weightTotalCount = def.weightTotalCount;
+    const i64 scratchStart = scratchMark();
+    i32* prevSpeciesMatch = scratchArr<i32>(popCount);
+
+    parallelForChunks(popCount, EVOLVE_CHUNK_COUNT, [&](i32 start, i32 end, i32 chunkId) {
+        for(i32 i = start; i < end; ++i) {
+            prevSpeciesMatch[i] = -1;
+            for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
+                if(!speciesPrevExisted[s]) continue;
+
+                f64 dist = compatibilityDistance(speciesRep[s]->weights, nets[i]->weights,
+                                                 weightTotalCount);
+                if(dist < compT) {
+                    prevSpeciesMatch[i] = s;
+                    break;
+                }
+            }
+        }
+    });
+
+    for(i32 i = 0; i < popCount; ++i) {
+        i32 sid = prevSpeciesMatch[i];
+        const i32 newSpeciesEnd = sid == -1 ? RNN_MAX_SPECIES : sid;
+        for(i32 s = 0; s < newSpeciesEnd; ++s) {
+            if(speciesPrevExisted[s] || speciesPopCount[s] == 0) continue;
+
+            f64 dist = compatibilityDistance(speciesRep[s]->weights, nets[i]->weights,
+                                             weightTotalCount);
+            if(dist < compT) {
+                sid = s;
+                break;
+            }
         }
+
+        if(sid != -1) {
+            species[i] = sid;
+            speciesPopCount[sid]++;
+            continue;
+        }
+
+        // find a species slot
+        for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
+            if(!speciesPrevExisted[s] && speciesPopCount[s] == 0) {
+                sid = s;
+                break;
+            }
+        }
+        assert(sid >= 0 && sid < RNN_MAX_SPECIES);
+
+        netCopy(speciesRep[sid], nets[i], def);
+        speciesPopCount[sid] = 1;
+        species[i] = sid;
     }
+    scratchRewind(scratchStart);
 }
 
 void nnEvolve(NnEvolutionParams* params, bool verbose)
@@ -340,6 +477,9 @@ void nnEvolve(NnEvolutionParams* params, bool verbose)
     const NeuralNetDef& rnnDef = *params->rnnDef;
     const i32 weightTotalCount = rnnDef.weightTotalCount;
 
+    // temporary arrays of this generation, released together at the end
+    const i64 scratchStart = scratchMark();
+
     f64 speciesMaxFitness[RNN_MAX_SPECIES] = {0};
 
     for(i32 i = 0; i < popCount; ++i) {
@@ -349,8 +489,9 @@ void nnEvolve(NnEvolutionParams* params, bool verbose)
     }
 
     // species stagnation
+    PROFILE_SCOPE(stagnationZone, "stagnation");
     i32* speciesPopCount = speciation.speciesPopCount;
-    u8* deleteSpecies = stack_arr(u8,RNN_MAX_SPECIES);
+    u8* deleteSpecies = scratchArr<u8>(RNN_MAX_SPECIES);
     const i32 stagnationT = 15;
     u16* specStagnation = speciation.stagnation;
     f64* specStagMaxFitness = speciation.maxFitness;
@@ -388,7 +529,10 @@ void nnEvolve(NnEvolutionParams* params, bool verbose)
     deleteSpecies[bestSpecies] = false;
     specStagnation[bestSpecies] = 0;
 
-    FitnessPair* fpair = stack_arr(FitnessPair,popCount);
+    stagnationZone.stop();
+
+    PROFILE_SCOPE(selectionZone, "selection");
+    FitnessPair* fpair = scratchArr<FitnessPair>(popCount);
     memset(fpair, 0, sizeof(FitnessPair) * popCount);
     for(i32 i = 0; i < popCount; ++i) {
         fpair[i] = { i, curGenSpecies[i], fitness[i] };
@@ -396,15 +540,15 @@ void nnEvolve(NnEvolutionParams* params, bool verbose)
     qsort(fpair, popCount, sizeof(FitnessPair), compareFitnessDesc);
 
     // fitness sharing
-    f64* normFitness = stack_arr(f64,popCount);
+    f64* normFitness = scratchArr<f64>(popCount);
     for(i32 i = 0; i < popCount; ++i) {
         normFitness[i] = fitness[i] * 10000.0 / speciesPopCount[curGenSpecies[i]];
     }
 
     // parents
-    i32* speciesParentCount = stack_arr(i32,RNN_MAX_SPECIES);
+    i32* speciesParentCount = scratchArr<i32>(RNN_MAX_SPECIES);
     memset(speciesParentCount, 0, RNN_MAX_SPECIES * sizeof(i32));
-    f64* parentFitness = stack_arr(f64,popCount);
+    f64* parentFitness = scratchArr<f64>(popCount);
     f64 parentTotalFitness = 0.0;
     i32 parentCount = 0;
 
@@ -443,19 +587,24 @@ void nnEvolve(NnEvolutionParams* params, bool verbose)
     }
 
     const i32 popCountMinusChamps = popCount - championCount;
+    selectionZone.stop();
 
+    PROFILE_SCOPE(crossoverZone, "crossover");
     i32 noMatesFoundCount = 0;
-    NeuralNet** potentialMates = stack_arr(NeuralNet*,parentCount);
-    f64* pmFitness = stack_arr(f64,parentCount);
+    NeuralNet** potentialMates = scratchArr<NeuralNet*>(parentCount);
+    f64* pmFitness = scratchArr<f64>(parentCount);
+    NeuralNet** childParentA = scratchArr<NeuralNet*>(popCountMinusChamps);
+    NeuralNet** childParentB = scratchArr<NeuralNet*>(popCountMinusChamps);
 
     for(i32 i = 0; i < popCountMinusChamps; ++i) {
         const i32 idA = selectRoulette(parentCount, parentFitness, parentTotalFitness);
         const i32 speciesA = curGenSpecies[idA];
+        childParentA[i] = curGenNN[idA];
+        childParentB[i] = nullptr;
+        nextGenSpecies[i] = speciesA;
 
         // copy 25% (no crossover)
         if(randf64(0.0, 1.0) < 0.25) {
-            nnCopy(nextGenNN[i], curGenNN[idA], rnnDef);
-            nextGenSpecies[i] = speciesA;
             continue;
         }
 
@@ -474,8 +623,6 @@ void nnEvolve(NnEvolutionParams* params, bool verbose)
 
         if(potentialMatesCount < 1) {
             noMatesFoundCount++;
-            nnCopy(nextGenNN[i], curGenNN[idA], rnnDef);
-            nextGenSpecies[i] = speciesA;
         }
         else {
             NeuralNet* mateA = curGenNN[idA];
@@ -489,100 +636,25 @@ void nnEvolve(NnEvolutionParams* params, bool verbose)
                 mateB = tmp;
             }
 
-            nnCrossover(nextGenNN[i]->weights, mateA->weights, mateB->weights, weightTotalCount);
-            nextGenSpecies[i] = speciesA;
+            childParentA[i] = mateA;
+            childParentB[i] = mateB;
         }
     }
 
+    makeOffspring(nextGenNN, childParentA, childParentB, popCountMinusChamps, rnnDef);
+
     if(verbose) LOG("RnnEvol> noMatesFoundCount=%d", noMatesFoundCount);
 
+    crossoverZone.stop();
+
     // mutate
+    PROFILE_SCOPE(mutationZone, "mutation");
     const f64 mutationRate = params->mutationRate;
     const f64 mutationStep = params->mutationStep;
     const f64 mutationResetWeight = params->mutationReset;
 
-    i32 layerWeightFirstId[NN_MAX_LAYERS];
-    layerWeightFirstId[0] = 0;
-    for(i32 l = 1; l < rnnDef.layerCount; l++) {
-        i32 w = rnnDef.layerNeuronCount[l] * rnnDef.layerNeuronCount[l-1];
-        layerWeightFirstId[l] = layerWeightFirstId[l-1] + w;
-    }
-
-    const i32 outputCount = rnnDef.outputNeuronCount;
-    const i32 inputCount = rnnDef.inputNeuronCount;
-    constexpr i32 SM_SAMPLES = 10;
-    const i32 SM_INPUT_COUNT = SM_SAMPLES * inputCount;
-    f64* sampleInputs = stack_arr(f64,SM_INPUT_COUNT);
-    for(i32 i = 0; i < SM_INPUT_COUNT; i++) {
-        sampleInputs[i] = randf64(-1.0, 1.0);
-    }
-
-    i32 mutationCount = 0;
-    for(i32 i = 0; i < popCountMinusChamps; ++i) {
-        f64 m = mutationRate;
-        NeuralNet* nni = nextGenNN[i];
-
-        while(m > 0.0) {
-            if(randf64(0.0, 1.0) < m) {
-                const i32 w = randi64(0, weightTotalCount-1);
-                mutationCount++;
-
-                if(randf64(0.0, 1.0) < mutationResetWeight) {
-                    nni->weights[w] = randf64(-1.0, 1.0);
-                }
-                else {
-                    // safe mutation
-#if 0
-                    // pre mutation forward pass
-                    f64 preOutTotal = 0.0;
-                    memset(nni->prevHiddenValues, 0,
-                           sizeof(nni->prevHiddenValues[0]) * hiddenStateNeuronCount);
-                    for(i32 S = 0; S < SM_SAMPLES; S++) {
-                        nni->setInputs(sampleInputs + (S * inputCount), inputCount);
-                        rnnPropagate(&nni, 1, rnnDef);
-                        f64* output = nni->output;
-                        for(i32 o = 0; o < outputCount; o++) {
-                            preOutTotal += output[o];
-                        }
-                    }
-
-                    const f64 perturbation = randf64(-mutationStep, mutationStep);
-                    const f64 oldWeight = nni->weights[w];
-                    nni->weights[w] += perturbation;
-
-                    // post mutation forward pass
-                    f64 postOutTotal = 0.0;
-                    memset(nni->prevHiddenValues, 0,
-                           sizeof(nni->prevHiddenValues[0]) * hiddenStateNeuronCount);
-                    for(i32 S = 0; S < SM_SAMPLES; S++) {
-                        nni->setInputs(sampleInputs + (S * inputCount), inputCount);
-                        rnnPropagate(&nni, 1, rnnDef);
-                        f64* output = nni->output;
-                        for(i32 o = 0; o < outputCount; o++) {
-                            postOutTotal += output[o];
-                        }
-                    }
-
-                    f64 divergence = pow2(preOutTotal - postOutTotal) / SM_SAMPLES;
-                    divergence = min(divergence, 1.0);
-
-                    const f64 divergenceScaling = 0.5;
-                    const f64 keepBase = 1.0 - divergenceScaling;
-                    const f64 scaledPerturbation = perturbation * (keepBase + divergenceScaling
-                                                                   - divergence * divergenceScaling);
-                    nni->weights[w] = oldWeight + scaledPerturbation;
-
-                    LOG("%i> divergence: %g oldPert: %g scaledPert:  %g", i, divergence,
-                        perturbation, scaledPerturbation);
-
-#else
-                    nni->weights[w] += randf64(-mutationStep, mutationStep);
-#endif
-                }
-                m -= 1.0;
-            }
-        }
-    }
+    const i32 mutationCount = mutateWeights(nextGenNN, popCountMinusChamps, weightTotalCount,
+                                            mutationRate, mutationStep, mutationResetWeight);
 
     if(verbose) LOG("RnnEvol> mutationCount=%d", mutationCount);
 
@@ -591,52 +663,22 @@ void nnEvolve(NnEvolutionParams* params, bool verbose)
     }
     memmove(curGenSpecies, nextGenSpecies, sizeof(curGenSpecies[0]) * popCount);
 
+    mutationZone.stop();
+
     // speciation
+    PROFILE_SCOPE(speciationZone, "speciation");
     u8 speciesPrevExisted[RNN_MAX_SPECIES] = {0};
     for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
         speciesPrevExisted[s] = (speciesPopCount[s] != 0);
     }
 
-    NeuralNet** speciesRep = speciation.speciesRep;
     mem_zero(speciation.speciesPopCount); // reset species population count
     speciesPopCount = speciation.speciesPopCount;
-    f64 biggestDist = 0.0;
 
-    const f64 compT = speciation.compT;
-
-    for(i32 i = 0; i < popCount; ++i) {
-        NeuralNet* nni = curGenNN[i];
-
-        bool found = false;
-        for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
-            if(!speciesPrevExisted[s] && speciesPopCount[s] == 0) continue;
+    assignSpecies(curGenNN, popCount, curGenSpecies, speciation.speciesRep, speciesPopCount,
+                  speciesPrevExisted, speciation.compT, rnnDef);
 
-            f64 dist = compatibilityDistance(speciesRep[s]->weights, nni->weights, weightTotalCount);
-            biggestDist = max(dist, biggestDist);
-            if(dist < compT) {
-                curGenSpecies[i] = s;
-                speciesPopCount[s]++;
-                found = true;
-                break;
-            }
-        }
-
-        if(!found) {
-            // find a species slot
-            i32 sid = -1;
-            for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
-                if(!speciesPrevExisted[s] && speciesPopCount[s] == 0) {
-                    sid = s;
-                    break;
-                }
-            }
-            assert(sid >= 0 && sid < RNN_MAX_SPECIES);
-
-            nnCopy(speciesRep[sid], nni, rnnDef);
-            speciesPopCount[sid] = 1;
-            curGenSpecies[i] = sid;
-        }
-    }
+    scratchRewind(scratchStart);
 }
 
 void rnnMakeDef(RecurrentNeuralNetDef* def, const i32 layerCount, const i32 layerNeuronCount[], f64 bias)
@@ -721,9 +763,7 @@ void rnnInit(RecurrentNeuralNet** nn, const i32 popCount, const RecurrentNeuralN
     const i32 neuronCount = def.neuronCount;
     for(i32 i = 0; i < popCount; ++i) {
         memset(nn[i]->values, 0, sizeof(nn[i]->values[0]) * neuronCount);
-        for(i32 s = 0; s < weightTotalCount; ++s) {
-            nn[i]->weights[s] = randf64(-1.0, 1.0);
-        }
+        randFillF64(nn[i]->weights, weightTotalCount, -1.0, 1.0);
     }
 }
 
@@ -1010,16 +1050,12 @@ void rnnPropagateWide(RecurrentNeuralNet** nn, const i32 nnCount, const Recurren
 
 void rnnCrossover(f64* outWeights, f64* parentBWeights, f64* parentAWeights, i32 weightCount)
 {
-    for(i32 s = 0; s < weightCount; ++s) {
-        // get weight from parent A
-        if(xorshift64star() & 1) {
-            outWeights[s] = parentAWeights[s];
-        }
-        // get weight from parent B
-        else {
-            outWeights[s] = parentBWeights[s];
-        }
-    }
+    crossoverWeights(outWeights, parentAWeights, parentBWeights, weightCount);
+}
+
+f64 nnTestCompatibility(const f64* weightA, const f64* weightB, const i32 weightCount)
+{
+    return compatibilityDistance(weightA, weightB, weightCount);
 }
 
 void testPropagateNN()
@@ -1263,6 +1299,9 @@ void rnnEvolve(RnnEvolutionParams* params, bool verbose)
     const i32 weightTotalCount = rnnDef.weightTotalCount;
     const i32 hiddenStateNeuronCount = rnnDef.hiddenStateNeuronCount;
 
+    // temporary arrays of this generation, released together at the end
+    const i64 scratchStart = scratchMark();
+
     f64 speciesMaxFitness[RNN_MAX_SPECIES] = {0};
 
     for(i32 i = 0; i < popCount; ++i) {
@@ -1272,8 +1311,9 @@ void rnnEvolve(RnnEvolutionParams* params, bool verbose)
     }
 
     // species stagnation
+    PROFILE_SCOPE(stagnationZone, "stagnation");
     i32* speciesPopCount = speciation.speciesPopCount;
-    u8* deleteSpecies = stack_arr(u8,RNN_MAX_SPECIES);
+    u8* deleteSpecies = scratchArr<u8>(RNN_MAX_SPECIES);
     const i32 stagnationT = 15;
     u16* specStagnation = speciation.stagnation;
     f64* specStagMaxFitness = speciation.maxFitness;
@@ -1311,7 +1351,10 @@ void rnnEvolve(RnnEvolutionParams* params, bool verbose)
     deleteSpecies[bestSpecies] = false;
     specStagnation[bestSpecies] = 0;
 
-    FitnessPair* fpair = stack_arr(FitnessPair,popCount);
+    stagnationZone.stop();
+
+    PROFILE_SCOPE(selectionZone, "selection");
+    FitnessPair* fpair = scratchArr<FitnessPair>(popCount);
     memset(fpair, 0, sizeof(FitnessPair) * popCount);
     for(i32 i = 0; i < popCount; ++i) {
         fpair[i] = { i, curGenSpecies[i], fitness[i] };
@@ -1319,15 +1362,15 @@ void rnnEvolve(RnnEvolutionParams* params, bool verbose)
     qsort(fpair, popCount, sizeof(FitnessPair), compareFitnessDesc);
 
     // fitness sharing
-    f64* normFitness = stack_arr(f64,popCount);
+    f64* normFitness = scratchArr<f64>(popCount);
     for(i32 i = 0; i < popCount; ++i) {
         normFitness[i] = fitness[i] * 10000.0 / speciesPopCount[curGenSpecies[i]];
     }
 
     // parents
-    i32* speciesParentCount = stack_arr(i32,RNN_MAX_SPECIES);
+    i32* speciesParentCount = scratchArr<i32>(RNN_MAX_SPECIES);
     memset(speciesParentCount, 0, RNN_MAX_SPECIES * sizeof(i32));
-    f64* parentFitness = stack_arr(f64,popCount);
+    f64* parentFitness = scratchArr<f64>(popCount);
     f64 parentTotalFitness = 0.0;
     i32 parentCount = 0;
 
@@ -1366,19 +1409,24 @@ void rnnEvolve(RnnEvolutionParams* params, bool verbose)
     }
 
     const i32 popCountMinusChamps = popCount - championCount;
+    selectionZone.stop();
 
+    PROFILE_SCOPE(crossoverZone, "crossover");
     i32 noMatesFoundCount = 0;
-    RecurrentNeuralNet** potentialMates = stack_arr(RecurrentNeuralNet*,parentCount);
-    f64* pmFitness = stack_arr(f64,parentCount);
+    RecurrentNeuralNet** potentialMates = scratchArr<RecurrentNeuralNet*>(parentCount);
+    f64* pmFitness = scratchArr<f64>(parentCount);
+    RecurrentNeuralNet** childParentA = scratchArr<RecurrentNeuralNet*>(popCountMinusChamps);
+    RecurrentNeuralNet** childParentB = scratchArr<RecurrentNeuralNet*>(popCountMinusChamps);
 
     for(i32 i = 0; i < popCountMinusChamps; ++i) {
         const i32 idA = selectRoulette(parentCount, parentFitness, parentTotalFitness);
         const i32 speciesA = curGenSpecies[idA];
+        childParentA[i] = curGenNN[idA];
+        childParentB[i] = nullptr;
+        nextGenSpecies[i] = speciesA;
 
         // copy 25% (no crossover)
         if(randf64(0.0, 1.0) < 0.25) {
-            rnnCopy(nextGenNN[i], curGenNN[idA], rnnDef);
-            nextGenSpecies[i] = speciesA;
             continue;
         }
 
@@ -1397,8 +1445,6 @@ void rnnEvolve(RnnEvolutionParams* params, bool verbose)
 
         if(potentialMatesCount < 1) {
             noMatesFoundCount++;
-            rnnCopy(nextGenNN[i], curGenNN[idA], rnnDef);
-            nextGenSpecies[i] = speciesA;
         }
         else {
             RecurrentNeuralNet* mateA = curGenNN[idA];
@@ -1412,100 +1458,25 @@ void rnnEvolve(RnnEvolutionParams* params, bool verbose)
                 mateB = tmp;
             }
 
-            rnnCrossover(nextGenNN[i]->weights, mateA->weights, mateB->weights, weightTotalCount);
-            nextGenSpecies[i] = speciesA;
+            childParentA[i] = mateA;
+            childParentB[i] = mateB;
         }
     }
 
+    makeOffspring(nextGenNN, childParentA, childParentB, popCountMinusChamps, rnnDef);
+
     if(verbose) LOG("RnnEvol> noMatesFoundCount=%d", noMatesFoundCount);
 
+    crossoverZone.stop();
+
     // mutate
+    PROFILE_SCOPE(mutationZone, "mutation");
     const f64 mutationRate = params->mutationRate;
     const f64 mutationStep = params->mutationStep;
     const f64 mutationResetWeight = params->mutationReset;
 
-    i32 layerWeightFirstId[NN_MAX_LAYERS];
-    layerWeightFirstId[0] = 0;
-    for(i32 l = 1; l < rnnDef.layerCount; l++) {
-        i32 w = rnnDef.layerNeuronCount[l] * rnnDef.layerNeuronCount[l-1];
-        layerWeightFirstId[l] = layerWeightFirstId[l-1] + w;
-    }
-
-    const i32 outputCount = rnnDef.outputNeuronCount;
-    const i32 inputCount = rnnDef.inputNeuronCount;
-    constexpr i32 SM_SAMPLES = 10;
-    const i32 SM_INPUT_COUNT = SM_SAMPLES * inputCount;
-    f64* sampleInputs = stack_arr(f64,SM_INPUT_COUNT);
-    for(i32 i = 0; i < SM_INPUT_COUNT; i++) {
-        sampleInputs[i] = randf64(-1.0, 1.0);
-    }
-
-    i32 mutationCount = 0;
-    for(i32 i = 0; i < popCountMinusChamps; ++i) {
-        f64 m = mutationRate;
-        RecurrentNeuralNet* nni = nextGenNN[i];
-
-        while(m > 0.0) {
-            if(randf64(0.0, 1.0) < m) {
-                const i32 w = randi64(0, weightTotalCount-1);
-                mutationCount++;
-
-                if(randf64(0.0, 1.0) < mutationResetWeight) {
-                    nni->weights[w] = randf64(-1.0, 1.0);
-                }
-                else {
-                    // safe mutation
-#if 0
-                    // pre mutation forward pass
-                    f64 preOutTotal = 0.0;
-                    memset(nni->prevHiddenValues, 0,
-                           sizeof(nni->prevHiddenValues[0]) * hiddenStateNeuronCount);
-                    for(i32 S = 0; S < SM_SAMPLES; S++) {
-                        nni->setInputs(sampleInputs + (S * inputCount), inputCount);
-                        rnnPropagate(&nni, 1, rnnDef);
-                        f64* output = nni->output;
-                        for(i32 o = 0; o < outputCount; o++) {
-                            preOutTotal += output[o];
-                        }
-                    }
-
-                    const f64 perturbation = randf64(-mutationStep, mutationStep);
-                    const f64 oldWeight = nni->weights[w];
-                    nni->weights[w] += perturbation;
-
-                    // post mutation forward pass
-                    f64 postOutTotal = 0.0;
-                    memset(nni->prevHiddenValues, 0,
-                           sizeof(nni->prevHiddenValues[0]) * hiddenStateNeuronCount);
-                    for(i32 S = 0; S < SM_SAMPLES; S++) {
-                        nni->setInputs(sampleInputs + (S * inputCount), inputCount);
-                        rnnPropagate(&nni, 1, rnnDef);
-                        f64* output = nni->output;
-                        for(i32 o = 0; o < outputCount; o++) {
-                            postOutTotal += output[o];
-                        }
-                    }
-
-                    f64 divergence = pow2(preOutTotal - postOutTotal) / SM_SAMPLES;
-                    divergence = min(divergence, 1.0);
-
-                    const f64 divergenceScaling = 0.5;
-                    const f64 keepBase = 1.0 - divergenceScaling;
-                    const f64 scaledPerturbation = perturbation * (keepBase + divergenceScaling
-                                                                   - divergence * divergenceScaling);
-                    nni->weights[w] = oldWeight + scaledPerturbation;
-
-                    LOG("%i> divergence: %g oldPert: %g scaledPert:  %g", i, divergence,
-                        perturbation, scaledPerturbation);
-
-#else
-                    nni->weights[w] += randf64(-mutationStep, mutationStep);
-#endif
-                }
-                m -= 1.0;
-            }
-        }
-    }
+    const i32 mutationCount = mutateWeights(nextGenNN, popCountMinusChamps, weightTotalCount,
+                                            mutationRate, mutationStep, mutationResetWeight);
 
     if(verbose) LOG("RnnEvol> mutationCount=%d", mutationCount);
 
@@ -1519,173 +1490,404 @@ void rnnEvolve(RnnEvolutionParams* params, bool verbose)
                sizeof(curGenNN[i]->prevHiddenValues[0]) * hiddenStateNeuronCount);
     }
 
+    mutationZone.stop();
+
     // speciation
+    PROFILE_SCOPE(speciationZone, "speciation");
     u8 speciesPrevExisted[RNN_MAX_SPECIES] = {0};
     for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
         speciesPrevExisted[s] = (speciesPopCount[s] != 0);
     }
 
-    RecurrentNeuralNet** speciesRep = speciation.speciesRep;
     mem_zero(speciation.speciesPopCount); // reset species population count
     speciesPopCount = speciation.speciesPopCount;
-    f64 biggestDist = 0.0;
 
-    const f64 compT = speciation.compT;
+    assignSpecies(curGenNN, popCount, curGenSpecies, speciation.speciesRep, speciesPopCount,
+                  speciesPrevExisted, speciation.compT, rnnDef);
+
+    scratchRewind(scratchStart);
+}
+
+// same operators as nnEvolve/rnnEvolve, applied to a few slots while the rest of the
+// population keeps being evaluated
+template<typename EvolutionParams>
+static void replaceWithOffspring(EvolutionParams* params, const i32* slots, const i32 slotCount,
+                                 const f64* parentFitness)
+{
+    const i32 popCount = params->popCount;
+    auto** nets = params->curGenRNN;
+    i32* species = params->curGenSpecies;
+    const auto& def = *params->rnnDef;
+    auto& speciation = *params->speciation;
+    i32* speciesPopCount = speciation.speciesPopCount;
+    const i32 weightTotalCount = def.weightTotalCount;
+
+    // replaced nets leave their species
+    for(i32 k = 0; k < slotCount; ++k) {
+        const i32 id = slots[k];
+        assert(parentFitness[id] <= 0.0); // a replaced net can't be a parent
+        speciesPopCount[species[id]]--;
+        assert(speciesPopCount[species[id]] >= 0);
+    }
 
+    // fitness sharing
+    const i64 scratchStart = scratchMark();
+    f64* sharedFitness = scratchArr<f64>(popCount);
+    f64 totalFitness = 0.0;
     for(i32 i = 0; i < popCount; ++i) {
-        RecurrentNeuralNet* nni = curGenNN[i];
+        sharedFitness[i] = 0.0;
+        if(parentFitness[i] <= 0.0) continue;
+        sharedFitness[i] = parentFitness[i] / speciesPopCount[species[i]];
+        totalFitness += sharedFitness[i];
+    }
 
-        bool found = false;
-        for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
-            if(!speciesPrevExisted[s] && speciesPopCount[s] == 0) continue;
+    i32* mateIds = scratchArr<i32>(popCount);
+    f64* mateFitness = scratchArr<f64>(popCount);
 
-            f64 dist = compatibilityDistance(speciesRep[s]->weights, nni->weights, weightTotalCount);
-            biggestDist = max(dist, biggestDist);
-            if(dist < compT) {
-                curGenSpecies[i] = s;
-                speciesPopCount[s]++;
-                found = true;
+    for(i32 k = 0; k < slotCount; ++k) {
+        auto* child = nets[slots[k]];
+
+        if(totalFitness <= 0.0) {
+            // nobody to breed from yet
+            randFillF64(child->weights, weightTotalCount, -1.0, 1.0);
+        }
+        else {
+            const i32 idA = selectRoulette(popCount, sharedFitness, totalFitness);
+            const i32 speciesA = species[idA];
+
+            i32 mateCount = 0;
+            f64 mateTotalFitness = 0.0;
+            if(randf64(0.0, 1.0) >= 0.25) { // copy 25% (no crossover)
+                for(i32 j = 0; j < popCount; ++j) {
+                    if(j != idA && sharedFitness[j] > 0.0 && species[j] == speciesA) {
+                        const i32 mid = mateCount++;
+                        mateIds[mid] = j;
+                        mateFitness[mid] = sharedFitness[j];
+                        mateTotalFitness += sharedFitness[j];
+                    }
+                }
+            }
+
+            if(mateCount < 1) {
+                netCopy(child, nets[idA], def);
+            }
+            else {
+                const i32 idB = mateIds[selectRoulette(mateCount, mateFitness, mateTotalFitness)];
+                nnCrossover(child->weights, nets[idA]->weights, nets[idB]->weights, weightTotalCount);
+            }
+        }
+
+        mutateWeights(&child, 1, weightTotalCount, params->mutationRate, params->mutationStep,
+                      params->mutationReset);
+
+        memset(child->values, 0, sizeof(child->values[0]) * def.neuronCount);
+
+        // speciation
+        i32 sid = -1;
+        for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
+            if(speciesPopCount[s] == 0) continue;
+            f64 dist = compatibilityDistance(speciation.speciesRep[s]->weights, child->weights,
+                                             weightTotalCount);
+            if(dist < speciation.compT) {
+                sid = s;
                 break;
             }
         }
 
-        if(!found) {
-            // find a species slot
-            i32 sid = -1;
+        if(sid == -1) {
             for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
-                if(!speciesPrevExisted[s] && speciesPopCount[s] == 0) {
+                if(speciesPopCount[s] == 0) {
                     sid = s;
                     break;
                 }
             }
             assert(sid >= 0 && sid < RNN_MAX_SPECIES);
-
-            rnnCopy(speciesRep[sid], nni, rnnDef);
-            speciesPopCount[sid] = 1;
-            curGenSpecies[i] = sid;
+            netCopy(speciation.speciesRep[sid], child, def);
+            speciation.stagnation[sid] = 0;
+            speciation.maxFitness[sid] = 0.0;
         }
+
+        species[slots[k]] = sid;
+        speciesPopCount[sid]++;
     }
+
+    scratchRewind(scratchStart);
 }
 
-void ImGui_NeuralNet(const NeuralNet* nn, const NeuralNetDef& def)
+void nnReplaceWithOffspring(NnEvolutionParams* params, const i32* slots, const i32 slotCount,
+                            const f64* parentFitness)
 {
-    ImGuiWindow* window = ImGui::GetCurrentWindow();
-    if (window->SkipItems)
-        return;
+    replaceWithOffspring(params, slots, slotCount, parentFitness);
+}
 
-    constexpr i32 cellsPerLine = 10;
-    const ImVec2 cellSize(10, 10);
-    i32 lines = def.neuronCount / cellsPerLine + 1;
-    ImVec2 size(cellsPerLine * cellSize.x, lines * cellSize.y);
+void rnnReplaceWithOffspring(RnnEvolutionParams* params, const i32* slots, const i32 slotCount,
+                             const f64* parentFitness)
+{
+    replaceWithOffspring(params, slots, slotCount, parentFitness);
+}
 
-    ImVec2 pos = window->DC.CursorPos;
-    const ImRect bb(pos, pos + size);
-    ImGui::ItemSize(bb);
+// SNAPSHOT
+template<typename Net, typename Def, typename Speciation>
+static void netSnapshotAdd(SnapshotWriter* sw, u32 index, Net** nets, const i32 popCount,
+                           const i32* species, const Speciation& speciation, const Def& def)
+{
+    const i32 weightTotalCount = def.weightTotalCount;
+    snapshotAdd(sw, NN_SNAPSHOT_DEF, index, &def, sizeof(def), 1);
 
-    for(i32 i = 0; i < def.neuronCount; ++i) {
-        f32 w = clamp(nn->values[i] * 0.5, 0.0, 1.0);
-        u32 color = 0xff000000 | ((u8)(0xff*w) << 16)| ((u8)(0xff*w) << 8)| ((u8)(0xff*w));
-        i32 column = i % cellsPerLine;
-        i32 line = i / cellsPerLine;
-        ImVec2 offset(column * cellSize.x, line * cellSize.y);
-        ImGui::RenderFrame(pos + offset, pos + offset + cellSize, color, false, 0);
+    f64* weights = (f64*)snapshotAdd(sw, NN_SNAPSHOT_WEIGHTS, index, nullptr, sizeof(f64),
+                                     (i64)popCount * weightTotalCount);
+    for(i32 i = 0; i < popCount; ++i) {
+        memmove(weights + (i64)i * weightTotalCount, nets[i]->weights, sizeof(f64) * weightTotalCount);
+    }
+    snapshotAdd(sw, NN_SNAPSHOT_SPECIES, index, species, sizeof(species[0]), popCount);
+
+    // only up to the last species still alive
+    i32 repCount = 0;
+    for(i32 s = 0; s < RNN_MAX_SPECIES; ++s) {
+        if(speciation.speciesPopCount[s] != 0) repCount = s + 1;
     }
+    f64* repWeights = (f64*)snapshotAdd(sw, NN_SNAPSHOT_SPECIES_REP_WEIGHTS, index, nullptr,
+                                        sizeof(f64), (i64)repCount * weightTotalCount);
+    for(i32 s = 0; s < repCount; ++s) {
+        memmove(repWeights + (i64)s * weightTotalCount, speciation.speciesRep[s]->weights,
+                sizeof(f64) * weightTotalCount);
+    }
+
+    snapshotAdd(sw, NN_SNAPSHOT_SPECIES_POP_COUNT, index, speciation.speciesPopCount,
+                sizeof(speciation.speciesPopCount[0]), RNN_MAX_SPECIES);
+    snapshotAdd(sw, NN_SNAPSHOT_SPECIES_STAGNATION, index, speciation.stagnation,
+                sizeof(speciation.stagnation[0]), RNN_MAX_SPECIES);
+    snapshotAdd(sw, NN_SNAPSHOT_SPECIES_MAX_FITNESS, index, speciation.maxFitness,
+                sizeof(speciation.maxFitness[0]), RNN_MAX_SPECIES);
 }
 
-void ImGui_RecurrentNeuralNet(const RecurrentNeuralNet* nn, const RecurrentNeuralNetDef& def)
+template<typename Net, typename Def, typename Speciation>
+static bool netSnapshotRestore(const Snapshot& snap, u32 index, Net** nets, const i32 popCount,
+                               i32* species, Speciation* speciation, const Def& def)
 {
-    ImGuiWindow* window = ImGui::GetCurrentWindow();
-    if (window->SkipItems)
-        return;
+    assert(speciation->speciesRep[0]); // forgot to call (r)nnSpeciationInit ?
+    const i32 weightTotalCount = def.weightTotalCount;
 
-    constexpr i32 cellsPerLine = 14;
-    const ImVec2 cellSize(10, 10);
-    i32 lines = def.neuronCount / cellsPerLine + 1;
-    ImVec2 size(cellsPerLine * cellSize.x, lines * cellSize.y);
+    const Def* defIn = snapshotArrExact<Def>(snap, NN_SNAPSHOT_DEF, index, 1);
+    if(!defIn || defIn->layerCount != def.layerCount || defIn->weightTotalCount != weightTotalCount ||
+       memcmp(defIn->layerNeuronCount, def.layerNeuronCount,
+              sizeof(def.layerNeuronCount[0]) * def.layerCount) != 0) {
+        LOG("ERROR: snapshot %u was not made with this network layout", index);
+        return false;
+    }
+
+    i64 repWeightCount = 0;
+    const f64* weightsIn = snapshotArrExact<f64>(snap, NN_SNAPSHOT_WEIGHTS, index,
+                                                 (i64)popCount * weightTotalCount);
+    const i32* speciesIn = snapshotArrExact<i32>(snap, NN_SNAPSHOT_SPECIES, index, popCount);
+    const f64* repWeightsIn = snapshotArr<f64>(snap, NN_SNAPSHOT_SPECIES_REP_WEIGHTS, index,
+                                               &repWeightCount);
+    const i32* popCountIn = snapshotArrExact<i32>(snap, NN_SNAPSHOT_SPECIES_POP_COUNT, index,
+                                                  RNN_MAX_SPECIES);
+    const u16* stagnationIn = snapshotArrExact<u16>(snap, NN_SNAPSHOT_SPECIES_STAGNATION, index,
+                                                    RNN_MAX_SPECIES);
+    const f64* maxFitnessIn = snapshotArrExact<f64>(snap, NN_SNAPSHOT_SPECIES_MAX_FITNESS, index,
+                                                    RNN_MAX_SPECIES);
+    if(!weightsIn || !speciesIn || !repWeightsIn || !popCountIn || !stagnationIn || !maxFitnessIn ||
+       repWeightCount % weightTotalCount != 0 ||
+       repWeightCount / weightTotalCount > RNN_MAX_SPECIES) {
+        LOG("ERROR: snapshot %u is incomplete", index);
+        return false;
+    }
 
-    ImVec2 pos = window->DC.CursorPos;
-    const ImRect bb(pos, pos + size);
-    ImGui::ItemSize(bb);
+    for(i32 i = 0; i < popCount; ++i) {
+        memmove(nets[i]->weights, weightsIn + (i64)i * weightTotalCount,
+                sizeof(f64) * weightTotalCount);
+        memset(nets[i]->values, 0, sizeof(f64) * def.neuronCount);
+    }
+    memmove(species, speciesIn, sizeof(species[0]) * popCount);
 
-    for(i32 i = 0; i < def.neuronCount; ++i) {
-        i32 isNormalVal = i < (def.neuronCount - def.hiddenStateNeuronCount);
-        f32 w = clamp(nn->values[i] * 0.5, 0.0, 1.0);
-        u32 color = 0xff000000 | ((u8)(0xff*w) << 16)| ((u8)(0xff*w*isNormalVal) << 8)| ((u8)(0xff*w));
-        i32 column = i % cellsPerLine;
-        i32 line = i / cellsPerLine;
-        ImVec2 offset(column * cellSize.x, line * cellSize.y);
-        ImGui::RenderFrame(pos + offset, pos + offset + cellSize, color, false, 0);
+    const i32 repCount = repWeightCount / weightTotalCount;
+    for(i32 s = 0; s < repCount; ++s) {
+        memmove(speciation->speciesRep[s]->weights, repWeightsIn + (i64)s * weightTotalCount,
+                sizeof(f64) * weightTotalCount);
     }
+    memmove(speciation->speciesPopCount, popCountIn, sizeof(speciation->speciesPopCount));
+    memmove(speciation->stagnation, stagnationIn, sizeof(speciation->stagnation));
+    memmove(speciation->maxFitness, maxFitnessIn, sizeof(speciation->maxFitness));
+    return true;
 }
 
-void ImGui_SubPopWindow(const RnnEvolutionParams* env, const ImVec4* subPopColors)
+void nnSnapshotAdd(SnapshotWriter* sw, u32 index, NeuralNet** nets, const i32 popCount,
+                   const i32* species, const NnSpeciation& speciation, const NeuralNetDef& def)
 {
-    const i32 POP_COUNT = env->popCount;
-    const i32 speciesCount = RNN_MAX_SPECIES;
-    const i32* curSpeciesTag = env->curGenSpecies;
-    const f64* fitness = env->fitness;
-
-    f64* totalFitness = stack_arr(f64,speciesCount);
-    f64* maxFitness = stack_arr(f64,speciesCount);
-    f64* avgFitness = stack_arr(f64,speciesCount);
-    i32* subPopIndivCount = stack_arr(i32,speciesCount);
-    arr_zero(maxFitness,speciesCount);
-    arr_zero(totalFitness,speciesCount);
-    arr_zero(avgFitness,speciesCount);
-    arr_zero(subPopIndivCount,speciesCount);
-    f64 maxTotal = 0;
-    f64 maxMaxFitness = 0;
-    f64 maxAvg = 0;
-    i32 maxCount = 0;
-
-    for(i32 i = 0; i < POP_COUNT; ++i) {
-        maxFitness[curSpeciesTag[i]] = max(fitness[i], maxFitness[curSpeciesTag[i]]);
-        totalFitness[curSpeciesTag[i]] += fitness[i];
-        subPopIndivCount[curSpeciesTag[i]]++;
-    }
-    for(i32 i = 0; i < speciesCount; ++i) {
-        maxTotal = max(totalFitness[i], maxTotal);
-        maxMaxFitness = max(maxFitness[i], maxMaxFitness);
-        avgFitness[i] = totalFitness[i]/subPopIndivCount[i];
-        maxAvg = max(avgFitness[i], maxAvg);
-        maxCount = max(subPopIndivCount[i], maxCount);
-    }
-
-    ImGui::Begin("Sub populations");
-
-    if(ImGui::CollapsingHeader("Population count")) {
-        for(i32 i = 0; i < speciesCount; ++i) {
-            ImGui::PushStyleColor(ImGuiCol_PlotHistogram, subPopColors[i]);
-            char buff[64];
-            sprintf(buff, "%d", subPopIndivCount[i]);
-            ImGui::ProgressBar(subPopIndivCount[i]/(f32)maxCount, ImVec2(-1,0), buff);
-            ImGui::PopStyleColor(1);
-        }
+    netSnapshotAdd(sw, index, nets, popCount, species, speciation, def);
+}
+
+bool nnSnapshotRestore(const Snapshot& snap, u32 index, NeuralNet** nets, const i32 popCount,
+                       i32* species, NnSpeciation* speciation, const NeuralNetDef& def)
+{
+    return netSnapshotRestore(snap, index, nets, popCount, species, speciation, def);
+}
+
+void rnnSnapshotAdd(SnapshotWriter* sw, u32 index, RecurrentNeuralNet** nets, const i32 popCount,
+                    const i32* species, const RnnSpeciation& speciation,
+                    const RecurrentNeuralNetDef& def)
+{
+    netSnapshotAdd(sw, index, nets, popCount, species, speciation, def);
+}
+
+bool rnnSnapshotRestore(const Snapshot& snap, u32 index, RecurrentNeuralNet** nets,
+                        const i32 popCount, i32* species, RnnSpeciation* speciation,
+                        const RecurrentNeuralNetDef& def)
+{
+    return netSnapshotRestore(snap, index, nets, popCount, species, speciation, def);
+}
+
+// EXPORT
+static void exportCLayerTerms(CExport* ex, const f64* weights, i32 prevLayer, i32 prevCount)
+{
+    for(i32 s = 0; s < prevCount; ++s) {
+        if(prevLayer == 0) exportCSumTerm(ex, weights[s], "in[%d]", s);
+        else exportCSumTerm(ex, weights[s], "h%d_%d", prevLayer, s);
     }
+}
 
-    if(ImGui::CollapsingHeader("Total fitness")) {
-        for(i32 i = 0; i < speciesCount; ++i) {
-            ImGui::PushStyleColor(ImGuiCol_PlotHistogram, subPopColors[i]);
-            ImGui::ProgressBar(totalFitness[i]/maxTotal);
-            ImGui::PopStyleColor(1);
+bool nnExportC(const char* path, const NeuralNet* nn, const NeuralNetDef& def)
+{
+    const i32 layerCount = def.layerCount;
+    const i32 inputCount = def.inputNeuronCount;
+    const i32 outputCount = def.outputNeuronCount;
+
+    char description[128];
+    snprintf(description, sizeof(description), "neural net, %d layers, %d weights", layerCount,
+             def.weightTotalCount);
+    CExport ex;
+    bool ok = exportCBegin(&ex, path, description, inputCount, outputCount, 0,
+                           ACTIVATION_FUNC == ACTFUNC_RELU);
+    if(ok) {
+        exportCFunctionBegin(&ex);
+
+        // same order as nnPropagate, the last layer goes straight to out
+        const f64* weights = nn->weights;
+        for(i32 l = 1; l < layerCount; ++l) {
+            const i32 prevCount = def.layerNeuronCount[l-1];
+            for(i32 n = 0; n < def.layerNeuronCount[l]; ++n) {
+                char lhs[32];
+                if(l == layerCount-1) snprintf(lhs, sizeof(lhs), "out[%d]", n);
+                else snprintf(lhs, sizeof(lhs), "const double h%d_%d", l, n);
+                exportCSumBegin(&ex, lhs, def.bias);
+                exportCLayerTerms(&ex, weights, l-1, prevCount);
+                exportCSumEnd(&ex);
+                weights += prevCount;
+            }
         }
+        exportCFunctionEnd(&ex);
+        ok = exportCEnd(&ex);
+    }
+
+    if(ok) {
+        const i32 sampleCount = EXPORT_C_TEST_SAMPLES;
+        const i64 mark = scratchMark();
+        f64* inputs = scratchArr<f64>(sampleCount * inputCount);
+        f64* expected = scratchArr<f64>(sampleCount * outputCount);
+        exportCTestInputs(inputs, sampleCount * inputCount);
+
+        // same layout as nnAlloc, the weights are only read
+        NeuralNet net;
+        net.values = scratchArr<f64>(def.neuronCount);
+        net.weights = nn->weights;
+        net.output = net.values + def.neuronCount - outputCount;
+        NeuralNet* netPtr = &net;
+        for(i32 s = 0; s < sampleCount; ++s) {
+            net.setInputs(&inputs[s * inputCount], inputCount);
+            nnPropagate(&netPtr, 1, def);
+            memmove(&expected[s * outputCount], net.output, sizeof(f64) * outputCount);
+        }
+        ok = exportCWriteHarness(ex, inputs, expected, sampleCount);
+        scratchRewind(mark);
     }
+    return ok;
+}
+
+bool rnnExportC(const char* path, const RecurrentNeuralNet* nn, const RecurrentNeuralNetDef& def)
+{
+    const i32 layerCount = def.layerCount;
+    const i32 inputCount = def.inputNeuronCount;
+    const i32 outputCount = def.outputNeuronCount;
+    const i32 stateCount = def.hiddenStateNeuronCount;
+
+    char description[128];
+    snprintf(description, sizeof(description), "recurrent neural net, %d layers, %d weights",
+             layerCount, def.weightTotalCount);
+    CExport ex;
+    bool ok = exportCBegin(&ex, path, description, inputCount, outputCount, stateCount,
+                           ACTIVATION_FUNC == ACTFUNC_RELU);
+    if(ok) {
+        exportCFunctionBegin(&ex);
+
+        // same order as rnnPropagate, the state holds the hidden values of the previous call
+        const f64* weights = nn->weights;
+        const f64* prevHiddenWeights = nn->prevHiddenWeights;
+        i32 stateOffset = 0;
+        for(i32 l = 1; l < layerCount-1; ++l) {
+            const i32 prevCount = def.layerNeuronCount[l-1];
+            const i32 hiddenCount = def.layerNeuronCount[l];
+            for(i32 n = 0; n < hiddenCount; ++n) {
+                char lhs[32];
+                snprintf(lhs, sizeof(lhs), "const double h%d_%d", l, n);
+                exportCSumBegin(&ex, lhs, def.bias);
+                exportCLayerTerms(&ex, weights, l-1, prevCount);
+                for(i32 s = 0; s < hiddenCount; ++s) {
+                    exportCSumTerm(&ex, prevHiddenWeights[s], "state[%d]", stateOffset + s);
+                }
+                exportCSumEnd(&ex);
+                weights += prevCount;
+                prevHiddenWeights += hiddenCount;
+            }
+            stateOffset += hiddenCount;
+        }
 
-    if(ImGui::CollapsingHeader("Average fitness")) {
-        for(i32 i = 0; i < speciesCount; ++i) {
-            ImGui::PushStyleColor(ImGuiCol_PlotHistogram, subPopColors[i]);
-            ImGui::ProgressBar(avgFitness[i]/maxAvg);
-            ImGui::PopStyleColor(1);
+        const i32 prevCount = def.layerNeuronCount[layerCount-2];
+        for(i32 n = 0; n < outputCount; ++n) {
+            char lhs[32];
+            snprintf(lhs, sizeof(lhs), "out[%d]", n);
+            exportCSumBegin(&ex, lhs, def.bias);
+            exportCLayerTerms(&ex, weights, layerCount-2, prevCount);
+            exportCSumEnd(&ex);
+            weights += prevCount;
         }
-    }
 
-    if(ImGui::CollapsingHeader("Max fitness")) {
-        for(i32 i = 0; i < speciesCount; ++i) {
-            ImGui::PushStyleColor(ImGuiCol_PlotHistogram, subPopColors[i]);
-            ImGui::ProgressBar(maxFitness[i]/maxMaxFitness);
-            ImGui::PopStyleColor(1);
+        fprintf(ex.file, "\n");
+        stateOffset = 0;
+        for(i32 l = 1; l < layerCount-1; ++l) {
+            for(i32 n = 0; n < def.layerNeuronCount[l]; ++n) {
+                fprintf(ex.file, "    state[%d] = h%d_%d;\n", stateOffset + n, l, n);
+            }
+            stateOffset += def.layerNeuronCount[l];
+        }
+        exportCFunctionEnd(&ex);
+        ok = exportCEnd(&ex);
+    }
+
+    if(ok) {
+        const i32 sampleCount = EXPORT_C_TEST_SAMPLES;
+        const i64 mark = scratchMark();
+        f64* inputs = scratchArr<f64>(sampleCount * inputCount);
+        f64* expected = scratchArr<f64>(sampleCount * outputCount);
+        exportCTestInputs(inputs, sampleCount * inputCount);
+
+        // same layout as rnnAlloc with a zeroed hidden state, the weights are only read
+        RecurrentNeuralNet net;
+        net.values = scratchArr<f64>(def.neuronCount);
+        net.weights = nn->weights;
+        net.prevHiddenValues = net.values + def.neuronCount - stateCount;
+        net.prevHiddenWeights = nn->weights + def.weightTotalCount - def.hiddenStateWeightCount;
+        net.output = net.prevHiddenValues - outputCount;
+        arr_zero(net.values, def.neuronCount);
+        RecurrentNeuralNet* netPtr = &net;
+        for(i32 s = 0; s < sampleCount; ++s) {
+            net.setInputs(&inputs[s * inputCount], inputCount);
+            rnnPropagate(&netPtr, 1, def);
+            memmove(&expected[s * outputCount], net.output, sizeof(f64) * outputCount);
         }
+        ok = exportCWriteHarness(ex, inputs, expected, sampleCount);
+        scratchRewind(mark);
     }
-
-    ImGui::End();
+    return ok;
 }
@@ -1,6 +1,12 @@
 #pragma once
 #include "base.h"
-#include <intrin.h>
+#include "snapshot.h"
+#include "export_c.h"
+#ifdef _MSC_VER
+    #include <intrin.h>
+#else
+    #include <x86intrin.h>
+#endif
 #include <emmintrin.h>
 
 #define NN_MAX_LAYERS 10
@@ -102,6 +108,9 @@ void nnPropagate(NeuralNet** nn, const i32 nnCount, const NeuralNetDef& def);
 
 void nnCrossover(f64* outWeights, f64* parentBWeights, f64* parentAWeights, i32 weightCount);
 void nnEvolve(NnEvolutionParams* params, bool verbose = false);
+// steady state: replace the nets in slots with offspring of the nets with parentFitness > 0
+void nnReplaceWithOffspring(NnEvolutionParams* params, const i32* slots, const i32 slotCount,
+                            const f64* parentFitness);
 
 union alignas(w128d) RecurrentNeuralNet
 {
@@ -178,12 +187,40 @@ void rnnPropagateWide(RecurrentNeuralNet** nn, const i32 nnCount, const Recurren
 
 void rnnCrossover(f64* outWeights, f64* parentBWeights, f64* parentAWeights, i32 weightCount);
 void rnnEvolve(RnnEvolutionParams* params, bool verbose = false);
+void rnnReplaceWithOffspring(RnnEvolutionParams* params, const i32* slots, const i32 slotCount,
+                             const f64* parentFitness);
+
+// SNAPSHOT
+// weights of a population (the hidden state isn't kept), index tells apart several populations
+// the DEF section has the layout of the def type, a nn snapshot doesn't load as a rnn one
+#define NN_SNAPSHOT_DEF 16
+#define NN_SNAPSHOT_WEIGHTS 17
+#define NN_SNAPSHOT_SPECIES 18
+#define NN_SNAPSHOT_SPECIES_REP_WEIGHTS 19
+#define NN_SNAPSHOT_SPECIES_POP_COUNT 20
+#define NN_SNAPSHOT_SPECIES_STAGNATION 21
+#define NN_SNAPSHOT_SPECIES_MAX_FITNESS 22
+
+void nnSnapshotAdd(SnapshotWriter* sw, u32 index, NeuralNet** nets, const i32 popCount,
+                   const i32* species, const NnSpeciation& speciation, const NeuralNetDef& def);
+// nets and speciation have to be allocated (after nnSpeciationInit)
+bool nnSnapshotRestore(const Snapshot& snap, u32 index, NeuralNet** nets, const i32 popCount,
+                       i32* species, NnSpeciation* speciation, const NeuralNetDef& def);
+void rnnSnapshotAdd(SnapshotWriter* sw, u32 index, RecurrentNeuralNet** nets, const i32 popCount,
+                    const i32* species, const RnnSpeciation& speciation,
+                    const RecurrentNeuralNetDef& def);
+bool rnnSnapshotRestore(const Snapshot& snap, u32 index, RecurrentNeuralNet** nets,
+                        const i32 popCount, i32* species, RnnSpeciation* speciation,
+                        const RecurrentNeuralNetDef& def);
+
+// EXPORT
+// see exportCBegin, the harness checks against nnPropagate/rnnPropagate
+// the state of an RNN export is its hidden values of the previous call
+bool nnExportC(const char* path, const NeuralNet* nn, const NeuralNetDef& def);
+bool rnnExportC(const char* path, const RecurrentNeuralNet* nn, const RecurrentNeuralNetDef& def);
 
 void testWideTanh();
+f64 nnTestCompatibility(const f64* weightA, const f64* weightB, const i32 weightCount);
 void testPropagateNN();
 void testPropagateRNN();
 void testPropagateRNNWide();
-
-void ImGui_NeuralNet(const NeuralNet* nn, const NeuralNetDef& def);
-void ImGui_RecurrentNeuralNet(const RecurrentNeuralNet* nn, const RecurrentNeuralNetDef& def);
-void ImGui_SubPopWindow(const RnnEvolutionParams* env, const struct ImVec4* subPopColors);
@@ -0,0 +1,128 @@
+#include "neural_imgui.h"
+#include <malloc.h>
+#include "imgui/imgui.h"
+#define IMGUI_DEFINE_MATH_OPERATORS
+#include "imgui/imgui_internal.h"
+
+void ImGui_NeuralNet(const NeuralNet* nn, const NeuralNetDef& def)
+{
+    ImGuiWindow* window = ImGui::GetCurrentWindow();
+    if (window->SkipItems)
+        return;
+
+    constexpr i32 cellsPerLine = 10;
+    const ImVec2 cellSize(10, 10);
+    i32 lines = def.neuronCount / cellsPerLine + 1;
+    ImVec2 size(cellsPerLine * cellSize.x, lines * cellSize.y);
+
+    ImVec2 pos = window->DC.CursorPos;
+    const ImRect bb(pos, pos + size);
+    ImGui::ItemSize(bb);
+
+    for(i32 i = 0; i < def.neuronCount; ++i) {
+        f32 w = clamp(nn->values[i] * 0.5, 0.0, 1.0);
+        u32 color = 0xff000000 | ((u8)(0xff*w) << 16)| ((u8)(0xff*w) << 8)| ((u8)(0xff*w));
+        i32 column = i % cellsPerLine;
+        i32 line = i / cellsPerLine;
+        ImVec2 offset(column * cellSize.x, line * cellSize.y);
+        ImGui::RenderFrame(pos + offset, pos + offset + cellSize, color, false, 0);
+    }
+}
+
+void ImGui_RecurrentNeuralNet(const RecurrentNeuralNet* nn, const RecurrentNeuralNetDef& def)
+{
+    ImGuiWindow* window = ImGui::GetCurrentWindow();
+    if (window->SkipItems)
+        return;
+
+    constexpr i32 cellsPerLine = 14;
+    const ImVec2 cellSize(10, 10);
+    i32 lines = def.neuronCount / cellsPerLine + 1;
+    ImVec2 size(cellsPerLine * cellSize.x, lines * cellSize.y);
+
+    ImVec2 pos = window->DC.CursorPos;
+    const ImRect bb(pos, pos + size);
+    ImGui::ItemSize(bb);
+
+    for(i32 i = 0; i < def.neuronCount; ++i) {
+        i32 isNormalVal = i < (def.neuronCount - def.hiddenStateNeuronCount);
+        f32 w = clamp(nn->values[i] * 0.5, 0.0, 1.0);
+        u32 color = 0xff000000 | ((u8)(0xff*w) << 16)| ((u8)(0xff*w*isNormalVal) << 8)| ((u8)(0xff*w));
+        i32 column = i % cellsPerLine;
+        i32 line = i / cellsPerLine;
+        ImVec2 offset(column * cellSize.x, line * cellSize.y);
+        ImGui::RenderFrame(pos + offset, pos + offset + cellSize, color, false, 0);
+    }
+}
+
+void ImGui_SubPopWindow(const RnnEvolutionParams* env, const ImVec4* subPopColors)
+{
+    const i32 POP_COUNT = env->popCount;
+    const i32 speciesCount = RNN_MAX_SPECIES;
+    const i32* curSpeciesTag = env->curGenSpecies;
+    const f64* fitness = env->fitness;
+
+    f64* totalFitness = stack_arr(f64,speciesCount);
+    f64* maxFitness = stack_arr(f64,speciesCount);
+    f64* avgFitness = stack_arr(f64,speciesCount);
+    i32* subPopIndivCount = stack_arr(i32,speciesCount);
+    arr_zero(maxFitness,speciesCount);
+    arr_zero(totalFitness,speciesCount);
+    arr_zero(avgFitness,speciesCount);
+    arr_zero(subPopIndivCount,speciesCount);
+    f64 maxTotal = 0;
+    f64 maxMaxFitness = 0;
+    f64 maxAvg = 0;
+    i32 maxCount = 0;
+
+    for(i32 i = 0; i < POP_COUNT; ++i) {
+        maxFitness[curSpeciesTag[i]] = max(fitness[i], maxFitness[curSpeciesTag[i]]);
+        totalFitness[curSpeciesTag[i]] += fitness[i];
+        subPopIndivCount[curSpeciesTag[i]]++;
+    }
+    for(i32 i = 0; i < speciesCount; ++i) {
+        maxTotal = max(totalFitness[i], maxTotal);
+        maxMaxFitness = max(maxFitness[i], maxMaxFitness);
+        avgFitness[i] = totalFitness[i]/subPopIndivCount[i];
+        maxAvg = max(avgFitness[i], maxAvg);
+        maxCount = max(subPopIndivCount[i], maxCount);
+    }
+
+    ImGui::Begin("Sub populations");
+
+    if(ImGui::CollapsingHeader("Population count")) {
+        for(i32 i = 0; i < speciesCount; ++i) {
+            ImGui::PushStyleColor(ImGuiCol_PlotHistogram, subPopColors[i]);
+            char buff[64];
+            sprintf(buff, "%d", subPopIndivCount[i]);
+            ImGui::ProgressBar(subPopIndivCount[i]/(f32)maxCount, ImVec2(-1,0), buff);
+            ImGui::PopStyleColor(1);
+        }
+    }
+
+    if(ImGui::CollapsingHeader("Total fitness")) {
+        for(i32 i = 0; i < speciesCount; ++i) {
+            ImGui::PushStyleColor(ImGuiCol_PlotHistogram, subPopColors[i]);
+            ImGui::ProgressBar(totalFitness[i]/maxTotal);
+            ImGui::PopStyleColor(1);
+        }
+    }
+
+    if(ImGui::CollapsingHeader("Average fitness")) {
+        for(i32 i = 0; i < speciesCount; ++i) {
+            ImGui::PushStyleColor(ImGuiCol_PlotHistogram, subPopColors[i]);
+            ImGui::ProgressBar(avgFitness[i]/maxAvg);
+            ImGui::PopStyleColor(1);
+        }
+    }
+
+    if(ImGui::CollapsingHeader("Max fitness")) {
+        for(i32 i = 0; i < speciesCount; ++i) {
+            ImGui::PushStyleColor(ImGuiCol_PlotHistogram, subPopColors[i]);
+            ImGui::ProgressBar(maxFitness[i]/maxMaxFitness);
+            ImGui::PopStyleColor(1);
+        }
+    }
+
+    ImGui::End();
+}
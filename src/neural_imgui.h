@@ -0,0 +1,6 @@
+#pragma once
+#include "neural.h"
+
+void ImGui_NeuralNet(const NeuralNet* nn, const NeuralNetDef& def);
+void ImGui_RecurrentNeuralNet(const RecurrentNeuralNet* nn, const RecurrentNeuralNetDef& def);
+void ImGui_SubPopWindow(const RnnEvolutionParams* env, const struct ImVec4* subPopColors);
@@ -0,0 +1,56 @@
+#include "profile_imgui.h"
+#include "base.h"
+#include "imgui/imgui.h"
+
+#define PROFILE_UI_TRACE_PATH "trace.json"
+
+void ImGui_ProfileWindow()
+{
+    const ProfileStats& lastFrame = profileLastFrame();
+    const f64 avgFrameMicro = profileAverageFrameMicro();
+
+    ImGui::Begin("Profile");
+
+    bool recording = traceIsRecording();
+    if(ImGui::Checkbox("Record trace (" PROFILE_UI_TRACE_PATH ")", &recording)) {
+        if(recording) {
+            traceStart(PROFILE_UI_TRACE_PATH);
+        }
+        else {
+            traceStop();
+        }
+    }
+
+    ImGui::Text("frame: %.3fms (avg %.3fms)", timeCyclesToMicro(lastFrame.frameCycles) / 1000.0,
+                avgFrameMicro / 1000.0);
+    ImGui::Separator();
+
+    ImGui::Columns(4, "profileZones");
+    ImGui::TextUnformatted("zone");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("last (ms)");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("avg (ms)");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("calls");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    // zones run on several threads (parallel fors, background evolution) can exceed 100%
+    const i32 zoneCount = profileZoneCount();
+    for(i32 z = 0; z < zoneCount; ++z) {
+        const f64 avgMicro = profileAverageMicro(z);
+        ImGui::TextUnformatted(profileZoneName(z));
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", timeCyclesToMicro(lastFrame.zoneCycles[z]) / 1000.0);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f (%.0f%%)", avgMicro / 1000.0,
+                    avgFrameMicro > 0.0 ? avgMicro / avgFrameMicro * 100.0 : 0.0);
+        ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long)lastFrame.zoneCalls[z]);
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+    ImGui::End();
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// last frame and smoothed time of every profile zone
+void ImGui_ProfileWindow();
@@ -0,0 +1,248 @@
+#include "snapshot.h"
+#include <assert.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static i64 snapshotAlign(i64 v)
+{
+    return (v + 63) & ~(i64)63;
+}
+
+static void snapshotReserve(SnapshotWriter* sw, i64 size)
+{
+    if(size <= sw->capacity) return;
+    i64 capacity = max(sw->capacity * 2, (i64)(1024 * 1024));
+    while(capacity < size) capacity *= 2;
+
+    u8* data = (u8*)_aligned_malloc(capacity, 64);
+    assert(data);
+    if(sw->data) {
+        memmove(data, sw->data, sw->size);
+        _aligned_free(sw->data);
+    }
+    sw->data = data;
+    sw->capacity = capacity;
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    snapshotWait(this);
+    if(data) _aligned_free(data);
+}
+
+void snapshotBegin(SnapshotWriter* sw, u32 kind)
+{
+    snapshotWait(sw);
+
+    sw->size = snapshotAlign(sizeof(SnapshotHeader));
+    snapshotReserve(sw, sw->size);
+    memset(sw->data, 0, sw->size);
+
+    SnapshotHeader& header = *(SnapshotHeader*)sw->data;
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.kind = kind;
+}
+
+void* snapshotAdd(SnapshotWriter* sw, u32 id, u32 index, const void* data, i64 elemSize, i64 count)
+{
+    assert(sw->size > 0); // forgot to call snapshotBegin() ?
+    assert(elemSize > 0 && count >= 0);
+    const i64 offset = sw->size;
+    const i64 dataSize = elemSize * count;
+    snapshotReserve(sw, offset + snapshotAlign(dataSize));
+
+    SnapshotHeader& header = *(SnapshotHeader*)sw->data;
+    assert(header.sectionCount < SNAPSHOT_MAX_SECTIONS);
+    header.sections[header.sectionCount++] = { id, index, elemSize, count, offset };
+
+    u8* dest = sw->data + offset;
+    if(data) {
+        memmove(dest, data, dataSize);
+    }
+    memset(dest + dataSize, 0, snapshotAlign(dataSize) - dataSize);
+    sw->size = offset + snapshotAlign(dataSize);
+    return dest;
+}
+
+static void snapshotWriteFile(SnapshotWriter* sw)
+{
+    char tmpPath[sizeof(sw->path) + 8];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", sw->path);
+
+    FILE* file = fopen(tmpPath, "wb");
+    if(!file) {
+        LOG("ERROR: snapshot> could not open %s", tmpPath);
+        return;
+    }
+    const bool written = fwrite(sw->data, 1, sw->size, file) == (size_t)sw->size;
+    const bool closed = fclose(file) == 0;
+    if(!written || !closed) {
+        LOG("ERROR: snapshot> could not write %s", tmpPath);
+        remove(tmpPath);
+        return;
+    }
+
+#ifdef _WIN32
+    const bool renamed = MoveFileExA(tmpPath, sw->path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    const bool renamed = rename(tmpPath, sw->path) == 0;
+#endif
+    if(!renamed) {
+        LOG("ERROR: snapshot> could not replace %s", sw->path);
+        return;
+    }
+    LOG("snapshot> %s written (%lld bytes)", sw->path, (long long)sw->size);
+}
+
+void snapshotWriteAsync(SnapshotWriter* sw, const char* path)
+{
+    assert(!sw->thread.joinable());
+    SnapshotHeader& header = *(SnapshotHeader*)sw->data;
+    header.fileSize = sw->size;
+
+    snprintf(sw->path, sizeof(sw->path), "%s", path);
+    sw->thread = std::thread(snapshotWriteFile, sw);
+}
+
+void snapshotWait(SnapshotWriter* sw)
+{
+    if(sw->thread.joinable()) {
+        sw->thread.join();
+    }
+}
+
+static bool snapshotCheck(const Snapshot& snap, const char* path, u32 kind)
+{
+    const SnapshotHeader& header = *snap.header;
+    if(snap.size < (i64)sizeof(SnapshotHeader) || header.magic != SNAPSHOT_MAGIC) {
+        LOG("ERROR: snapshot> %s is not a snapshot", path);
+        return false;
+    }
+    if(header.version != SNAPSHOT_VERSION || header.kind != kind) {
+        LOG("ERROR: snapshot> %s has version %u kind 0x%x, expected version %u kind 0x%x", path,
+            header.version, header.kind, SNAPSHOT_VERSION, kind);
+        return false;
+    }
+    if(header.fileSize != snap.size || header.sectionCount < 0 ||
+       header.sectionCount > SNAPSHOT_MAX_SECTIONS) {
+        LOG("ERROR: snapshot> %s is truncated", path);
+        return false;
+    }
+    for(i32 s = 0; s < header.sectionCount; ++s) {
+        const SnapshotSection& section = header.sections[s];
+        if(section.elemSize <= 0 || section.count < 0 || section.offset < 0 ||
+           section.count > (snap.size - section.offset) / section.elemSize) {
+            LOG("ERROR: snapshot> %s section %u:%u is out of bounds", path, section.id, section.index);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool snapshotOpen(Snapshot* snap, const char* path, u32 kind)
+{
+    assert(!snap->data);
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = NULL;
+    const void* data = nullptr;
+    if(GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    if(mapping) {
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if(!data) {
+        LOG("ERROR: snapshot> could not map %s", path);
+        if(mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    snap->fileHandle = file;
+    snap->mappingHandle = mapping;
+    snap->size = fileSize.QuadPart;
+#else
+    const i32 fd = open(path, O_RDONLY);
+    if(fd == -1) {
+        return false;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd); // the mapping keeps the file
+    if(data == MAP_FAILED) {
+        LOG("ERROR: snapshot> could not map %s", path);
+        return false;
+    }
+    snap->size = st.st_size;
+#endif
+
+    snap->data = (const u8*)data;
+    snap->header = (const SnapshotHeader*)data;
+    if(!snapshotCheck(*snap, path, kind)) {
+        snapshotClose(snap);
+        return false;
+    }
+    return true;
+}
+
+void snapshotClose(Snapshot* snap)
+{
+    if(!snap->data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(snap->data);
+    CloseHandle(snap->mappingHandle);
+    CloseHandle(snap->fileHandle);
+#else
+    munmap((void*)snap->data, snap->size);
+#endif
+    *snap = {};
+}
+
+const void* snapshotSection(const Snapshot& snap, u32 id, u32 index, i64 elemSize, i64* count)
+{
+    const SnapshotHeader& header = *snap.header;
+    for(i32 s = 0; s < header.sectionCount; ++s) {
+        const SnapshotSection& section = header.sections[s];
+        if(section.id != id || section.index != index) continue;
+        if(section.elemSize != elemSize) {
+            LOG("ERROR: snapshot> section %u:%u has %lld byte elements, expected %lld", id, index,
+                (long long)section.elemSize, (long long)elemSize);
+            return nullptr;
+        }
+        if(count) *count = section.count;
+        return snap.data + section.offset;
+    }
+    return nullptr;
+}
+
+bool snapshotConfigFromEnv(char* path, i32 pathSize, i32* interval)
+{
+    const char* file = getenv("SNAPSHOT_FILE");
+    if(!file || !file[0]) return false;
+    snprintf(path, pathSize, "%s", file);
+
+    *interval = SNAPSHOT_DEFAULT_INTERVAL;
+    const char* intervalStr = getenv("SNAPSHOT_INTERVAL");
+    if(intervalStr && intervalStr[0]) {
+        *interval = max(atoi(intervalStr), 1);
+    }
+    return true;
+}
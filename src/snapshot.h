@@ -0,0 +1,88 @@
+#pragma once
+#include "base.h"
+
+// versioned binary file made of raw arrays in their in-memory layout, each 64 byte aligned
+// a snapshot is mapped read-only and its sections are used in place, loading is only checks
+// sections are found by (id, index), the index telling apart several instances of the same data
+// native endianness and struct layout, a mismatching version or element size fails the open
+#define SNAPSHOT_MAGIC 0x50414e53 // "SNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_SECTIONS 64
+#define SNAPSHOT_SECTION_USER 1024 // first id free for the apps
+#define SNAPSHOT_DEFAULT_INTERVAL 50 // generations
+
+struct SnapshotSection
+{
+    u32 id;
+    u32 index;
+    i64 elemSize;
+    i64 count;
+    i64 offset; // from the start of the file
+};
+
+struct SnapshotHeader
+{
+    u32 magic;
+    u32 version;
+    u32 kind; // what wrote it, so an app doesn't load another app's snapshot
+    i32 sectionCount;
+    i64 fileSize;
+    i64 reserved;
+    SnapshotSection sections[SNAPSHOT_MAX_SECTIONS];
+};
+
+// the file is built in memory on the calling thread (the state keeps evolving meanwhile), then
+// a background thread writes it next to the destination and renames it over, so a crash never
+// leaves a half written snapshot behind
+struct SnapshotWriter
+{
+    u8* data = nullptr;
+    i64 size = 0;
+    i64 capacity = 0;
+    std::thread thread;
+    char path[256];
+
+    ~SnapshotWriter();
+};
+
+void snapshotBegin(SnapshotWriter* sw, u32 kind); // waits for the previous write
+// copies count elements as a new section and returns the copy, data can be null to fill it
+// afterwards (the pointer is valid until the next snapshotAdd)
+void* snapshotAdd(SnapshotWriter* sw, u32 id, u32 index, const void* data, i64 elemSize, i64 count);
+void snapshotWriteAsync(SnapshotWriter* sw, const char* path);
+void snapshotWait(SnapshotWriter* sw);
+
+struct Snapshot
+{
+    const u8* data = nullptr;
+    i64 size = 0;
+    const SnapshotHeader* header = nullptr;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+bool snapshotOpen(Snapshot* snap, const char* path, u32 kind);
+void snapshotClose(Snapshot* snap);
+// null if missing or if its elements aren't elemSize bytes
+const void* snapshotSection(const Snapshot& snap, u32 id, u32 index, i64 elemSize, i64* count);
+
+template<typename T>
+inline const T* snapshotArr(const Snapshot& snap, u32 id, u32 index, i64* count)
+{
+    return (const T*)snapshotSection(snap, id, index, sizeof(T), count);
+}
+
+// null unless it holds exactly count elements
+template<typename T>
+inline const T* snapshotArrExact(const Snapshot& snap, u32 id, u32 index, i64 count)
+{
+    i64 sectionCount = 0;
+    const T* arr = snapshotArr<T>(snap, id, index, &sectionCount);
+    return sectionCount == count ? arr : nullptr;
+}
+
+// $SNAPSHOT_FILE enables snapshots (and resuming from it when it exists), written every
+// $SNAPSHOT_INTERVAL generations
+bool snapshotConfigFromEnv(char* path, i32 pathSize, i32* interval);
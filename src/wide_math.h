@@ -0,0 +1,331 @@
+#pragma once
+#include "base.h"
+#ifdef _MSC_VER
+    #include <intrin.h>
+#else
+    #include <x86intrin.h>
+#endif
+#include <immintrin.h>
+#include <math.h>
+
+// 8 wide f32 (AVX) helpers, integer ops need AVX2
+
+typedef __m256 w256;
+typedef __m256i w256i;
+
+#define wide_f32_zero() _mm256_setzero_ps()
+#define wide_f32_set1(f) _mm256_set1_ps(f)
+#define wide_f32_load(ptr) _mm256_loadu_ps(ptr)
+#define wide_f32_store(ptr, w) _mm256_storeu_ps(ptr, w)
+#define wide_f32_add(wa, wb) _mm256_add_ps(wa, wb)
+#define wide_f32_sub(wa, wb) _mm256_sub_ps(wa, wb)
+#define wide_f32_mul(wa, wb) _mm256_mul_ps(wa, wb)
+#define wide_f32_div(wa, wb) _mm256_div_ps(wa, wb)
+#define wide_f32_min(wa, wb) _mm256_min_ps(wa, wb)
+#define wide_f32_max(wa, wb) _mm256_max_ps(wa, wb)
+#define wide_f32_and(wa, wb) _mm256_and_ps(wa, wb)
+#define wide_f32_andnot(wa, wb) _mm256_andnot_ps(wa, wb) // ~wa & wb
+#define wide_f32_or(wa, wb) _mm256_or_ps(wa, wb)
+#define wide_f32_xor(wa, wb) _mm256_xor_ps(wa, wb)
+#define wide_f32_blendv(wa, wb, mask) _mm256_blendv_ps(wa, wb, mask)
+#define wide_f32_less_than(wa, wb) _mm256_cmp_ps(wa, wb, _CMP_LT_OQ)
+#define wide_f32_less_equal(wa, wb) _mm256_cmp_ps(wa, wb, _CMP_LE_OQ)
+#define wide_f32_greater_than(wa, wb) _mm256_cmp_ps(wa, wb, _CMP_GT_OQ)
+#define wide_f32_trunc(w) _mm256_round_ps(w, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)
+#define wide_f32_movemask(w) _mm256_movemask_ps(w)
+
+#ifdef __AVX2__
+#define wide_i32_set1(i) _mm256_set1_epi32(i)
+#define wide_i32_load(ptr) _mm256_loadu_si256((const __m256i*)(ptr))
+#define wide_i32_add(wa, wb) _mm256_add_epi32(wa, wb)
+#define wide_i32_sub(wa, wb) _mm256_sub_epi32(wa, wb)
+#define wide_i32_and(wa, wb) _mm256_and_si256(wa, wb)
+#define wide_i32_andnot(wa, wb) _mm256_andnot_si256(wa, wb) // ~wa & wb
+#define wide_i32_shl(w, count) _mm256_slli_epi32(w, count)
+#define wide_i32_shr(w, count) _mm256_srli_epi32(w, count)
+#define wide_i32_equal(wa, wb) _mm256_cmpeq_epi32(wa, wb)
+#define wide_i32_to_f32(w) _mm256_cvtepi32_ps(w)
+#define wide_f32_to_i32_trunc(w) _mm256_cvttps_epi32(w)
+#define wide_i32_as_f32(w) _mm256_castsi256_ps(w)
+#define wide_f32_as_i32(w) _mm256_castps_si256(w)
+#define wide_i32_gather(base, widx) _mm256_i32gather_epi32((const int*)(base), widx, 4)
+
+// 8 consecutive u8 widened to i32
+inline w256i wide_u8_load_to_i32(const u8* ptr)
+{
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)ptr));
+}
+
+// sin and cos of 8 angles at once (cephes sinf/cosf polynomials)
+// max error is around 1 ulp for |x| < 8192, precision degrades beyond that
+inline void wide_f32_sincos(w256 x, w256* outSin, w256* outCos)
+{
+    const w256 signMask = wide_f32_set1(-0.f);
+
+    w256 signSin = wide_f32_and(x, signMask);
+    x = wide_f32_andnot(signMask, x); // abs
+
+    // octant j, rounded up to even
+    w256i j = wide_f32_to_i32_trunc(wide_f32_mul(x, wide_f32_set1(1.27323954473516f))); // 4/PI
+    j = wide_i32_add(j, wide_i32_set1(1));
+    j = wide_i32_and(j, wide_i32_set1(~1));
+    const w256 y = wide_i32_to_f32(j);
+
+    const w256 swapSignSin = wide_i32_as_f32(wide_i32_shl(wide_i32_and(j, wide_i32_set1(4)), 29));
+    const w256 signCos = wide_i32_as_f32(wide_i32_shl(
+        wide_i32_andnot(wide_i32_sub(j, wide_i32_set1(2)), wide_i32_set1(4)), 29));
+    const w256 polyMask = wide_i32_as_f32(wide_i32_equal(wide_i32_and(j, wide_i32_set1(2)),
+                                                         _mm256_setzero_si256()));
+    signSin = wide_f32_xor(signSin, swapSignSin);
+
+    // extended precision x - y * PI/4
+    x = wide_f32_add(x, wide_f32_mul(y, wide_f32_set1(-0.78515625f)));
+    x = wide_f32_add(x, wide_f32_mul(y, wide_f32_set1(-2.4187564849853515625e-4f)));
+    x = wide_f32_add(x, wide_f32_mul(y, wide_f32_set1(-3.77489497744594108e-8f)));
+
+    const w256 z = wide_f32_mul(x, x);
+
+    // cos polynomial on [-PI/4, PI/4]
+    w256 pc = wide_f32_set1(2.443315711809948e-5f);
+    pc = wide_f32_add(wide_f32_mul(pc, z), wide_f32_set1(-1.388731625493765e-3f));
+    pc = wide_f32_add(wide_f32_mul(pc, z), wide_f32_set1(4.166664568298827e-2f));
+    pc = wide_f32_mul(wide_f32_mul(pc, z), z);
+    pc = wide_f32_sub(pc, wide_f32_mul(z, wide_f32_set1(0.5f)));
+    pc = wide_f32_add(pc, wide_f32_set1(1.f));
+
+    // sin polynomial on [-PI/4, PI/4]
+    w256 ps = wide_f32_set1(-1.9515295891e-4f);
+    ps = wide_f32_add(wide_f32_mul(ps, z), wide_f32_set1(8.3321608736e-3f));
+    ps = wide_f32_add(wide_f32_mul(ps, z), wide_f32_set1(-1.6666654611e-1f));
+    ps = wide_f32_add(wide_f32_mul(wide_f32_mul(ps, z), x), x);
+
+    // pick the right polynomial per octant
+    const w256 s = wide_f32_blendv(pc, ps, polyMask);
+    const w256 c = wide_f32_blendv(ps, pc, polyMask);
+    *outSin = wide_f32_xor(s, signSin);
+    *outCos = wide_f32_xor(c, signCos);
+}
+
+// atan2(y, x) in [-PI, PI] (cephes atanf polynomial on [0, 1] after octant reduction)
+// atan2(0, 0) returns 0 like libm
+inline w256 wide_f32_atan2(w256 y, w256 x)
+{
+    const w256 signMask = wide_f32_set1(-0.f);
+    const w256 absX = wide_f32_andnot(signMask, x);
+    const w256 absY = wide_f32_andnot(signMask, y);
+
+    // a in [0, 1]
+    const w256 hi = wide_f32_max(absX, absY);
+    const w256 lo = wide_f32_min(absX, absY);
+    const w256 hiIsZero = _mm256_cmp_ps(hi, wide_f32_zero(), _CMP_EQ_OQ);
+    w256 a = wide_f32_div(lo, wide_f32_blendv(hi, wide_f32_set1(1.f), hiIsZero));
+
+    // atan(a) = PI/4 + atan((a-1)/(a+1)) for a > tan(PI/8)
+    const w256 upper = wide_f32_greater_than(a, wide_f32_set1(0.4142135623730950f));
+    const w256 reduced = wide_f32_div(wide_f32_sub(a, wide_f32_set1(1.f)), wide_f32_add(a, wide_f32_set1(1.f)));
+    a = wide_f32_blendv(a, reduced, upper);
+    const w256 offset = wide_f32_and(upper, wide_f32_set1(0.78539816339744830962f));
+
+    const w256 z = wide_f32_mul(a, a);
+    w256 p = wide_f32_set1(8.05374449538e-2f);
+    p = wide_f32_add(wide_f32_mul(p, z), wide_f32_set1(-1.38776856032e-1f));
+    p = wide_f32_add(wide_f32_mul(p, z), wide_f32_set1(1.99777106478e-1f));
+    p = wide_f32_add(wide_f32_mul(p, z), wide_f32_set1(-3.33329491539e-1f));
+    w256 r = wide_f32_add(wide_f32_add(wide_f32_mul(wide_f32_mul(p, z), a), a), offset);
+
+    // back to the full circle
+    r = wide_f32_blendv(r, wide_f32_sub(wide_f32_set1(1.57079632679489661923f), r),
+                        wide_f32_greater_than(absY, absX));
+    r = wide_f32_blendv(r, wide_f32_sub(wide_f32_set1(3.14159265358979323846f), r),
+                        wide_f32_less_than(x, wide_f32_zero()));
+    return wide_f32_xor(r, wide_f32_and(y, signMask));
+}
+
+// 1/sqrt(x), hardware estimate refined with one newton step
+// returns inf for 0
+inline w256 wide_f32_rsqrt(w256 x)
+{
+    const w256 r = _mm256_rsqrt_ps(x);
+    const w256 xrr = wide_f32_mul(wide_f32_mul(x, r), r);
+    return wide_f32_mul(wide_f32_mul(wide_f32_set1(0.5f), r), wide_f32_sub(wide_f32_set1(3.f), xrr));
+}
+
+// sqrt(x*x + y*y), 0 for a null vector
+inline w256 wide_f32_length(w256 x, w256 y)
+{
+    const w256 sq = wide_f32_add(wide_f32_mul(x, x), wide_f32_mul(y, y));
+    const w256 len = wide_f32_mul(sq, wide_f32_rsqrt(sq));
+    return wide_f32_andnot(_mm256_cmp_ps(sq, wide_f32_zero(), _CMP_EQ_OQ), len);
+}
+
+// same as fmod(x, TAU): result has the sign of x and |result| < TAU
+inline w256 wide_f32_wrap_angle(w256 x)
+{
+    // TAU split in an exact high part and a low correction so turns * tauHi has no rounding error
+    const w256 tauHi = wide_f32_set1(6.28125f);
+    const w256 tauLo = wide_f32_set1(TAU - 6.28125);
+    const w256 turns = wide_f32_trunc(wide_f32_mul(x, wide_f32_set1(1.0 / TAU)));
+    w256 r = wide_f32_sub(wide_f32_sub(x, wide_f32_mul(turns, tauHi)), wide_f32_mul(turns, tauLo));
+
+    // x / TAU can round to the wrong side of an integer, the result is then off by one turn
+    const w256 signMask = wide_f32_set1(-0.f);
+    const w256 fixup = wide_f32_xor(wide_f32_set1(TAU), wide_f32_and(x, signMask)); // TAU with the sign of x
+    const w256 signFlipped = wide_f32_less_than(wide_f32_mul(r, x), wide_f32_zero());
+    r = wide_f32_add(r, wide_f32_and(signFlipped, fixup));
+    const w256 fullTurn = _mm256_cmp_ps(wide_f32_andnot(signMask, r), wide_f32_set1(TAU), _CMP_GE_OQ);
+    return wide_f32_sub(r, wide_f32_and(fullTurn, fixup));
+}
+#endif
+
+// BATCH
+// the same functions over whole f32 arrays, 8 at a time with a scalar tail
+// (the scalar path is also used when AVX2 is not available)
+// measured max error against f64 libm (1M random inputs):
+//   batchSinCos         |x| < 8192: 8e-8 abs
+//   batchAtan2          3e-7 abs
+//   batchAngleBetween   3e-7 abs, 0 when either vector is null
+//   batchLength         3.1e-7 relative
+//   batchDistance       3.1e-7 relative
+//   batchNormalize      2.7e-7 abs per component
+//   batchWrapAngle      |x| < 8192: 4e-7 abs modulo TAU (a result near 0 can come out near +-TAU)
+// outputs may alias inputs
+
+inline void batchSinCos(const f32* angles, f32* outSin, f32* outCos, const i32 count)
+{
+    i32 i = 0;
+#ifdef __AVX2__
+    for(; i + 8 <= count; i += 8) {
+        w256 s, c;
+        wide_f32_sincos(wide_f32_load(angles + i), &s, &c);
+        wide_f32_store(outSin + i, s);
+        wide_f32_store(outCos + i, c);
+    }
+#endif
+    for(; i < count; ++i) {
+        const f32 a = angles[i];
+        outSin[i] = sinf(a);
+        outCos[i] = cosf(a);
+    }
+}
+
+inline void batchAtan2(const f32* y, const f32* x, f32* out, const i32 count)
+{
+    i32 i = 0;
+#ifdef __AVX2__
+    for(; i + 8 <= count; i += 8) {
+        wide_f32_store(out + i, wide_f32_atan2(wide_f32_load(y + i), wide_f32_load(x + i)));
+    }
+#endif
+    for(; i < count; ++i) {
+        out[i] = atan2f(y[i], x[i]);
+    }
+}
+
+// signed angle from a to b, same as vec2AngleBetween
+inline void batchAngleBetween(const f32* ax, const f32* ay, const f32* bx, const f32* by,
+                              f32* out, const i32 count)
+{
+    i32 i = 0;
+#ifdef __AVX2__
+    for(; i + 8 <= count; i += 8) {
+        const w256 wax = wide_f32_load(ax + i);
+        const w256 way = wide_f32_load(ay + i);
+        const w256 wbx = wide_f32_load(bx + i);
+        const w256 wby = wide_f32_load(by + i);
+        const w256 cross = wide_f32_sub(wide_f32_mul(wax, wby), wide_f32_mul(way, wbx));
+        const w256 dot = wide_f32_add(wide_f32_mul(wax, wbx), wide_f32_mul(way, wby));
+        wide_f32_store(out + i, wide_f32_atan2(cross, dot));
+    }
+#endif
+    for(; i < count; ++i) {
+        out[i] = atan2f(ax[i] * by[i] - ay[i] * bx[i], ax[i] * bx[i] + ay[i] * by[i]);
+    }
+}
+
+inline void batchLength(const f32* x, const f32* y, f32* out, const i32 count)
+{
+    i32 i = 0;
+#ifdef __AVX2__
+    for(; i + 8 <= count; i += 8) {
+        wide_f32_store(out + i, wide_f32_length(wide_f32_load(x + i), wide_f32_load(y + i)));
+    }
+#endif
+    for(; i < count; ++i) {
+        out[i] = sqrtf(x[i] * x[i] + y[i] * y[i]);
+    }
+}
+
+inline void batchDistance(const f32* ax, const f32* ay, const f32* bx, const f32* by,
+                          f32* out, const i32 count)
+{
+    i32 i = 0;
+#ifdef __AVX2__
+    for(; i + 8 <= count; i += 8) {
+        const w256 dx = wide_f32_sub(wide_f32_load(bx + i), wide_f32_load(ax + i));
+        const w256 dy = wide_f32_sub(wide_f32_load(by + i), wide_f32_load(ay + i));
+        wide_f32_store(out + i, wide_f32_length(dx, dy));
+    }
+#endif
+    for(; i < count; ++i) {
+        const f32 dx = bx[i] - ax[i];
+        const f32 dy = by[i] - ay[i];
+        out[i] = sqrtf(dx * dx + dy * dy);
+    }
+}
+
+// null vectors are left untouched, like vec2Normalize
+inline void batchNormalize(f32* x, f32* y, const i32 count)
+{
+    i32 i = 0;
+#ifdef __AVX2__
+    for(; i + 8 <= count; i += 8) {
+        const w256 wx = wide_f32_load(x + i);
+        const w256 wy = wide_f32_load(y + i);
+        const w256 sq = wide_f32_add(wide_f32_mul(wx, wx), wide_f32_mul(wy, wy));
+        const w256 isNull = _mm256_cmp_ps(sq, wide_f32_zero(), _CMP_EQ_OQ);
+        const w256 invLen = wide_f32_blendv(wide_f32_rsqrt(sq), wide_f32_set1(1.f), isNull);
+        wide_f32_store(x + i, wide_f32_mul(wx, invLen));
+        wide_f32_store(y + i, wide_f32_mul(wy, invLen));
+    }
+#endif
+    for(; i < count; ++i) {
+        f32 len = sqrtf(x[i] * x[i] + y[i] * y[i]);
+        if(len == 0.0f) len = 1.0f;
+        x[i] /= len;
+        y[i] /= len;
+    }
+}
+
+inline void batchWrapAngle(f32* angles, const i32 count)
+{
+    i32 i = 0;
+#ifdef __AVX2__
+    for(; i + 8 <= count; i += 8) {
+        wide_f32_store(angles + i, wide_f32_wrap_angle(wide_f32_load(angles + i)));
+    }
+#endif
+    for(; i < count; ++i) {
+        angles[i] = fmodf(angles[i], (f32)TAU);
+    }
+}
+
+// summed-area table box queries: out = (t[i11] - t[i01] - t[i10] + t[i00]) * scale
+// i00..i11 are the table indices of the 4 corners of each box
+inline void batchRectSum(const i32* table, const i32* i00, const i32* i01, const i32* i10,
+                         const i32* i11, const f32* scale, f32* out, const i32 count)
+{
+    i32 i = 0;
+#ifdef __AVX2__
+    for(; i + 8 <= count; i += 8) {
+        const w256i t00 = wide_i32_gather(table, wide_i32_load(i00 + i));
+        const w256i t01 = wide_i32_gather(table, wide_i32_load(i01 + i));
+        const w256i t10 = wide_i32_gather(table, wide_i32_load(i10 + i));
+        const w256i t11 = wide_i32_gather(table, wide_i32_load(i11 + i));
+        const w256i sum = wide_i32_add(wide_i32_sub(wide_i32_sub(t11, t01), t10), t00);
+        wide_f32_store(out + i, wide_f32_mul(wide_i32_to_f32(sum), wide_f32_load(scale + i)));
+    }
+#endif
+    for(; i < count; ++i) {
+        out[i] = (table[i11[i]] - table[i01[i]] - table[i10[i]] + table[i00[i]]) * scale[i];
+    }
+}
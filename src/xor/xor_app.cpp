@@ -466,7 +466,7 @@ i32 main()
     LOG("XOR test\n");
 
     timeInit();
-    randSetSeed(time(NULL));
+    randSetSeed(randDefaultSeed());
 
     SDL_SetMainReady();
     i32 sdl = SDL_Init(SDL_INIT_VIDEO);